@@ -214,7 +214,7 @@ namespace dl
         for (int r = 0; r < h; ++r)
         {
             const auto* inPtr = rgb.atRowPtr(r);
-            const auto* lastInPtr = rgb.atRowPtr(r+1);
+            const auto* lastInPtr = inPtr + w;
             auto* outPtr = outImg.atRowPtr(r);
             while (inPtr != lastInPtr)
             {
@@ -234,7 +234,7 @@ namespace dl
         for (int r = 0; r < h; ++r)
         {
             const auto* inPtr = srgb.atRowPtr(r);
-            const auto* lastInPtr = srgb.atRowPtr(r+1);
+            const auto* lastInPtr = inPtr + w;
             auto* outPtr = outImg.atRowPtr(r);
             while (inPtr != lastInPtr)
             {
@@ -12,12 +12,79 @@
 #include <Dalton/ColorConversion.h>
 
 #include <gl3w/GL/gl3w.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <functional>
+#include <map>
+
 namespace dl
 {
 
+namespace
+{
+
+    std::string replacePrefix (const char* code, const std::string& prefix)
+    {
+        const std::string placeholder = "PREFIX_";
+        std::string output = code;
+        size_t pos = 0;
+        while ((pos = output.find (placeholder, pos)) != std::string::npos)
+        {
+            output.replace (pos, placeholder.size(), prefix);
+            pos += prefix.size();
+        }
+        return output;
+    }
+
+    // Runs the pixel functions one after the other in a single pass.
+    std::string fragmentShaderForPixelFunctions (const std::vector<const GLPixelFunction*>& functions,
+                                                 const std::vector<std::string>& prefixes)
+    {
+        std::string source =
+            "uniform sampler2D Texture;\n"
+            "in vec2 Frag_UV;\n"
+            "out vec4 Out_Color;\n";
+
+        for (size_t i = 0; i < functions.size(); ++i)
+            source += replacePrefix (functions[i]->glslCode, prefixes[i]);
+
+        source += "void main()\n{\n    vec4 srgba = texture(Texture, Frag_UV.st);\n";
+        for (size_t i = 0; i < functions.size(); ++i)
+            source += "    srgba = " + prefixes[i] + "apply(srgba);\n";
+        source += "    Out_Color = srgba;\n}\n";
+        return source;
+    }
+
+    std::vector<int> uniformLocations (const GLShader& shader, const GLPixelFunction& function, const std::string& prefix)
+    {
+        std::vector<int> locations;
+        for (const auto& name : function.uniformNames)
+            locations.push_back (glGetUniformLocation (shader.glHandles().shaderHandle, (prefix + name).c_str()));
+        return locations;
+    }
+
+    dl::Rect uvRectForTextureRect (const dl::Rect& textureRect, int textureWidth, int textureHeight)
+    {
+        return dl::Rect::from_x_y_w_h (textureRect.origin.x / textureWidth,
+                                       textureRect.origin.y / textureHeight,
+                                       textureRect.size.x / textureWidth,
+                                       textureRect.size.y / textureHeight);
+    }
+
+    template <class T>
+    void hashCombine (uint64_t& seed, const T& v)
+    {
+        seed ^= uint64_t(std::hash<T>()(v)) + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+    }
+
+} // anonymous
+
 struct GLFilter::Impl
 {
     GLShader shader;
+    std::vector<int> uniformLocations;
 };
 
 GLFilter::GLFilter()
@@ -32,6 +99,15 @@ void GLFilter::initializeGL(const char *glslVersionString, const char *vertexSha
     impl->shader.initialize (glslVersionString, vertexShader, fragmentShader);
 }
 
+void GLFilter::initializeGLFromPixelFunction ()
+{
+    const GLPixelFunction* function = pixelFunction ();
+    dl_assert (function, "Only for filters with a pixel function.");
+    const std::string fragmentShader = fragmentShaderForPixelFunctions ({function}, {""});
+    initializeGL (glslVersion(), nullptr, fragmentShader.c_str());
+    impl->uniformLocations = uniformLocations (impl->shader, *function, "");
+}
+
 GLShader* GLFilter::glShader () const
 {
     return &impl->shader;
@@ -39,7 +115,13 @@ GLShader* GLFilter::glShader () const
 
 void GLFilter::enableGLShader()
 {
+    // Compile on first use, most filters are never used in a session.
+    if (!impl->shader.isInitialized ())
+        initializeGL ();
+
     impl->shader.enable ();
+    if (pixelFunction ())
+        setUniforms (impl->uniformLocations);
 }
 
 void GLFilter::disableGLShader()
@@ -57,6 +139,21 @@ void GLFilter::applyCPU (const ImageSRGBA& input, ImageSRGBA& output) const
     dl_assert (false, "unimplemented");
 }
 
+void GLFilter::applyCPUOnRegion (const ImageSRGBA& input, const dl::Rect& inputRect, ImageSRGBA& output) const
+{
+    const dl::Rect rect = inputRect.intersect (dl::Rect::from_x_y_w_h (0, 0, input.width(), input.height()));
+    const int x = int(rect.origin.x);
+    const int y = int(rect.origin.y);
+
+    // No copy, the view just points to the first pixel of the area.
+    const ImageSRGBA inputView (const_cast<uint8_t*>(reinterpret_cast<const uint8_t*>(input.atRowPtr(y) + x)),
+                                int(rect.size.x),
+                                int(rect.size.y),
+                                int(input.bytesPerRow()),
+                                ImageSRGBA::noopReleaseFunc());
+    applyCPU (inputView, output);
+}
+
 } // dl
 
 // --------------------------------------------------------------------------------
@@ -85,10 +182,16 @@ void GLFilterProcessor::initializeGL ()
 
 void GLFilterProcessor::render (GLFilter& filter, uint32_t inputTextureId, int width, int height, ImageSRGBA* output)
 {
-    impl->frameBuffer.enable(width, height);
-    glBindTexture(GL_TEXTURE_2D, inputTextureId);
+    render (filter, inputTextureId, width, height, dl::Rect::from_x_y_w_h (0, 0, width, height), output);
+}
+
+void GLFilterProcessor::render (GLFilter& filter, uint32_t inputTextureId, int width, int height, const dl::Rect& textureRect, ImageSRGBA* output)
+{
+    GLScopedGpuTimer _ (filter.name());
+    impl->frameBuffer.enable(int(textureRect.size.x), int(textureRect.size.y));
+    GLStateCache::current().bindTexture2D (inputTextureId);
     filter.enableGLShader ();
-    impl->renderer.render ();
+    impl->renderer.render (uvRectForTextureRect (textureRect, width, height));
     filter.disableGLShader ();
     if (output)
     {
@@ -97,6 +200,38 @@ void GLFilterProcessor::render (GLFilter& filter, uint32_t inputTextureId, int w
     impl->frameBuffer.disable();
 }
 
+void GLFilterProcessor::render (GLFilter& filter, const GLTiledTexture& input, ImageSRGBA& output)
+{
+    GLScopedGpuTimer _ (filter.name());
+    output.ensureAllocatedBufferForSize (input.width(), input.height());
+    if (input.numTiles() == 0)
+        return;
+
+    // The textures of the inner tiles are larger, they have a border on both sides.
+    int frameBufferWidth = 0;
+    int frameBufferHeight = 0;
+    for (int i = 0; i < input.numTiles(); ++i)
+    {
+        frameBufferWidth = std::max (frameBufferWidth, int(input.tile(i).textureRect.size.x));
+        frameBufferHeight = std::max (frameBufferHeight, int(input.tile(i).textureRect.size.y));
+    }
+    impl->frameBuffer.enable (frameBufferWidth, frameBufferHeight);
+    filter.enableGLShader ();
+    for (int i = 0; i < input.numTiles(); ++i)
+    {
+        // The whole texture gets rendered, but only the imageRect of the tile is kept.
+        const GLTiledTexture::Tile& tile = input.tile(i);
+        glViewport (0, 0, int(tile.textureRect.size.x), int(tile.textureRect.size.y));
+        GLStateCache::current().bindTexture2D (tile.texture.textureId());
+        impl->renderer.render ();
+        dl::Rect outputRect = tile.imageRect;
+        outputRect.origin -= tile.textureRect.origin;
+        impl->frameBuffer.downloadBufferArea (outputRect, output, int(tile.imageRect.origin.x), int(tile.imageRect.origin.y));
+    }
+    filter.disableGLShader ();
+    impl->frameBuffer.disable ();
+}
+
 GLTexture& GLFilterProcessor::filteredTexture()
 {
     return impl->frameBuffer.outputColorTexture();
@@ -104,6 +239,275 @@ GLTexture& GLFilterProcessor::filteredTexture()
 
 } // dl
 
+// --------------------------------------------------------------------------------
+// GLFilterGraph
+// --------------------------------------------------------------------------------
+
+namespace dl
+{
+
+struct GLFilterGraph::Impl
+{
+    struct FusedShader
+    {
+        GLShader shader;
+        // One per filter.
+        std::vector<std::vector<int>> uniformLocations;
+    };
+
+    // Either a single filter with its own shader, or a fused sequence.
+    struct Pass
+    {
+        std::vector<GLFilter*> filters;
+        FusedShader* fusedShader = nullptr;
+    };
+
+    std::vector<GLFilter*> filters;
+    bool fusionEnabled = true;
+    dl::Rect regionOfInterest = dl::Rect::from_x_y_w_h (0, 0, 0, 0);
+    dl::Rect filteredRegion = dl::Rect::from_x_y_w_h (0, 0, 0, 0);
+
+    // Kept when the filters change, there are only a few combinations in practice.
+    std::map<std::vector<GLFilter*>, std::unique_ptr<FusedShader>> fusedShaders;
+
+    // Ping-pong between the two, the last pass output stays valid until the next render.
+    std::array<GLFrameBuffer, 2> frameBuffers;
+    int outputFrameBufferIndex = 0;
+    int numPasses = 0;
+
+    GLImageRenderer renderer;
+    GLShader copyShader;
+
+    // What the current output got rendered from, see renderIfChanged.
+    struct RenderedState
+    {
+        bool isValid = false;
+        uint32_t inputTextureId = 0;
+        uint64_t inputContentGeneration = 0;
+        int width = 0;
+        int height = 0;
+        bool fusionEnabled = true;
+        dl::Rect regionOfInterest = dl::Rect::from_x_y_w_h (0, 0, 0, 0);
+        std::vector<GLFilter*> filters;
+        std::vector<uint64_t> paramsHashes;
+
+        bool operator== (const RenderedState& rhs) const
+        {
+            return isValid == rhs.isValid
+                && inputTextureId == rhs.inputTextureId
+                && inputContentGeneration == rhs.inputContentGeneration
+                && width == rhs.width
+                && height == rhs.height
+                && fusionEnabled == rhs.fusionEnabled
+                && regionOfInterest.origin.x == rhs.regionOfInterest.origin.x
+                && regionOfInterest.origin.y == rhs.regionOfInterest.origin.y
+                && regionOfInterest.size.x == rhs.regionOfInterest.size.x
+                && regionOfInterest.size.y == rhs.regionOfInterest.size.y
+                && filters == rhs.filters
+                && paramsHashes == rhs.paramsHashes;
+        }
+    };
+    RenderedState renderedState;
+
+    FusedShader* fusedShaderFor (const std::vector<GLFilter*>& filters)
+    {
+        auto& fused = fusedShaders[filters];
+        if (fused)
+            return fused.get();
+
+        std::vector<const GLPixelFunction*> functions;
+        std::vector<std::string> prefixes;
+        for (size_t i = 0; i < filters.size(); ++i)
+        {
+            functions.push_back (filters[i]->pixelFunction());
+            prefixes.push_back ("f" + std::to_string(i) + "_");
+        }
+
+        fused = std::make_unique<FusedShader>();
+        const std::string fragmentShader = fragmentShaderForPixelFunctions (functions, prefixes);
+        fused->shader.initialize (glslVersion(), nullptr, fragmentShader.c_str());
+        for (size_t i = 0; i < filters.size(); ++i)
+            fused->uniformLocations.push_back (uniformLocations (fused->shader, *functions[i], prefixes[i]));
+        return fused.get();
+    }
+
+    // Fused passes get the names of all their filters.
+    std::string timerName (const std::vector<Pass>& passes, int passIndex) const
+    {
+        if (passes.empty())
+            return "Copy";
+
+        std::string name;
+        for (const auto* filter : passes[passIndex].filters)
+            name += (name.empty() ? "" : "+") + std::string(filter->name());
+        return name;
+    }
+
+    std::vector<Pass> computePasses ()
+    {
+        std::vector<Pass> passes;
+        for (size_t i = 0; i < filters.size(); )
+        {
+            Pass pass;
+            pass.filters.push_back (filters[i++]);
+            if (fusionEnabled && pass.filters[0]->pixelFunction())
+            {
+                while (i < filters.size() && filters[i]->pixelFunction())
+                    pass.filters.push_back (filters[i++]);
+            }
+
+            if (pass.filters.size() > 1)
+                pass.fusedShader = fusedShaderFor (pass.filters);
+            passes.push_back (std::move(pass));
+        }
+        return passes;
+    }
+};
+
+GLFilterGraph::GLFilterGraph()
+: impl (new Impl())
+{}
+
+GLFilterGraph::~GLFilterGraph() = default;
+
+void GLFilterGraph::initializeGL ()
+{
+    impl->renderer.initializeGL();
+}
+
+void GLFilterGraph::setFilters (const std::vector<GLFilter*>& filters)
+{
+    impl->filters = filters;
+}
+
+const std::vector<GLFilter*>& GLFilterGraph::filters () const
+{
+    return impl->filters;
+}
+
+void GLFilterGraph::setFusionEnabled (bool enabled)
+{
+    impl->fusionEnabled = enabled;
+}
+
+void GLFilterGraph::setRegionOfInterest (const dl::Rect& textureRect)
+{
+    impl->regionOfInterest = textureRect;
+}
+
+dl::Rect GLFilterGraph::filteredRegion () const
+{
+    return impl->filteredRegion;
+}
+
+dl::Rect GLFilterGraph::textureRectForUVRect (const dl::Rect& uvRect, int textureWidth, int textureHeight, int marginInPixels)
+{
+    const double x0 = std::floor (uvRect.origin.x * textureWidth) - marginInPixels;
+    const double y0 = std::floor (uvRect.origin.y * textureHeight) - marginInPixels;
+    const double x1 = std::ceil ((uvRect.origin.x + uvRect.size.x) * textureWidth) + marginInPixels;
+    const double y1 = std::ceil ((uvRect.origin.y + uvRect.size.y) * textureHeight) + marginInPixels;
+    return dl::Rect::from_x_y_w_h (x0, y0, x1 - x0, y1 - y0).intersect (dl::Rect::from_x_y_w_h (0, 0, textureWidth, textureHeight));
+}
+
+bool GLFilterGraph::renderIfChanged (const GLTexture& inputTexture)
+{
+    Impl::RenderedState state;
+    state.isValid = true;
+    state.inputTextureId = inputTexture.textureId();
+    state.inputContentGeneration = inputTexture.contentGeneration();
+    state.width = inputTexture.width();
+    state.height = inputTexture.height();
+    state.fusionEnabled = impl->fusionEnabled;
+    state.regionOfInterest = impl->regionOfInterest;
+    state.filters = impl->filters;
+    for (const auto* filter : impl->filters)
+        state.paramsHashes.push_back (filter->paramsHash());
+
+    if (state == impl->renderedState)
+        return false;
+
+    render (state.inputTextureId, state.width, state.height);
+    impl->renderedState = std::move(state);
+    return true;
+}
+
+void GLFilterGraph::render (uint32_t inputTextureId, int width, int height, ImageSRGBA* output)
+{
+    // We don't know what the input is, the next renderIfChanged will render.
+    impl->renderedState.isValid = false;
+
+    const std::vector<Impl::Pass> passes = impl->computePasses ();
+    const int numPasses = std::max (int(passes.size()), 1);
+
+    const dl::Rect fullRect = dl::Rect::from_x_y_w_h (0, 0, width, height);
+    dl::Rect region = impl->regionOfInterest.intersect (fullRect);
+    if (region.area() == 0.)
+        region = fullRect;
+
+    // Only the first pass reads a part of its input, the next ones read
+    // the full output of the previous pass.
+    const dl::Rect firstPassUVRect = uvRectForTextureRect (region, width, height);
+    const dl::Rect fullUVRect = dl::Rect::from_x_y_w_h (0, 0, 1, 1);
+
+    uint32_t passInputTextureId = inputTextureId;
+    for (int i = 0; i < numPasses; ++i)
+    {
+        GLFrameBuffer& frameBuffer = impl->frameBuffers[i % 2];
+        frameBuffer.enable (int(region.size.x), int(region.size.y));
+        GLStateCache::current().bindTexture2D (passInputTextureId);
+        const dl::Rect& uvRect = i == 0 ? firstPassUVRect : fullUVRect;
+        // Only builds the name when the timers are enabled.
+        const std::string timerName = GLGpuTimers::isEnabled() ? impl->timerName (passes, i) : std::string();
+        GLScopedGpuTimer timer (timerName.c_str());
+
+        if (passes.empty())
+        {
+            if (!impl->copyShader.isInitialized ())
+                impl->copyShader.initialize (glslVersion(), nullptr, nullptr);
+            impl->copyShader.enable ();
+            impl->renderer.render (uvRect);
+            impl->copyShader.disable ();
+        }
+        else if (passes[i].fusedShader)
+        {
+            const Impl::Pass& pass = passes[i];
+            pass.fusedShader->shader.enable ();
+            for (size_t k = 0; k < pass.filters.size(); ++k)
+                pass.filters[k]->setUniforms (pass.fusedShader->uniformLocations[k]);
+            impl->renderer.render (uvRect);
+            pass.fusedShader->shader.disable ();
+        }
+        else
+        {
+            GLFilter* filter = passes[i].filters[0];
+            filter->enableGLShader ();
+            impl->renderer.render (uvRect);
+            filter->disableGLShader ();
+        }
+
+        if (output && i == numPasses - 1)
+            frameBuffer.downloadBuffer (*output);
+        frameBuffer.disable ();
+        passInputTextureId = frameBuffer.outputColorTexture().textureId();
+    }
+
+    impl->outputFrameBufferIndex = (numPasses - 1) % 2;
+    impl->numPasses = numPasses;
+    impl->filteredRegion = region;
+}
+
+GLTexture& GLFilterGraph::filteredTexture()
+{
+    return impl->frameBuffers[impl->outputFrameBufferIndex].outputColorTexture();
+}
+
+int GLFilterGraph::numPasses () const
+{
+    return impl->numPasses;
+}
+
+} // dl
+
 // --------------------------------------------------------------------------------
 // Simple filters
 // --------------------------------------------------------------------------------
@@ -112,12 +516,24 @@ namespace dl
 
 void Filter_FlipRedBlue::initializeGL ()
 { 
-    GLFilter::initializeGL (glslVersion(), nullptr, fragmentShader_FlipRedBlue_glsl_130); 
+    initializeGLFromPixelFunction ();
+}
+
+const GLPixelFunction* Filter_FlipRedBlue::pixelFunction () const
+{
+    static const GLPixelFunction function { pixelFunction_FlipRedBlue, {} };
+    return &function;
 }
 
 void Filter_FlipRedBlueAndInvertRed::initializeGL ()
 { 
-    GLFilter::initializeGL (glslVersion(), nullptr, fragmentShader_FlipRedBlue_InvertRed_glsl_130); 
+    initializeGLFromPixelFunction ();
+}
+
+const GLPixelFunction* Filter_FlipRedBlueAndInvertRed::pixelFunction () const
+{
+    static const GLPixelFunction function { pixelFunction_FlipRedBlue_InvertRed, {} };
+    return &function;
 }
 
 } // dl
@@ -127,20 +543,32 @@ namespace dl
 
 void Filter_HSVTransform::initializeGL ()
 {
-    GLFilter::initializeGL (glslVersion(), nullptr, fragmentShader_HSVTransform_glsl_130); 
+    initializeGLFromPixelFunction ();
+}
 
-    GLuint shaderHandle = glHandles().shaderHandle;
-    _attribLocationHueShift = (GLuint)glGetUniformLocation(shaderHandle, "u_hueShift");
-    _attribLocationSaturationScale = (GLuint)glGetUniformLocation(shaderHandle, "u_saturationScale");
-    _attribLocationHueQuantization = (GLuint)glGetUniformLocation(shaderHandle, "u_hueQuantization");
+const GLPixelFunction* Filter_HSVTransform::pixelFunction () const
+{
+    static const GLPixelFunction function {
+        pixelFunction_HSVTransform,
+        { "u_hueShift", "u_saturationScale", "u_hueQuantization" }
+    };
+    return &function;
 }
 
-void Filter_HSVTransform::enableGLShader ()
+void Filter_HSVTransform::setUniforms (const std::vector<int>& uniformLocations) const
 {
-    GLFilter::enableGLShader ();
-    glUniform1f(_attribLocationHueShift, _currentParams.hueShift / 360.f);
-    glUniform1f(_attribLocationSaturationScale, _currentParams.saturationScale);
-    glUniform1i(_attribLocationHueQuantization, _currentParams.hueQuantization);
+    glUniform1f(uniformLocations[0], _currentParams.hueShift / 360.f);
+    glUniform1f(uniformLocations[1], _currentParams.saturationScale);
+    glUniform1i(uniformLocations[2], _currentParams.hueQuantization);
+}
+
+uint64_t Filter_HSVTransform::paramsHash () const
+{
+    uint64_t hash = 0;
+    hashCombine (hash, _currentParams.hueShift);
+    hashCombine (hash, _currentParams.saturationScale);
+    hashCombine (hash, _currentParams.hueQuantization);
+    return hash;
 }
 
 } // dl
@@ -153,26 +581,47 @@ namespace dl
 
 void Filter_HighlightSimilarColors::initializeGL ()
 {
-    GLFilter::initializeGL (glslVersion(), nullptr, fragmentShader_highlightSameColor); 
-    GLuint shaderHandle = glHandles().shaderHandle;
-    _attribLocationRefColor_sRGB = (GLuint)glGetUniformLocation(shaderHandle, "u_refColor_sRGB");
-    _attribLocationDeltaH = (GLuint)glGetUniformLocation(shaderHandle, "u_deltaH_360");
-    _attribLocationDeltaS = (GLuint)glGetUniformLocation(shaderHandle, "u_deltaS_100");
-    _attribLocationDeltaV = (GLuint)glGetUniformLocation(shaderHandle, "u_deltaV_255");
-    _attribLocationFrameCount = (GLuint)glGetUniformLocation(shaderHandle, "u_frameCount");
+    initializeGLFromPixelFunction ();
+}
+
+const GLPixelFunction* Filter_HighlightSimilarColors::pixelFunction () const
+{
+    static const GLPixelFunction function {
+        pixelFunction_highlightSameColor,
+        { "u_refColor_sRGB", "u_deltaH_360", "u_deltaS_100", "u_deltaV_255" }
+    };
+    return &function;
 }
 
-void Filter_HighlightSimilarColors::enableGLShader ()
+void Filter_HighlightSimilarColors::setUniforms (const std::vector<int>& uniformLocations) const
 {
-    GLFilter::enableGLShader ();
-    glUniform3f(_attribLocationRefColor_sRGB,
+    glUniform3f(uniformLocations[0],
                 _currentParams.activeColorSRGB01.x,
                 _currentParams.activeColorSRGB01.y,
                 _currentParams.activeColorSRGB01.z);
-    glUniform1f(_attribLocationDeltaH, _currentParams.deltaH_360);
-    glUniform1f(_attribLocationDeltaS, _currentParams.deltaS_100);
-    glUniform1f(_attribLocationDeltaV, _currentParams.deltaV_255);
-    glUniform1i(_attribLocationFrameCount, _currentParams.frameCount / 2);
+    glUniform1f(uniformLocations[1], _currentParams.deltaH_360);
+    glUniform1f(uniformLocations[2], _currentParams.deltaS_100);
+    glUniform1f(uniformLocations[3], _currentParams.deltaV_255);
+}
+
+uint64_t Filter_HighlightSimilarColors::paramsHash () const
+{
+    uint64_t hash = 0;
+    hashCombine (hash, _currentParams.hasActiveColor);
+    hashCombine (hash, _currentParams.activeColorSRGB01.x);
+    hashCombine (hash, _currentParams.activeColorSRGB01.y);
+    hashCombine (hash, _currentParams.activeColorSRGB01.z);
+    hashCombine (hash, _currentParams.deltaH_360);
+    hashCombine (hash, _currentParams.deltaS_100);
+    hashCombine (hash, _currentParams.deltaV_255);
+    return hash;
+}
+
+float Filter_HighlightSimilarColors::blinkIntensity (double timeInSeconds)
+{
+    // Same period as the former per-frame animation at 60 fps.
+    const double periodInSeconds = 0.42;
+    return float(std::sin(timeInSeconds * 2.0 * M_PI / periodInSeconds) * 0.5 + 0.5);
 }
 
 } // dl
@@ -186,19 +635,32 @@ namespace dl
 
 void Filter_Daltonize::initializeGL ()
 {
-    GLFilter::initializeGL(glslVersion(), nullptr, fragmentShader_DaltonizeV1_glsl_130);
-    GLuint shaderHandle = glHandles().shaderHandle;
-    _attribLocationKind = (GLuint)glGetUniformLocation(shaderHandle, "u_kind");
-    _attribLocationSimulateOnly = (GLuint)glGetUniformLocation(shaderHandle, "u_simulateOnly");
-    _attribLocationSeverity = (GLuint)glGetUniformLocation(shaderHandle, "u_severity");    
+    initializeGLFromPixelFunction ();
+}
+
+const GLPixelFunction* Filter_Daltonize::pixelFunction () const
+{
+    static const GLPixelFunction function {
+        pixelFunction_DaltonizeV1,
+        { "u_kind", "u_simulateOnly", "u_severity" }
+    };
+    return &function;
+}
+
+void Filter_Daltonize::setUniforms (const std::vector<int>& uniformLocations) const
+{
+    glUniform1i(uniformLocations[0], static_cast<int>(_currentParams.kind));
+    glUniform1i(uniformLocations[1], _currentParams.simulateOnly);
+    glUniform1f(uniformLocations[2], _currentParams.severity);
 }
 
-void Filter_Daltonize::enableGLShader ()
+uint64_t Filter_Daltonize::paramsHash () const
 {
-    GLFilter::enableGLShader ();
-    glUniform1i(_attribLocationKind, static_cast<int>(_currentParams.kind));
-    glUniform1i(_attribLocationSimulateOnly, _currentParams.simulateOnly);
-    glUniform1f(_attribLocationSeverity, _currentParams.severity);
+    uint64_t hash = 0;
+    hashCombine (hash, static_cast<int>(_currentParams.kind));
+    hashCombine (hash, _currentParams.simulateOnly);
+    hashCombine (hash, _currentParams.severity);
+    return hash;
 }
 
 void applyDaltonizeSimulation (ImageLMS& lmsImage, Filter_Daltonize::Params::Kind blindness, float severity)
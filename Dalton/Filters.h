@@ -9,6 +9,7 @@
 #include <Dalton/Image.h>
 
 #include <string>
+#include <vector>
 
 namespace dl
 {
@@ -16,6 +17,19 @@ namespace dl
 struct GLShaderHandles;
 class GLShader;
 class GLTexture;
+class GLTiledTexture;
+
+// GLSL code of a filter that only depends on the input pixel, so it can
+// get fused with its neighbors into a single shader by GLFilterGraph. It
+// must define `vec4 PREFIX_apply (vec4 srgba)`. All the uniforms and helper
+// functions need to start with PREFIX_ too, it gets replaced to keep the
+// names unique in the fused shader.
+struct GLPixelFunction
+{
+    const char* glslCode = nullptr;
+    // Same order as the locations given to GLFilter::setUniforms.
+    std::vector<std::string> uniformNames;
+};
 
 class GLFilter
 {
@@ -26,17 +40,33 @@ public:
 public:
     // Default implementation is an assert.
     virtual void applyCPU (const ImageSRGBA& input, ImageSRGBA& output) const;
+    // Only filters the given area of the input, in pixels, without copying
+    // it first. The output has the size of the area.
+    void applyCPUOnRegion (const ImageSRGBA& input, const dl::Rect& inputRect, ImageSRGBA& output) const;
 
 public:
-    // GPU methods.
+    // GPU methods. initializeGL gets called by the first enableGLShader
+    // if needed, so the shaders of unused filters never get compiled.
     virtual void initializeGL () = 0;
+    // Used to label the GPU timings.
+    virtual const char* name () const = 0;
     virtual void enableGLShader ();
     virtual void disableGLShader ();
     const GLShaderHandles &glHandles() const;
     GLShader* glShader () const;
 
+    // Null if the filter can't be fused, e.g. it samples neighbor pixels.
+    virtual const GLPixelFunction* pixelFunction () const { return nullptr; }
+    // Must change whenever the params would change the output. Used by
+    // GLFilterGraph to skip the renders when nothing changed.
+    virtual uint64_t paramsHash () const { return 0; }
+    // Called with the shader enabled. The locations follow pixelFunction()->uniformNames.
+    virtual void setUniforms (const std::vector<int>& uniformLocations) const {}
+
 protected:
     void initializeGL(const char* glslVersionString, const char* vertexShader, const char* fragmentShader);
+    // Standalone shader running only the pixel function.
+    void initializeGLFromPixelFunction ();
 
 private:
     struct Impl;
@@ -52,10 +82,66 @@ public:
 public:
     void initializeGL ();
     void render (GLFilter& filter, uint32_t inputTextureId, int width, int height, ImageSRGBA* output = nullptr);
+    // Only filters the given area of the input texture, in pixels. The
+    // filtered texture has the size of the area.
+    void render (GLFilter& filter, uint32_t inputTextureId, int width, int height, const dl::Rect& textureRect, ImageSRGBA* output = nullptr);
+    // Filters each tile in turn into the same framebuffer and assembles
+    // the results in output. The filtered texture then only has the last tile.
+    void render (GLFilter& filter, const GLTiledTexture& input, ImageSRGBA& output);
+    GLTexture& filteredTexture();
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+// Chains several filters on the GPU. The passes alternate between two
+// framebuffers that get reused across renders, and consecutive filters
+// with a pixel function get fused into a single generated shader, so
+// stacking e.g. a correction and a simulation costs a single pass.
+// The filters are not owned.
+class GLFilterGraph
+{
+public:
+    GLFilterGraph();
+    ~GLFilterGraph();
+
+public:
+    void initializeGL ();
+
+    void setFilters (const std::vector<GLFilter*>& filters);
+    const std::vector<GLFilter*>& filters () const;
+
+    // Enabled by default. Fused passes don't round the intermediate
+    // results to 8 bits, so the output can be slightly different.
+    void setFusionEnabled (bool enabled);
+
+    // Only filter that area of the input, in pixels, e.g. the visible
+    // part of a zoomed image. The filtered texture then has the size of
+    // the area. The whole input gets filtered if the rect is empty, which
+    // is the default.
+    void setRegionOfInterest (const dl::Rect& textureRect);
+    // Area of the input covered by the filtered texture after the last render.
+    dl::Rect filteredRegion () const;
+
+    // Integer pixel rect covering the given UV area plus the margin,
+    // clipped to the texture.
+    static dl::Rect textureRectForUVRect (const dl::Rect& uvRect, int textureWidth, int textureHeight, int marginInPixels = 0);
+
+    // With no filter the input just gets copied.
+    void render (uint32_t inputTextureId, int width, int height, ImageSRGBA* output = nullptr);
+    // Skips the render if the content of the input texture, the filters
+    // and their params did not change since the last call, the filtered
+    // texture is then still valid. Returns true if it rendered.
+    bool renderIfChanged (const GLTexture& inputTexture);
     GLTexture& filteredTexture();
 
+    // Number of passes of the last render.
+    int numPasses () const;
+
 private:
     struct Impl;
+    friend struct Impl;
     std::unique_ptr<Impl> impl;
 };
 
@@ -75,13 +161,12 @@ public:
 
 public:
     virtual void initializeGL () override;
-    virtual void enableGLShader () override;
+    virtual const char* name () const override { return "HSVTransform"; }
+    virtual const GLPixelFunction* pixelFunction () const override;
+    virtual void setUniforms (const std::vector<int>& uniformLocations) const override;
+    virtual uint64_t paramsHash () const override;
 
 private:
-    unsigned _attribLocationHueShift = 0;
-    unsigned _attribLocationSaturationScale = 0;
-    unsigned _attribLocationHueQuantization = 0;
-
     Params _currentParams;
 };
 
@@ -89,12 +174,16 @@ class Filter_FlipRedBlue : public GLFilter
 {
 public:
     virtual void initializeGL () override;
+    virtual const char* name () const override { return "FlipRedBlue"; }
+    virtual const GLPixelFunction* pixelFunction () const override;
 };
 
 class Filter_FlipRedBlueAndInvertRed : public GLFilter
 {
 public:
     virtual void initializeGL () override;
+    virtual const char* name () const override { return "FlipRedBlueAndInvertRed"; }
+    virtual const GLPixelFunction* pixelFunction () const override;
 };
 
 class Filter_Daltonize : public GLFilter
@@ -120,16 +209,21 @@ public:
 
 public:
     virtual void initializeGL () override;
-    virtual void enableGLShader () override;
+    virtual const char* name () const override { return "Daltonize"; }
+    virtual const GLPixelFunction* pixelFunction () const override;
+    virtual void setUniforms (const std::vector<int>& uniformLocations) const override;
+    virtual uint64_t paramsHash () const override;
     virtual void applyCPU (const ImageSRGBA& input, ImageSRGBA& output) const override;
 
 private:
     Params _currentParams;
-    unsigned _attribLocationKind = 0;
-    unsigned _attribLocationSimulateOnly = 0;
-    unsigned _attribLocationSeverity = 0;
 };
 
+// The output does not blink by itself, so it only needs to be rendered
+// again when the params change. The alpha channel is the mask of the
+// similar colors, which are at full brightness. The blinking is done
+// when compositing it over the input, by scaling its color with
+// blinkIntensity. It thus needs to be the last filter of a graph.
 class Filter_HighlightSimilarColors : public GLFilter
 {
 public:
@@ -140,23 +234,25 @@ public:
         float deltaH_360 = NAN; // within [0,360º]
         float deltaS_100 = NAN; // within [0,100%]
         float deltaV_255 = NAN; // within [0,255]
-        int frameCount = 0;
     };
 
 public:
     void setParams (const Params& params) { _currentParams = params;}
 
+    // Within [0,1]. For a fixed hue and saturation the sRGB values are
+    // proportional to the HSV value, so scaling the output color by this
+    // is the same as setting the value of the similar colors to it.
+    static float blinkIntensity (double timeInSeconds);
+
 public:
     virtual void initializeGL () override;
-    virtual void enableGLShader () override;
+    virtual const char* name () const override { return "HighlightSimilarColors"; }
+    virtual const GLPixelFunction* pixelFunction () const override;
+    virtual void setUniforms (const std::vector<int>& uniformLocations) const override;
+    virtual uint64_t paramsHash () const override;
 
 private:
     Params _currentParams;
-    unsigned _attribLocationRefColor_sRGB = 0;
-    unsigned _attribLocationDeltaH = 0;
-    unsigned _attribLocationDeltaS = 0;
-    unsigned _attribLocationDeltaV = 0;
-    unsigned _attribLocationFrameCount = 0;
 };
 
 } // dl
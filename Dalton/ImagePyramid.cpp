@@ -0,0 +1,121 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#include "ImagePyramid.h"
+
+#include <Dalton/Utils.h>
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+# define DL_HAS_SSE2 1
+# include <emmintrin.h>
+#endif
+
+namespace dl
+{
+
+namespace
+{
+
+    inline PixelSRGBA average4 (const PixelSRGBA& p00, const PixelSRGBA& p01, const PixelSRGBA& p10, const PixelSRGBA& p11)
+    {
+        PixelSRGBA out;
+        for (int i = 0; i < 4; ++i)
+            out.v[i] = (int(p00.v[i]) + p01.v[i] + p10.v[i] + p11.v[i] + 2) >> 2;
+        return out;
+    }
+
+#if DL_HAS_SSE2
+    // 16 input bytes of each row (4 pixels) => 2 output pixels in the low 8 bytes, as 16 bits.
+    inline __m128i sumBlocks_4to2 (__m128i row0, __m128i row1)
+    {
+        const __m128i zero = _mm_setzero_si128 ();
+        const __m128i lo = _mm_add_epi16 (_mm_unpacklo_epi8 (row0, zero), _mm_unpacklo_epi8 (row1, zero));
+        const __m128i hi = _mm_add_epi16 (_mm_unpackhi_epi8 (row0, zero), _mm_unpackhi_epi8 (row1, zero));
+        // Each half has 2 pixels, add them together.
+        const __m128i sumLo = _mm_add_epi16 (lo, _mm_srli_si128 (lo, 8));
+        const __m128i sumHi = _mm_add_epi16 (hi, _mm_srli_si128 (hi, 8));
+        return _mm_unpacklo_epi64 (sumLo, sumHi);
+    }
+
+    // Returns the number of output pixels that were processed.
+    int downsampleRow_SSE2 (const PixelSRGBA* row0, const PixelSRGBA* row1, PixelSRGBA* outRow, int outWidth)
+    {
+        const __m128i rounding = _mm_set1_epi16 (2);
+        int c = 0;
+        for (; c + 4 <= outWidth; c += 4)
+        {
+            const __m128i* in0 = reinterpret_cast<const __m128i*>(row0 + 2*c);
+            const __m128i* in1 = reinterpret_cast<const __m128i*>(row1 + 2*c);
+            __m128i sumA = sumBlocks_4to2 (_mm_loadu_si128 (in0), _mm_loadu_si128 (in1));
+            __m128i sumB = sumBlocks_4to2 (_mm_loadu_si128 (in0 + 1), _mm_loadu_si128 (in1 + 1));
+            sumA = _mm_srli_epi16 (_mm_add_epi16 (sumA, rounding), 2);
+            sumB = _mm_srli_epi16 (_mm_add_epi16 (sumB, rounding), 2);
+            _mm_storeu_si128 (reinterpret_cast<__m128i*>(outRow + c), _mm_packus_epi16 (sumA, sumB));
+        }
+        return c;
+    }
+#endif
+
+} // anonymous
+
+void downsampleBox2x2 (const ImageSRGBA& input, ImageSRGBA& output)
+{
+    const int inWidth = input.width();
+    const int inHeight = input.height();
+    const int outWidth = std::max (1, inWidth / 2);
+    const int outHeight = std::max (1, inHeight / 2);
+    output.ensureAllocatedBufferForSize (outWidth, outHeight);
+
+    // When one dimension is already 1 we just average along the other one.
+    const int dx = inWidth > 1 ? 1 : 0;
+    const int dy = inHeight > 1 ? 1 : 0;
+
+    // Keep the chunks big enough to amortize the thread creation.
+    const int minRowsPerChunk = std::max (1, (1 << 16) / std::max (1, outWidth));
+
+    parallelFor (0, outHeight, [&](int rowBegin, int rowEnd) {
+        for (int r = rowBegin; r < rowEnd; ++r)
+        {
+            const PixelSRGBA* row0 = input.atRowPtr (2*r);
+            const PixelSRGBA* row1 = input.atRowPtr (2*r + dy);
+            PixelSRGBA* outRow = output.atRowPtr (r);
+
+            int c = 0;
+#if DL_HAS_SSE2
+            if (dx == 1)
+                c = downsampleRow_SSE2 (row0, row1, outRow, outWidth);
+#endif
+            for (; c < outWidth; ++c)
+                outRow[c] = average4 (row0[2*c], row0[2*c + dx], row1[2*c], row1[2*c + dx]);
+        }
+    }, minRowsPerChunk);
+}
+
+void ImagePyramid::compute (const ImageSRGBA& input, int minSize)
+{
+    minSize = std::max (minSize, 1);
+
+    int numLevels = 0;
+    for (int w = input.width(), h = input.height(); w > minSize || h > minSize; ++numLevels)
+    {
+        w = std::max (1, w / 2);
+        h = std::max (1, h / 2);
+    }
+
+    // Keep the existing buffers around, the sizes are often the same.
+    _levels.resize (numLevels);
+
+    const ImageSRGBA* prevLevel = &input;
+    for (auto& level : _levels)
+    {
+        downsampleBox2x2 (*prevLevel, level);
+        prevLevel = &level;
+    }
+}
+
+} // dl
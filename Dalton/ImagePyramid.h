@@ -0,0 +1,37 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#pragma once
+
+#include <Dalton/Image.h>
+
+#include <vector>
+
+namespace dl
+{
+
+    // Output has size (width/2, height/2), each pixel being the rounded
+    // average of the corresponding 2x2 input block. The last column / row
+    // is dropped for odd sizes, like OpenGL mipmaps.
+    void downsampleBox2x2 (const ImageSRGBA& input, ImageSRGBA& output);
+
+    // Mip pyramid of an image, without the full resolution level.
+    // level(0) is half the input resolution, level(1) a quarter, etc.
+    // down to a 1x1 image (or minSize).
+    class ImagePyramid
+    {
+    public:
+        void compute (const ImageSRGBA& input, int minSize = 1);
+        void clear () { _levels.clear (); }
+
+        int numLevels () const { return int(_levels.size()); }
+        const ImageSRGBA& level (int i) const { return _levels[i]; }
+
+    private:
+        std::vector<ImageSRGBA> _levels;
+    };
+
+} // dl
@@ -0,0 +1,256 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#include "LosslessCodec.h"
+
+#include <Dalton/Utils.h>
+
+#include <cstring>
+
+namespace dl
+{
+
+namespace
+{
+
+    enum : uint8_t
+    {
+        QOI_OP_INDEX = 0x00, // 00xxxxxx
+        QOI_OP_DIFF  = 0x40, // 01xxxxxx
+        QOI_OP_LUMA  = 0x80, // 10xxxxxx
+        QOI_OP_RUN   = 0xc0, // 11xxxxxx
+        QOI_OP_RGB   = 0xfe, // 11111110
+        QOI_OP_RGBA  = 0xff, // 11111111
+        QOI_MASK_2   = 0xc0, // 11000000
+    };
+
+    const int qoiHeaderSize = 14;
+    const uint8_t qoiPadding[8] = {0,0,0,0,0,0,0,1};
+
+    inline int qoiHash (const PixelSRGBA& p)
+    {
+        return (p.r*3 + p.g*5 + p.b*7 + p.a*11) % 64;
+    }
+
+    inline void write32 (uint8_t*& ptr, uint32_t v)
+    {
+        *ptr++ = (0xff000000 & v) >> 24;
+        *ptr++ = (0x00ff0000 & v) >> 16;
+        *ptr++ = (0x0000ff00 & v) >> 8;
+        *ptr++ = (0x000000ff & v);
+    }
+
+    inline uint32_t read32 (const uint8_t*& ptr)
+    {
+        uint32_t v = (uint32_t(ptr[0]) << 24) | (uint32_t(ptr[1]) << 16) | (uint32_t(ptr[2]) << 8) | uint32_t(ptr[3]);
+        ptr += 4;
+        return v;
+    }
+
+} // anonymous
+
+size_t encodeLossless (const ImageSRGBA& image, std::vector<uint8_t>& output)
+{
+    const size_t numPixels = size_t(image.width()) * image.height();
+    // Worst case is one RGBA op per pixel.
+    const size_t maxSize = qoiHeaderSize + numPixels * 5 + sizeof(qoiPadding);
+
+    const size_t startOffset = output.size();
+    output.resize (startOffset + maxSize);
+    uint8_t* const bytes = output.data() + startOffset;
+    uint8_t* ptr = bytes;
+
+    *ptr++ = 'q'; *ptr++ = 'o'; *ptr++ = 'i'; *ptr++ = 'f';
+    write32 (ptr, image.width());
+    write32 (ptr, image.height());
+    *ptr++ = 4; // channels
+    *ptr++ = 0; // sRGB with linear alpha
+
+    PixelSRGBA index[64];
+    memset (index, 0, sizeof(index));
+
+    PixelSRGBA prev (0, 0, 0, 255);
+    int run = 0;
+
+    for (int r = 0; r < image.height(); ++r)
+    {
+        const PixelSRGBA* rowPtr = image.atRowPtr(r);
+        const PixelSRGBA* endRowPtr = rowPtr + image.width();
+        for (; rowPtr != endRowPtr; ++rowPtr)
+        {
+            const PixelSRGBA& px = *rowPtr;
+            if (px == prev)
+            {
+                ++run;
+                if (run == 62)
+                {
+                    *ptr++ = QOI_OP_RUN | (run - 1);
+                    run = 0;
+                }
+                continue;
+            }
+
+            if (run > 0)
+            {
+                *ptr++ = QOI_OP_RUN | (run - 1);
+                run = 0;
+            }
+
+            const int hash = qoiHash (px);
+            if (index[hash] == px)
+            {
+                *ptr++ = QOI_OP_INDEX | hash;
+            }
+            else
+            {
+                index[hash] = px;
+
+                if (px.a == prev.a)
+                {
+                    const int8_t vr = px.r - prev.r;
+                    const int8_t vg = px.g - prev.g;
+                    const int8_t vb = px.b - prev.b;
+                    const int8_t vg_r = vr - vg;
+                    const int8_t vg_b = vb - vg;
+
+                    if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2)
+                    {
+                        *ptr++ = QOI_OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2);
+                    }
+                    else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 && vg_b > -9 && vg_b < 8)
+                    {
+                        *ptr++ = QOI_OP_LUMA | (vg + 32);
+                        *ptr++ = (vg_r + 8) << 4 | (vg_b + 8);
+                    }
+                    else
+                    {
+                        *ptr++ = QOI_OP_RGB;
+                        *ptr++ = px.r;
+                        *ptr++ = px.g;
+                        *ptr++ = px.b;
+                    }
+                }
+                else
+                {
+                    *ptr++ = QOI_OP_RGBA;
+                    *ptr++ = px.r;
+                    *ptr++ = px.g;
+                    *ptr++ = px.b;
+                    *ptr++ = px.a;
+                }
+            }
+
+            prev = px;
+        }
+    }
+
+    if (run > 0)
+        *ptr++ = QOI_OP_RUN | (run - 1);
+
+    memcpy (ptr, qoiPadding, sizeof(qoiPadding));
+    ptr += sizeof(qoiPadding);
+
+    const size_t numBytes = ptr - bytes;
+    output.resize (startOffset + numBytes);
+    return numBytes;
+}
+
+bool decodeLossless (const uint8_t* data, size_t numBytes, ImageSRGBA& image)
+{
+    if (numBytes < qoiHeaderSize + sizeof(qoiPadding))
+        return false;
+
+    const uint8_t* ptr = data;
+    if (memcmp (ptr, "qoif", 4) != 0)
+        return false;
+    ptr += 4;
+
+    const uint32_t width = read32 (ptr);
+    const uint32_t height = read32 (ptr);
+    const int channels = *ptr++;
+    ptr++; // colorspace, ignored.
+
+    if (width == 0 || height == 0 || channels != 4)
+        return false;
+
+    // Avoid crazy allocations on a corrupted stream.
+    if (uint64_t(width) * height > uint64_t(numBytes) * 62)
+        return false;
+
+    image.ensureAllocatedBufferForSize (width, height);
+
+    PixelSRGBA index[64];
+    memset (index, 0, sizeof(index));
+
+    PixelSRGBA px (0, 0, 0, 255);
+    int run = 0;
+
+    // The padding guarantees that the longest op (5 bytes) never reads past the end.
+    const uint8_t* const endChunks = data + numBytes - sizeof(qoiPadding);
+
+    for (int r = 0; r < int(height); ++r)
+    {
+        PixelSRGBA* rowPtr = image.atRowPtr(r);
+        PixelSRGBA* endRowPtr = rowPtr + width;
+        for (; rowPtr != endRowPtr; ++rowPtr)
+        {
+            if (run > 0)
+            {
+                --run;
+            }
+            else
+            {
+                if (ptr >= endChunks)
+                    return false;
+
+                const uint8_t b1 = *ptr++;
+                if (b1 == QOI_OP_RGB)
+                {
+                    px.r = *ptr++;
+                    px.g = *ptr++;
+                    px.b = *ptr++;
+                }
+                else if (b1 == QOI_OP_RGBA)
+                {
+                    px.r = *ptr++;
+                    px.g = *ptr++;
+                    px.b = *ptr++;
+                    px.a = *ptr++;
+                }
+                else if ((b1 & QOI_MASK_2) == QOI_OP_INDEX)
+                {
+                    px = index[b1];
+                }
+                else if ((b1 & QOI_MASK_2) == QOI_OP_DIFF)
+                {
+                    px.r += ((b1 >> 4) & 0x03) - 2;
+                    px.g += ((b1 >> 2) & 0x03) - 2;
+                    px.b += ( b1       & 0x03) - 2;
+                }
+                else if ((b1 & QOI_MASK_2) == QOI_OP_LUMA)
+                {
+                    const uint8_t b2 = *ptr++;
+                    const int vg = (b1 & 0x3f) - 32;
+                    px.r += vg - 8 + ((b2 >> 4) & 0x0f);
+                    px.g += vg;
+                    px.b += vg - 8 +  (b2       & 0x0f);
+                }
+                else if ((b1 & QOI_MASK_2) == QOI_OP_RUN)
+                {
+                    run = (b1 & 0x3f);
+                }
+
+                index[qoiHash(px)] = px;
+            }
+
+            *rowPtr = px;
+        }
+    }
+
+    return true;
+}
+
+} // dl
@@ -0,0 +1,27 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#pragma once
+
+#include <Dalton/Image.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace dl
+{
+
+    // Fast lossless RGBA codec, following the QOI format (https://qoiformat.org).
+    // Compression is not as good as PNG, but it is more than an order of magnitude
+    // faster to encode and works very well on screen content with large flat areas.
+
+    // Appends the encoded image to output. Returns the number of bytes written.
+    size_t encodeLossless (const ImageSRGBA& image, std::vector<uint8_t>& output);
+
+    // Returns false if the buffer is truncated or not a valid stream.
+    bool decodeLossless (const uint8_t* data, size_t numBytes, ImageSRGBA& image);
+
+} // dl
@@ -141,6 +141,13 @@ namespace dl
         Point() = default;
         Point (double x, double y) : x(x), y(y) {}
     
+        inline Point& operator+=(const Point& rhs)
+        {
+            x += rhs.x;
+            y += rhs.y;
+            return *this;
+        }
+
         inline Point& operator-=(const Point& rhs)
         {
             x -= rhs.x;
@@ -9,13 +9,28 @@
 #include <Dalton/Platform.h>
 #include <Dalton/Utils.h>
 #include <Dalton/OpenGL_Shaders.h>
+#include <Dalton/ImagePyramid.h>
 
 #include <gl3w/GL/gl3w.h>
 #include <GLFW/glfw3.h>
 
+#if PLATFORM_LINUX
+// Avoid the X11 types and macros, only the surfaceless platform is used.
+# define EGL_NO_X11 1
+# include <EGL/egl.h>
+# include <EGL/eglext.h>
+#endif
+
 #include <vector>
 #include <array>
+#include <map>
+#include <mutex>
+#include <atomic>
 #include <numeric>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
 
 namespace dl
 {
@@ -38,6 +53,57 @@ const char* glslVersion()
 #endif
 }
 
+int glMaxTextureSize ()
+{
+    // Same for all the contexts in practice.
+    static GLint maxSize = 0;
+    if (maxSize == 0)
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    return maxSize;
+}
+
+namespace
+{
+
+    bool glHasExtension (const char* extensionName)
+    {
+        GLint numExtensions = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+        for (int i = 0; i < numExtensions; ++i)
+        {
+            const char* ext = (const char*)glGetStringi(GL_EXTENSIONS, i);
+            if (ext && strcmp (ext, extensionName) == 0)
+                return true;
+        }
+        return false;
+    }
+
+} // anonymous
+
+bool glHasTextureStorage ()
+{
+    static int hasTextureStorage = -1;
+    if (hasTextureStorage < 0)
+        hasTextureStorage = gl3wIsSupported (4, 2) || glHasExtension ("GL_ARB_texture_storage");
+    return hasTextureStorage > 0;
+}
+
+bool glHasTimerQueries ()
+{
+    static int hasTimerQueries = -1;
+    if (hasTimerQueries < 0)
+        hasTimerQueries = gl3wIsSupported (3, 3) || glHasExtension ("GL_ARB_timer_query");
+    return hasTimerQueries > 0;
+}
+
+bool glHasSamplerObjects ()
+{
+    static int hasSamplerObjects = -1;
+    if (hasSamplerObjects < 0)
+        hasSamplerObjects = gl3wIsSupported (3, 3) || glHasExtension ("GL_ARB_sampler_objects");
+    return hasSamplerObjects > 0;
+}
+
 } // dl
 
 // --------------------------------------------------------------------------------
@@ -81,11 +147,106 @@ bool gl_checkShader(GLuint handle, const char *desc)
     return (GLboolean)status == GL_TRUE;
 }
 
+namespace
+{
+
+    std::string programCacheDirectory;
+
+    uint64_t fnv1aHash (const std::string& s, uint64_t hash = 14695981039346656037ull)
+    {
+        for (unsigned char c : s)
+        {
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // The binaries are only valid for the exact same driver.
+    std::string programCachePath (const std::string& sourceCode)
+    {
+        if (programCacheDirectory.empty())
+            return std::string();
+
+        GLint numFormats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+        if (numFormats <= 0)
+            return std::string();
+
+        auto glString = [](GLenum name) {
+            const char* s = (const char*)glGetString(name);
+            return std::string(s ? s : "");
+        };
+
+        std::string key = glString(GL_VENDOR) + "\n" + glString(GL_RENDERER) + "\n" + glString(GL_VERSION) + "\n" + sourceCode;
+        return programCacheDirectory + "/" + formatted("%016llx.glbin", (unsigned long long)fnv1aHash(key));
+    }
+
+    // Returns 0 if there was no valid binary.
+    GLuint loadCachedProgram (const std::string& path)
+    {
+        std::ifstream f (path, std::ios::binary);
+        if (!f)
+            return 0;
+
+        GLenum binaryFormat = 0;
+        if (!f.read (reinterpret_cast<char*>(&binaryFormat), sizeof(binaryFormat)))
+            return 0;
+        std::vector<char> binary ((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+        if (binary.empty())
+            return 0;
+
+        GLuint program = glCreateProgram();
+        glProgramBinary (program, binaryFormat, binary.data(), GLsizei(binary.size()));
+        GLint status = GL_FALSE;
+        glGetProgramiv (program, GL_LINK_STATUS, &status);
+        if (status != GL_TRUE)
+        {
+            // Typically after a driver update.
+            glDeleteProgram (program);
+            // Drop the possible GL_INVALID_ENUM if the format is not supported anymore.
+            glGetError ();
+            return 0;
+        }
+        return program;
+    }
+
+    void saveCachedProgram (GLuint program, const std::string& path)
+    {
+        GLint length = 0;
+        glGetProgramiv (program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+
+        std::vector<char> binary (length);
+        GLenum binaryFormat = 0;
+        glGetProgramBinary (program, length, nullptr, &binaryFormat, binary.data());
+
+        // Write to a temporary file first so another instance never reads a partial file.
+        const std::string tmpPath = path + ".tmp";
+        {
+            std::ofstream f (tmpPath, std::ios::binary);
+            f.write (reinterpret_cast<const char*>(&binaryFormat), sizeof(binaryFormat));
+            f.write (binary.data(), binary.size());
+            if (!f)
+                return;
+        }
+        if (std::rename (tmpPath.c_str(), path.c_str()) != 0)
+            std::remove (tmpPath.c_str());
+    }
+
+} // anonymous
+
 struct GLShader::Impl
 {
-    GLint prevHandle = 0;
+    uint32_t prevHandle = 0;
 };
 
+void GLShader::setProgramCacheDirectory (const std::string& path)
+{
+    programCacheDirectory = path;
+}
+
 GLShader::GLShader()
 : impl (new Impl())
 {
@@ -134,6 +295,18 @@ void GLShader::initialize(const char* glslVersionString, const char* vertexShade
     
     if (fragmentShader == nullptr)
         fragmentShader = defaultFragmentShader_glsl_130;
+
+    const std::string cachePath = programCachePath (std::string(glslVersionString) + vertexShader + commonFragmentLibrary + fragmentShader);
+    if (!cachePath.empty())
+    {
+        _glHandles.shaderHandle = loadCachedProgram (cachePath);
+        if (_glHandles.shaderHandle != 0)
+        {
+            _glHandles.textureUniformLocation = glGetUniformLocation(_glHandles.shaderHandle, "Texture");
+            checkGLError();
+            return;
+        }
+    }
     
     // Create shaders
     const GLchar *vertex_shader_with_version[3] = {glslVersionString, "\n", vertexShader};
@@ -158,8 +331,11 @@ void GLShader::initialize(const char* glslVersionString, const char* vertexShade
     glBindAttribLocation(_glHandles.shaderHandle, (GLuint)Attribute::VertexNormal, "Normal");
     glBindAttribLocation(_glHandles.shaderHandle, (GLuint)Attribute::VertexUV,     "UV");
     glBindAttribLocation(_glHandles.shaderHandle, (GLuint)Attribute::VertexColor,  "Color");
+    if (!cachePath.empty())
+        glProgramParameteri(_glHandles.shaderHandle, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(_glHandles.shaderHandle);
-    gl_checkProgram(_glHandles.shaderHandle, "shader program", glslVersionString);
+    if (gl_checkProgram(_glHandles.shaderHandle, "shader program", glslVersionString) && !cachePath.empty())
+        saveCachedProgram (_glHandles.shaderHandle, cachePath);
 
     _glHandles.textureUniformLocation = glGetUniformLocation(_glHandles.shaderHandle, "Texture");
     checkGLError();
@@ -168,14 +344,15 @@ void GLShader::initialize(const char* glslVersionString, const char* vertexShade
 void GLShader::enable (int32_t textureId)
 {
     dl_assert (_glHandles.shaderHandle != 0, "Forgot to call initialize()?");
-    glGetIntegerv(GL_CURRENT_PROGRAM, &impl->prevHandle);
-    glUseProgram (_glHandles.shaderHandle);
+    GLStateCache& stateCache = GLStateCache::current();
+    impl->prevHandle = stateCache.program ();
+    stateCache.useProgram (_glHandles.shaderHandle);
     glUniform1i (_glHandles.textureUniformLocation, textureId);
 }
 
 void GLShader::disable ()
 {
-    glUseProgram (impl->prevHandle);
+    GLStateCache::current().useProgram (impl->prevHandle);
     impl->prevHandle = 0;
 }
 
@@ -189,20 +366,53 @@ namespace dl
 {
 
 GLRestoreStateAfterScope_Texture::GLRestoreStateAfterScope_Texture()
+: _stateCache (GLStateCache::current())
 {
-    glGetIntegerv(GL_TEXTURE_BINDING_2D, &_prevTexture);
+    _stateCache.pushTexture2D ();
 }
 
 GLRestoreStateAfterScope_Texture::~GLRestoreStateAfterScope_Texture()
 {
-    glBindTexture (GL_TEXTURE_2D, _prevTexture);
+    _stateCache.popTexture2D ();
 }
 
+namespace
+{
+
+    // Smaller uploads go directly through glTexSubImage2D, the extra copy
+    // to a pixel buffer would not be worth it.
+    constexpr int MinBytesForStreamingUpload = 64*1024;
+
+    int numMipLevelsForSize (int width, int height)
+    {
+        int numLevels = 1;
+        for (int w = width, h = height; w > 1 || h > 1; ++numLevels)
+        {
+            w = std::max (1, w / 2);
+            h = std::max (1, h / 2);
+        }
+        return numLevels;
+    }
+
+    // Only accessed from the GL thread.
+    uint64_t nextContentGeneration ()
+    {
+        static uint64_t lastGeneration = 0;
+        return ++lastGeneration;
+    }
+
+} // anonymous
+
 GLTexture::~GLTexture()
 {
     releaseGL();
 }
 
+void GLTexture::markContentChanged ()
+{
+    _contentGeneration = nextContentGeneration ();
+}
+
 void GLTexture::initializeWithExistingTextureID(uint32_t textureId, int width, int height)
 {
     if (_textureId != 0)
@@ -211,23 +421,48 @@ void GLTexture::initializeWithExistingTextureID(uint32_t textureId, int width, i
     _textureId = textureId;
     _width = width;
     _height = height;
+    _numMipLevels = 1;
+    // We don't know how it was allocated, assume the worst.
+    _storageLevels = 1;
+    _immutableStorage = false;
+    _externalStorage = true;
+    markContentChanged ();
 
-    GLint prevTexture;
-    glGetIntegerv(GL_TEXTURE_BINDING_2D, &prevTexture);
-
-    glBindTexture(GL_TEXTURE_2D, _textureId);
+    GLRestoreStateAfterScope_Texture _;
+    GLStateCache::current().bindTexture2D (_textureId);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+}
+
+void GLTexture::releaseStorage ()
+{
+    if (_textureId == 0)
+        return;
 
-    glBindTexture(GL_TEXTURE_2D, prevTexture);
+    if (_immutableStorage && !_externalStorage)
+        GLTexturePool::shared().release (_textureId, _width, _height, _storageLevels);
+    else
+        GLStateCache::current().deleteTexture (_textureId);
+    _textureId = 0;
 }
 
 void GLTexture::releaseGL()
 {
     if (_textureId != 0)
     {
-        glDeleteTextures(1, &_textureId);
-        _textureId = 0;
+        releaseStorage ();
+        _externalStorage = false;
+        _numMipLevels = 1;
+        _storageLevels = 0;
+        _immutableStorage = false;
+        _width = 0;
+        _height = 0;
+    }
+
+    if (_unpackBuffer != 0)
+    {
+        glDeleteBuffers(1, &_unpackBuffer);
+        _unpackBuffer = 0;
     }
 }
 
@@ -236,75 +471,397 @@ void GLTexture::initialize()
     GLRestoreStateAfterScope_Texture _;
 
     glGenTextures(1, &_textureId);
-    glBindTexture(GL_TEXTURE_2D, _textureId);
+    _linearInterpolationEnabled = false;
+    _numMipLevels = 1;
+    _storageLevels = 0;
+    _immutableStorage = false;
+    GLStateCache::current().bindTexture2D (_textureId);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 }
 
-void GLTexture::ensureAllocatedForRGBA (int width, int height)
+// Assumes that the texture is bound.
+void GLTexture::allocateStorage (int width, int height, int numLevels)
 {
-    GLRestoreStateAfterScope_Texture _;
-        
-    glBindTexture(GL_TEXTURE_2D, _textureId);
+    dl_assert (width <= glMaxTextureSize() && height <= glMaxTextureSize(), "Too large, use a GLTiledTexture.");
+
+    if (glHasTextureStorage ())
+    {
+        // Immutable storage can't be resized, we need a new texture object.
+        const uint32_t pooledTextureId = GLTexturePool::shared().acquire (width, height, numLevels);
+        if (pooledTextureId != 0 || _immutableStorage)
+        {
+            releaseStorage ();
+            _textureId = pooledTextureId;
+            if (_textureId == 0)
+                glGenTextures(1, &_textureId);
+            GLStateCache::current().bindTexture2D (_textureId);
+        }
+
+        if (pooledTextureId == 0)
+            glTexStorage2D(GL_TEXTURE_2D, numLevels, GL_RGBA8, width, height);
+        _immutableStorage = true;
+        _externalStorage = false;
+    }
+    else
+    {
+        glTexImage2D (GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        _immutableStorage = false;
+    }
+
     _width = width;
     _height = height;
-    glTexImage2D (GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    _storageLevels = numLevels;
+    _numMipLevels = 1;
+    markContentChanged ();
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    applyFilteringParams ();
 }
 
-void GLTexture::upload(const dl::ImageSRGBA& im)
+// Assumes that the texture is bound. Mutable storage gets the levels
+// allocated on upload, so only the immutable one needs to be reallocated.
+// Level 0 gets copied on the GPU to the new texture.
+void GLTexture::ensureStorageForAllMipmapLevels ()
+{
+    const int numLevels = numMipLevelsForSize (_width, _height);
+    if (!_immutableStorage || _storageLevels >= numLevels)
+        return;
+
+    const GLuint prevTextureId = _textureId;
+    _textureId = GLTexturePool::shared().acquire (_width, _height, numLevels);
+    if (_textureId == 0)
+    {
+        glGenTextures(1, &_textureId);
+        GLStateCache::current().bindTexture2D (_textureId);
+        glTexStorage2D(GL_TEXTURE_2D, numLevels, GL_RGBA8, _width, _height);
+    }
+    else
+    {
+        GLStateCache::current().bindTexture2D (_textureId);
+    }
+
+    GLStateCache& stateCache = GLStateCache::current();
+    const uint32_t prevReadFbo = stateCache.readFramebuffer ();
+    GLuint fbo = 0;
+    glGenFramebuffers(1, &fbo);
+    stateCache.bindReadFramebuffer (fbo);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, prevTextureId, 0);
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, _width, _height);
+    stateCache.bindReadFramebuffer (prevReadFbo);
+    stateCache.deleteFramebuffer (fbo);
+    GLTexturePool::shared().release (prevTextureId, _width, _height, _storageLevels);
+
+    _storageLevels = numLevels;
+    _numMipLevels = 1;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    applyFilteringParams ();
+}
+
+// Assumes that the texture is bound and the storage allocated.
+void GLTexture::uploadPixels (int level, int x, int y, int width, int height, const uint8_t* firstPixel, int bytesPerRow)
+{
+    if (level == 0)
+        markContentChanged ();
+
+    const int packedBytesPerRow = width * 4;
+    const size_t numBytes = size_t(packedBytesPerRow) * height;
+    if (numBytes < MinBytesForStreamingUpload)
+    {
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, (GLint)(bytesPerRow / 4));
+        glTexSubImage2D(GL_TEXTURE_2D, level, x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, firstPixel);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        return;
+    }
+
+    if (_unpackBuffer == 0)
+        glGenBuffers(1, &_unpackBuffer);
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _unpackBuffer);
+    // Orphan the previous content, so we don't wait for the GPU to be done with it.
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, numBytes, nullptr, GL_STREAM_DRAW);
+    uint8_t* mappedBytes = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, numBytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (!mappedBytes)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, (GLint)(bytesPerRow / 4));
+        glTexSubImage2D(GL_TEXTURE_2D, level, x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, firstPixel);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        return;
+    }
+
+    if (bytesPerRow == packedBytesPerRow)
+    {
+        memcpy (mappedBytes, firstPixel, numBytes);
+    }
+    else
+    {
+        for (int r = 0; r < height; ++r)
+            memcpy (mappedBytes + size_t(r) * packedBytesPerRow, firstPixel + size_t(r) * bytesPerRow, packedBytesPerRow);
+    }
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    glTexSubImage2D(GL_TEXTURE_2D, level, x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void GLTexture::ensureAllocatedForRGBA (int width, int height)
 {
     GLRestoreStateAfterScope_Texture _;
+        
+    GLStateCache::current().bindTexture2D (_textureId);
+    if (_storageLevels > 0 && _width == width && _height == height)
+    {
+        dropMipmapsIfAny ();
+        return;
+    }
 
-    glBindTexture(GL_TEXTURE_2D, _textureId);
-    glPixelStorei(GL_UNPACK_ROW_LENGTH, (GLint)(im.bytesPerRow() / im.bytesPerPixel()));
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, im.width(), im.height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, im.rawBytes());
-    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    allocateStorage (width, height, 1);
+}
 
-    _width = im.width();
-    _height = im.height();
+void GLTexture::upload(const dl::ImageSRGBA& im)
+{
+    uploadRgba (im.rawBytes(), im.width(), im.height(), int(im.bytesPerRow()));
 }
 
 void GLTexture::uploadRgba(const uint8_t* rgbaBuffer, int width, int height, int bytesPerRow)
 {
     GLRestoreStateAfterScope_Texture _;
+    GLScopedGpuTimer timer ("Texture upload");
 
     if (bytesPerRow <= 0)
         bytesPerRow = width*4;
 
-    glBindTexture(GL_TEXTURE_2D, _textureId);
-    glPixelStorei(GL_UNPACK_ROW_LENGTH, (GLint)(bytesPerRow / 4));
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgbaBuffer);
-    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    GLStateCache::current().bindTexture2D (_textureId);
+    if (_storageLevels == 0 || _width != width || _height != height)
+        allocateStorage (width, height, 1);
+    uploadPixels (0, 0, 0, width, height, rgbaBuffer, bytesPerRow);
+    dropMipmapsIfAny ();
+}
 
-    _width = width;
-    _height = height;
+void GLTexture::uploadSubRect (const dl::ImageSRGBA& im, int x, int y, int width, int height)
+{
+    dl_assert (im.width() == _width && im.height() == _height, "The texture must be allocated first.");
+    uploadRgbaSubRect (reinterpret_cast<const uint8_t*>(im.atRowPtr(y) + x), x, y, width, height, int(im.bytesPerRow()));
+}
+
+void GLTexture::uploadRgbaSubRect (const uint8_t* firstPixel, int x, int y, int width, int height, int bytesPerRow)
+{
+    dl_assert (x >= 0 && y >= 0 && x + width <= _width && y + height <= _height, "Out of the texture bounds.");
+
+    GLRestoreStateAfterScope_Texture _;
+    GLScopedGpuTimer timer ("Texture upload");
+
+    GLStateCache::current().bindTexture2D (_textureId);
+    uploadPixels (0, x, y, width, height, firstPixel, bytesPerRow);
+    dropMipmapsIfAny ();
 }
 
 void GLTexture::download (dl::ImageSRGBA& im)
 {
     GLRestoreStateAfterScope_Texture _;
+    GLScopedGpuTimer timer ("Texture download");
     im.ensureAllocatedBufferForSize (_width, _height);
 
-    glBindTexture(GL_TEXTURE_2D, _textureId);
+    GLStateCache::current().bindTexture2D (_textureId);
     glPixelStorei(GL_PACK_ROW_LENGTH, (GLint)(im.bytesPerRow() / im.bytesPerPixel()));
     glGetTexImage (GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, im.rawBytes());
     glPixelStorei(GL_PACK_ROW_LENGTH, 0);
 }
 
+void GLTexture::uploadMipmaps (const ImagePyramid& pyramid)
+{
+    GLRestoreStateAfterScope_Texture _;
+
+    GLStateCache::current().bindTexture2D (_textureId);
+    ensureStorageForAllMipmapLevels ();
+    for (int i = 0; i < pyramid.numLevels(); ++i)
+    {
+        const ImageSRGBA& im = pyramid.level(i);
+        if (_immutableStorage)
+        {
+            uploadPixels (i + 1, 0, 0, im.width(), im.height(), im.rawBytes(), int(im.bytesPerRow()));
+        }
+        else
+        {
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, (GLint)(im.bytesPerRow() / im.bytesPerPixel()));
+            glTexImage2D(GL_TEXTURE_2D, i + 1, GL_RGBA, im.width(), im.height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, im.rawBytes());
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        }
+    }
+
+    _numMipLevels = pyramid.numLevels() + 1;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, _numMipLevels - 1);
+    applyFilteringParams ();
+}
+
+void GLTexture::generateMipmaps ()
+{
+    GLRestoreStateAfterScope_Texture _;
+
+    GLStateCache::current().bindTexture2D (_textureId);
+    ensureStorageForAllMipmapLevels ();
+    _numMipLevels = numMipLevelsForSize (_width, _height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, _numMipLevels - 1);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    applyFilteringParams ();
+}
+
+// Assumes that the texture is bound.
+void GLTexture::dropMipmapsIfAny ()
+{
+    if (_numMipLevels == 1)
+        return;
+
+    // The other levels would be stale anyway. Limiting the max level
+    // keeps the texture complete whatever the min filter is.
+    _numMipLevels = 1;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    applyFilteringParams ();
+}
+
+// Assumes that the texture is bound.
+void GLTexture::applyFilteringParams ()
+{
+    GLint minFilter = GL_NEAREST;
+    if (_linearInterpolationEnabled)
+        minFilter = hasMipmaps() ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, _linearInterpolationEnabled ? GL_LINEAR : GL_NEAREST);
+}
+
 void GLTexture::setLinearInterpolationEnabled(bool enabled)
 {
     if (_linearInterpolationEnabled == enabled)
         return;
 
     _linearInterpolationEnabled = enabled;
-    GLint prevTexture;
-    glGetIntegerv(GL_TEXTURE_BINDING_2D, &prevTexture);
+    GLRestoreStateAfterScope_Texture _;
+    GLStateCache::current().bindTexture2D (_textureId);
+    applyFilteringParams ();
+}
+
+} // dl
+
+// --------------------------------------------------------------------------------
+// GLTiledTexture
+// --------------------------------------------------------------------------------
+
+namespace dl
+{
+
+GLTiledTexture::GLTiledTexture ()
+{}
+
+GLTiledTexture::~GLTiledTexture ()
+{
+    releaseGL ();
+}
+
+int GLTiledTexture::maxTileSize () const
+{
+    return _requestedMaxTileSize > 0 ? std::min (_requestedMaxTileSize, glMaxTextureSize()) : glMaxTextureSize();
+}
+
+void GLTiledTexture::releaseGL ()
+{
+    for (auto& tile : _tiles)
+        tile->texture.releaseGL ();
+    _tiles.clear ();
+    _width = 0;
+    _height = 0;
+    _tileBorder = 0;
+    _tileStep = 0;
+    _numTileCols = 0;
+}
+
+void GLTiledTexture::ensureAllocatedForRGBA (int width, int height)
+{
+    const int tileSize = maxTileSize ();
+    if (!_tiles.empty() && _width == width && _height == height && _allocatedMaxTileSize == tileSize)
+    {
+        for (auto& tile : _tiles)
+            tile->texture.ensureAllocatedForRGBA (int(tile->textureRect.size.x), int(tile->textureRect.size.y));
+        return;
+    }
+
+    releaseGL ();
+    _width = width;
+    _height = height;
+    _allocatedMaxTileSize = tileSize;
+    // No border when it all fits in one tile. Otherwise the texture
+    // origins stay aligned on a multiple of the border, so the mipmap
+    // texels of the neighbor tiles cover the same pixels.
+    const bool singleTile = width <= tileSize && height <= tileSize;
+    _tileBorder = singleTile ? 0 : std::min (maxTileBorder, tileSize / 4);
+    _tileStep = singleTile ? tileSize : tileSize - 2 * _tileBorder;
+    _numTileCols = (width + _tileStep - 1) / _tileStep;
+    const dl::Rect fullImageRect = dl::Rect::from_x_y_w_h (0, 0, width, height);
+    for (int y = 0; y < height; y += _tileStep)
+    for (int x = 0; x < width; x += _tileStep)
+    {
+        auto tile = std::make_unique<Tile>();
+        tile->imageRect = dl::Rect::from_x_y_w_h (x, y, std::min (_tileStep, width - x), std::min (_tileStep, height - y));
+        tile->textureRect = dl::Rect::from_x_y_w_h (x - _tileBorder, y - _tileBorder,
+                                                    _tileStep + 2 * _tileBorder, _tileStep + 2 * _tileBorder).intersect (fullImageRect);
+        tile->texture.initialize ();
+        tile->texture.ensureAllocatedForRGBA (int(tile->textureRect.size.x), int(tile->textureRect.size.y));
+        tile->texture.setLinearInterpolationEnabled (_linearInterpolationEnabled);
+        _tiles.push_back (std::move(tile));
+    }
+}
+
+void GLTiledTexture::upload (const dl::ImageSRGBA& im)
+{
+    ensureAllocatedForRGBA (im.width(), im.height());
+    for (auto& tile : _tiles)
+    {
+        const int x = int(tile->textureRect.origin.x);
+        const int y = int(tile->textureRect.origin.y);
+        tile->texture.uploadRgba (reinterpret_cast<const uint8_t*>(im.atRowPtr(y) + x),
+                                  int(tile->textureRect.size.x), int(tile->textureRect.size.y),
+                                  int(im.bytesPerRow()));
+    }
+}
+
+void GLTiledTexture::uploadSubRect (const dl::ImageSRGBA& im, int x, int y, int width, int height)
+{
+    dl_assert (im.width() == _width && im.height() == _height, "The texture must be allocated first.");
+    // The borders of the neighbor tiles need the update too.
+    for (auto& tile : _tiles)
+    {
+        const int tileX = int(tile->textureRect.origin.x);
+        const int tileY = int(tile->textureRect.origin.y);
+        const int x0 = std::max (x, tileX);
+        const int y0 = std::max (y, tileY);
+        const int x1 = std::min (x + width, tileX + int(tile->textureRect.size.x));
+        const int y1 = std::min (y + height, tileY + int(tile->textureRect.size.y));
+        if (x1 <= x0 || y1 <= y0)
+            continue;
+
+        tile->texture.uploadRgbaSubRect (reinterpret_cast<const uint8_t*>(im.atRowPtr(y0) + x0),
+                                         x0 - tileX, y0 - tileY, x1 - x0, y1 - y0,
+                                         int(im.bytesPerRow()));
+    }
+}
+
+void GLTiledTexture::generateMipmaps ()
+{
+    for (auto& tile : _tiles)
+        tile->texture.generateMipmaps ();
+}
 
-    glBindTexture(GL_TEXTURE_2D, _textureId);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, enabled ? GL_LINEAR : GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, enabled ? GL_LINEAR : GL_NEAREST);
+void GLTiledTexture::setLinearInterpolationEnabled (bool enabled)
+{
+    _linearInterpolationEnabled = enabled;
+    for (auto& tile : _tiles)
+        tile->texture.setLinearInterpolationEnabled (enabled);
+}
 
-    glBindTexture(GL_TEXTURE_2D, prevTexture);
+int GLTiledTexture::tileIndexForPixel (int x, int y) const
+{
+    if (x < 0 || y < 0 || x >= _width || y >= _height)
+        return -1;
+    return (y / _tileStep) * _numTileCols + (x / _tileStep);
 }
 
 } // dl
@@ -316,43 +873,470 @@ void GLTexture::setLinearInterpolationEnabled(bool enabled)
 namespace dl
 {
 
+namespace
+{
+
+#if PLATFORM_LINUX
+    // Initialized once and never terminated, eglTerminate would destroy
+    // the contexts of all the other GLContext objects too.
+    EGLDisplay eglSurfacelessDisplay ()
+    {
+        static EGLDisplay display = []() {
+            auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress ("eglGetPlatformDisplayEXT");
+            if (!getPlatformDisplay)
+                return EGL_NO_DISPLAY;
+
+            EGLDisplay display = getPlatformDisplay (EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+            EGLint major = 0, minor = 0;
+            if (display == EGL_NO_DISPLAY || !eglInitialize (display, &major, &minor))
+            {
+                fprintf(stderr, "ERROR: GLContext: could not initialize the surfaceless EGL display.\n");
+                return EGL_NO_DISPLAY;
+            }
+            return display;
+        }();
+        return display;
+    }
+#endif
+
+    // Identifies the current context, whatever its backend. GLFW does not
+    // know about our EGL contexts, so check them first.
+    const void* currentNativeContext ()
+    {
+#if PLATFORM_LINUX
+        EGLContext eglContext = eglGetCurrentContext ();
+        if (eglContext != EGL_NO_CONTEXT)
+            return eglContext;
+#endif
+        return glfwGetCurrentContext ();
+    }
+
+} // anonymous
+
 struct GLContext::Impl
 {
+    Backend backend = Backend::GLFW;
     GLFWwindow* window = nullptr;
+#if PLATFORM_LINUX
+    EGLContext eglContext = EGL_NO_CONTEXT;
+#endif
+
+    void initializeGLFW (GLContext* parentContext)
+    {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);    
+#if PLATFORM_MACOS
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);  // 3.2+ only
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);            // Required on Mac
+#endif
+
+        GLFWwindow* parentWindow = parentContext ? parentContext->impl->window : nullptr;
+        glfwWindowHint(GLFW_VISIBLE, false);
+        window = glfwCreateWindow (16, 16, "offscreen context", nullptr, parentWindow);
+        glfwWindowHint(GLFW_VISIBLE, true);
+        glfwMakeContextCurrent (window);
+    }
+
+    void initializeEGLSurfaceless (GLContext* parentContext)
+    {
+#if PLATFORM_LINUX
+        EGLDisplay display = eglSurfacelessDisplay ();
+        if (display == EGL_NO_DISPLAY || !eglBindAPI (EGL_OPENGL_API))
+            return;
+
+        // Same version as the GLFW contexts. No config needed since there
+        // is no surface, we always render into framebuffer objects.
+        const EGLint contextAttribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 3,
+            EGL_CONTEXT_MINOR_VERSION, 2,
+            EGL_NONE
+        };
+        EGLContext sharedContext = parentContext ? parentContext->impl->eglContext : EGL_NO_CONTEXT;
+        eglContext = eglCreateContext (display, EGL_NO_CONFIG_KHR, sharedContext, contextAttribs);
+        if (eglContext == EGL_NO_CONTEXT)
+        {
+            fprintf(stderr, "ERROR: GLContext: could not create the EGL context (0x%x).\n", eglGetError());
+            return;
+        }
+        eglMakeCurrent (display, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext);
+#endif
+    }
 };
 
-GLContext::GLContext(GLContext* parentContext)
+GLContext::GLContext(GLContext* parentContext, Backend backend)
 : impl (new Impl ())
 {
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);    
-#if PLATFORM_MACOS
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);  // 3.2+ only
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);            // Required on Mac
+    impl->backend = backend == Backend::Default ? defaultBackend() : backend;
+    dl_assert (!parentContext || parentContext->backend() == impl->backend, "Contexts can't be shared across backends.");
+    if (impl->backend == Backend::EGLSurfaceless)
+        impl->initializeEGLSurfaceless (parentContext);
+    else
+        impl->initializeGLFW (parentContext);
+}
+
+GLContext::~GLContext ()
+{
+#if PLATFORM_LINUX
+    if (impl->eglContext != EGL_NO_CONTEXT)
+    {
+        GLStateCache::forgetContext (impl->eglContext);
+        GLGpuTimers::forgetContext (impl->eglContext);
+        if (eglGetCurrentContext() == impl->eglContext)
+            eglMakeCurrent (eglSurfacelessDisplay(), EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext (eglSurfacelessDisplay(), impl->eglContext);
+    }
 #endif
+    if (impl->window)
+    {
+        GLStateCache::forgetContext (impl->window);
+        GLGpuTimers::forgetContext (impl->window);
+        glfwDestroyWindow (impl->window);
+    }
+}
 
-    GLFWwindow* parentWindow = parentContext ? parentContext->impl->window : nullptr;
-    glfwWindowHint(GLFW_VISIBLE, false);
-    impl->window = glfwCreateWindow (16, 16, "offscreen context", nullptr, parentWindow);
-    glfwWindowHint(GLFW_VISIBLE, true);
-    glfwMakeContextCurrent (impl->window);
+bool GLContext::isValid () const
+{
+#if PLATFORM_LINUX
+    if (impl->backend == Backend::EGLSurfaceless)
+        return impl->eglContext != EGL_NO_CONTEXT;
+#endif
+    return impl->window != nullptr;
 }
 
-GLContext::~GLContext ()
+GLContext::Backend GLContext::backend () const
 {
-    glfwDestroyWindow (impl->window);
+    return impl->backend;
 }
 
 void GLContext::makeCurrent ()
 {
+#if PLATFORM_LINUX
+    if (impl->backend == Backend::EGLSurfaceless)
+    {
+        eglMakeCurrent (eglSurfacelessDisplay(), EGL_NO_SURFACE, EGL_NO_SURFACE, impl->eglContext);
+        return;
+    }
+#endif
     glfwMakeContextCurrent (impl->window);
 }
 
 void GLContext::setCurrentToNull ()
 {
+#if PLATFORM_LINUX
+    if (eglGetCurrentContext() != EGL_NO_CONTEXT)
+    {
+        eglMakeCurrent (eglGetCurrentDisplay(), EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        return;
+    }
+#endif
     glfwMakeContextCurrent (nullptr);
 }
 
+GLContext::Backend GLContext::defaultBackend ()
+{
+#if PLATFORM_LINUX
+    const char* backendName = getenv ("DALTONLENS_GL_BACKEND");
+    if (backendName && strcmp (backendName, "egl") == 0)
+        return Backend::EGLSurfaceless;
+#endif
+    return Backend::GLFW;
+}
+
+} // dl
+
+// --------------------------------------------------------------------------------
+// GLStateCache
+// --------------------------------------------------------------------------------
+
+namespace dl
+{
+
+namespace
+{
+
+    struct StateCaches
+    {
+        std::mutex mutex;
+        std::map<const void*, std::unique_ptr<GLStateCache>> byContext;
+        // Incremented by forgetContext to invalidate the per-thread lookups.
+        std::atomic<uint64_t> generation { 0 };
+    };
+
+    StateCaches& stateCaches ()
+    {
+        static StateCaches caches;
+        return caches;
+    }
+
+    uint32_t queryBinding (GLenum binding)
+    {
+        GLint value = 0;
+        glGetIntegerv (binding, &value);
+        return uint32_t(value);
+    }
+
+} // anonymous
+
+GLStateCache& GLStateCache::current ()
+{
+    // Most calls come from the same thread and context, avoid the lock then.
+    thread_local const void* lastContext = nullptr;
+    thread_local GLStateCache* lastCache = nullptr;
+    thread_local uint64_t lastGeneration = 0;
+
+    StateCaches& caches = stateCaches();
+    const void* context = currentNativeContext ();
+    const uint64_t generation = caches.generation.load ();
+    if (lastCache && context == lastContext && generation == lastGeneration)
+        return *lastCache;
+
+    std::lock_guard<std::mutex> _ (caches.mutex);
+    std::unique_ptr<GLStateCache>& cache = caches.byContext[context];
+    if (!cache)
+        cache.reset (new GLStateCache());
+    lastContext = context;
+    lastCache = cache.get();
+    lastGeneration = generation;
+    return *cache;
+}
+
+void GLStateCache::forgetContext (const void* nativeContext)
+{
+    StateCaches& caches = stateCaches();
+    std::lock_guard<std::mutex> _ (caches.mutex);
+    caches.byContext.erase (nativeContext);
+    ++caches.generation;
+}
+
+void GLStateCache::invalidate ()
+{
+    _program = -1;
+    _drawFramebuffer = -1;
+    _readFramebuffer = -1;
+    _texture2D = -1;
+    _pixelPackBuffer = -1;
+}
+
+uint32_t GLStateCache::program ()
+{
+    if (_program < 0)
+        _program = queryBinding (GL_CURRENT_PROGRAM);
+    return uint32_t(_program);
+}
+
+void GLStateCache::useProgram (uint32_t program)
+{
+    if (_program == int64_t(program))
+        return;
+    glUseProgram (program);
+    _program = program;
+}
+
+void GLStateCache::bindFramebuffer (uint32_t fbo)
+{
+    if (_drawFramebuffer == int64_t(fbo) && _readFramebuffer == int64_t(fbo))
+        return;
+    glBindFramebuffer (GL_FRAMEBUFFER, fbo);
+    _drawFramebuffer = fbo;
+    _readFramebuffer = fbo;
+}
+
+uint32_t GLStateCache::drawFramebuffer ()
+{
+    if (_drawFramebuffer < 0)
+        _drawFramebuffer = queryBinding (GL_DRAW_FRAMEBUFFER_BINDING);
+    return uint32_t(_drawFramebuffer);
+}
+
+uint32_t GLStateCache::readFramebuffer ()
+{
+    if (_readFramebuffer < 0)
+        _readFramebuffer = queryBinding (GL_READ_FRAMEBUFFER_BINDING);
+    return uint32_t(_readFramebuffer);
+}
+
+void GLStateCache::bindReadFramebuffer (uint32_t fbo)
+{
+    if (_readFramebuffer == int64_t(fbo))
+        return;
+    glBindFramebuffer (GL_READ_FRAMEBUFFER, fbo);
+    _readFramebuffer = fbo;
+}
+
+void GLStateCache::deleteFramebuffer (uint32_t fbo)
+{
+    // GL reverts the bindings of the current context to 0.
+    glDeleteFramebuffers (1, &fbo);
+    if (_drawFramebuffer == int64_t(fbo))
+        _drawFramebuffer = 0;
+    if (_readFramebuffer == int64_t(fbo))
+        _readFramebuffer = 0;
+}
+
+uint32_t GLStateCache::texture2D ()
+{
+    if (_texture2D < 0)
+        _texture2D = queryBinding (GL_TEXTURE_BINDING_2D);
+    return uint32_t(_texture2D);
+}
+
+void GLStateCache::bindTexture2D (uint32_t texture)
+{
+    if (_texture2D == int64_t(texture))
+        return;
+    glBindTexture (GL_TEXTURE_2D, texture);
+    _texture2D = texture;
+}
+
+void GLStateCache::deleteTexture (uint32_t texture)
+{
+    glDeleteTextures (1, &texture);
+    if (_texture2D == int64_t(texture))
+        _texture2D = 0;
+    // Binding the deleted name again would create a new texture.
+    for (auto& savedTexture : _savedTextures2D)
+    {
+        if (savedTexture == texture)
+            savedTexture = 0;
+    }
+}
+
+uint32_t GLStateCache::pixelPackBuffer ()
+{
+    if (_pixelPackBuffer < 0)
+        _pixelPackBuffer = queryBinding (GL_PIXEL_PACK_BUFFER_BINDING);
+    return uint32_t(_pixelPackBuffer);
+}
+
+void GLStateCache::bindPixelPackBuffer (uint32_t buffer)
+{
+    if (_pixelPackBuffer == int64_t(buffer))
+        return;
+    glBindBuffer (GL_PIXEL_PACK_BUFFER, buffer);
+    _pixelPackBuffer = buffer;
+}
+
+void GLStateCache::deleteBuffer (uint32_t buffer)
+{
+    glDeleteBuffers (1, &buffer);
+    if (_pixelPackBuffer == int64_t(buffer))
+        _pixelPackBuffer = 0;
+}
+
+void GLStateCache::pushTexture2D ()
+{
+    _savedTextures2D.push_back (texture2D());
+}
+
+void GLStateCache::popTexture2D ()
+{
+    dl_assert (!_savedTextures2D.empty(), "popTexture2D without pushTexture2D.");
+    bindTexture2D (_savedTextures2D.back());
+    _savedTextures2D.pop_back ();
+}
+
+uint32_t GLStateCache::linearSampler ()
+{
+    if (_linearSampler == 0 && glHasSamplerObjects ())
+    {
+        glGenSamplers (1, &_linearSampler);
+        glSamplerParameteri (_linearSampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glSamplerParameteri (_linearSampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glSamplerParameteri (_linearSampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glSamplerParameteri (_linearSampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    return _linearSampler;
+}
+
+} // dl
+
+// --------------------------------------------------------------------------------
+// GLTexturePool
+// --------------------------------------------------------------------------------
+
+namespace dl
+{
+
+namespace
+{
+
+    size_t textureSizeInBytes (int width, int height, int numLevels)
+    {
+        const size_t level0Bytes = size_t(width) * size_t(height) * 4;
+        // The whole mipmap chain adds about a third.
+        return numLevels > 1 ? level0Bytes + level0Bytes / 3 : level0Bytes;
+    }
+
+} // anonymous
+
+GLTexturePool& GLTexturePool::shared ()
+{
+    static GLTexturePool pool;
+    return pool;
+}
+
+void GLTexturePool::setBudgetInBytes (size_t budget)
+{
+    _budgetInBytes = budget;
+    evictToFitBudget ();
+}
+
+uint32_t GLTexturePool::acquire (int width, int height, int numLevels)
+{
+    for (auto it = _entries.begin(); it != _entries.end(); ++it)
+    {
+        if (it->width != width || it->height != height || it->numLevels != numLevels)
+            continue;
+
+        const uint32_t textureId = it->textureId;
+        _pooledBytes -= it->numBytes;
+        _entries.erase (it);
+        return textureId;
+    }
+    return 0;
+}
+
+void GLTexturePool::release (uint32_t textureId, int width, int height, int numLevels)
+{
+    if (textureId == 0)
+        return;
+
+    const size_t numBytes = textureSizeInBytes (width, height, numLevels);
+    if (numBytes > _budgetInBytes)
+    {
+        GLStateCache::current().deleteTexture (textureId);
+        return;
+    }
+
+    Entry entry;
+    entry.textureId = textureId;
+    entry.width = width;
+    entry.height = height;
+    entry.numLevels = numLevels;
+    entry.numBytes = numBytes;
+    _entries.insert (_entries.begin(), entry);
+    _pooledBytes += numBytes;
+    evictToFitBudget ();
+}
+
+void GLTexturePool::clear ()
+{
+    for (const auto& entry : _entries)
+        GLStateCache::current().deleteTexture (entry.textureId);
+    _entries.clear ();
+    _pooledBytes = 0;
+}
+
+void GLTexturePool::evictToFitBudget ()
+{
+    while (_pooledBytes > _budgetInBytes && !_entries.empty())
+    {
+        GLStateCache::current().deleteTexture (_entries.back().textureId);
+        _pooledBytes -= _entries.back().numBytes;
+        _entries.pop_back ();
+    }
+}
+
 } // dl
 
 // --------------------------------------------------------------------------------
@@ -368,7 +1352,9 @@ struct GLFrameBuffer::Impl
     GLuint fbo = 0;
     // GLuint rbo = 0;
     GLuint rbo_depth = 0;
-    GLint fboBeforeEnabled = 0;
+    uint32_t fboBeforeEnabled = 0;
+    // The texture id can change when generating the mipmaps.
+    GLuint attachedTextureId = 0;
 
     GLTexture outputColorTexture;
 };
@@ -381,7 +1367,7 @@ GLFrameBuffer::~GLFrameBuffer ()
 {
     if (impl->fboInitialized)
     {
-        glDeleteFramebuffers(1, &impl->fbo);
+        GLStateCache::current().deleteFramebuffer (impl->fbo);
         // glDeleteRenderbuffers(1, &impl->rbo);
         glDeleteRenderbuffers(1, &impl->rbo_depth);
     }
@@ -394,12 +1380,12 @@ GLTexture& GLFrameBuffer::outputColorTexture ()
 
 void GLFrameBuffer::enable(int width, int height)
 {
-    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &impl->fboBeforeEnabled);
+    GLStateCache& stateCache = GLStateCache::current();
+    impl->fboBeforeEnabled = stateCache.drawFramebuffer ();
 
     if (!impl->fboInitialized)
     {
         glGenFramebuffers(1, &impl->fbo);
-        glBindFramebuffer(GL_FRAMEBUFFER, impl->fbo);
         
         glGenRenderbuffers(1, &impl->rbo_depth);
         // glGenRenderbuffers(1, &impl->rbo);
@@ -408,9 +1394,11 @@ void GLFrameBuffer::enable(int width, int height)
         impl->fboInitialized = true;
     }
     
-    glBindFramebuffer(GL_FRAMEBUFFER, impl->fbo);     
+    stateCache.bindFramebuffer (impl->fbo);
 
-    if (impl->outputColorTexture.width() != width || impl->outputColorTexture.height() != height)
+    if (impl->outputColorTexture.width() != width
+        || impl->outputColorTexture.height() != height
+        || impl->outputColorTexture.textureId() != impl->attachedTextureId)
     {
         // We should not need a RBO for the color attachment anymore, the texture should be enough.
         // glBindRenderbuffer(GL_RENDERBUFFER, impl->rbo);
@@ -418,8 +1406,9 @@ void GLFrameBuffer::enable(int width, int height)
         // glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, impl->rbo);
 
         impl->outputColorTexture.ensureAllocatedForRGBA (width, height);
-        glBindTexture(GL_TEXTURE_2D, impl->outputColorTexture.textureId());
+        GLStateCache::current().bindTexture2D (impl->outputColorTexture.textureId());
         glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, impl->outputColorTexture.textureId(), 0);
+        impl->attachedTextureId = impl->outputColorTexture.textureId();
 
         glBindRenderbuffer(GL_RENDERBUFFER, impl->rbo_depth);
         glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
@@ -429,24 +1418,447 @@ void GLFrameBuffer::enable(int width, int height)
     }
 
     glViewport(0,0,width,height);
+    impl->outputColorTexture.markContentChanged ();
 }
 
 void GLFrameBuffer::disable()
 {
-    glBindFramebuffer(GL_FRAMEBUFFER, impl->fboBeforeEnabled); 
+    GLStateCache::current().bindFramebuffer (impl->fboBeforeEnabled);
     impl->fboBeforeEnabled = 0;
 }
 
 void GLFrameBuffer::downloadBuffer(ImageSRGBA& output) const
 {
     output.ensureAllocatedBufferForSize (impl->outputColorTexture.width(), impl->outputColorTexture.height());
-    glPixelStorei (GL_UNPACK_ROW_LENGTH, GLint(output.bytesPerRow() / output.bytesPerPixel()));
+    glPixelStorei (GL_PACK_ROW_LENGTH, GLint(output.bytesPerRow() / output.bytesPerPixel()));
     glReadPixels(0, 0,
                  impl->outputColorTexture.width(), impl->outputColorTexture.height(),
                  GL_RGBA,
                  GL_UNSIGNED_BYTE,
                  output.data());
-    glPixelStorei (GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei (GL_PACK_ROW_LENGTH, 0);
+}
+
+void GLFrameBuffer::downloadBufferArea (const dl::Rect& area, ImageSRGBA& output, int outputX, int outputY) const
+{
+    const int w = int(area.size.x);
+    const int h = int(area.size.y);
+    dl_assert (outputX >= 0 && outputY >= 0 && outputX + w <= output.width() && outputY + h <= output.height(), "Output too small.");
+    glPixelStorei (GL_PACK_ROW_LENGTH, GLint(output.bytesPerRow() / output.bytesPerPixel()));
+    glReadPixels(int(area.origin.x), int(area.origin.y), w, h,
+                 GL_RGBA,
+                 GL_UNSIGNED_BYTE,
+                 output.atRowPtr(outputY) + outputX);
+    glPixelStorei (GL_PACK_ROW_LENGTH, 0);
+}
+
+bool GLFrameBuffer::downloadBufferAsync (GLAsyncReadback& readback, const std::function<void(ImageSRGBA&&)>& callback) const
+{
+    if (!impl->fboInitialized)
+        return false;
+
+    GLStateCache& stateCache = GLStateCache::current();
+    const uint32_t prevReadFbo = stateCache.readFramebuffer ();
+    stateCache.bindReadFramebuffer (impl->fbo);
+    const bool ok = readback.requestReadPixels (impl->outputColorTexture.width(), impl->outputColorTexture.height(), callback);
+    stateCache.bindReadFramebuffer (prevReadFbo);
+    return ok;
+}
+
+} // dl
+
+// --------------------------------------------------------------------------------
+// GLAsyncReadback
+// --------------------------------------------------------------------------------
+
+namespace dl
+{
+
+struct GLAsyncReadback::Impl
+{
+    struct Slot
+    {
+        GLuint pbo = 0;
+        size_t capacityInBytes = 0;
+        GLsync fence = nullptr;
+        int width = 0;
+        int height = 0;
+        Callback callback;
+    };
+
+    std::vector<Slot> slots;
+    // To read parts of textures, created on first use.
+    GLuint readFbo = 0;
+    // Restored once the transfer is issued, see commitSlot.
+    uint32_t prevPixelPackBuffer = 0;
+    // Ring indices, the oldest request is at firstPending.
+    int firstPending = 0;
+    int numPending = 0;
+
+    Slot* acquireSlot (int width, int height)
+    {
+        if (numPending == int(slots.size()))
+            return nullptr;
+
+        Slot& slot = slots[(firstPending + numPending) % slots.size()];
+        if (slot.pbo == 0)
+            glGenBuffers (1, &slot.pbo);
+
+        GLStateCache& stateCache = GLStateCache::current();
+        prevPixelPackBuffer = stateCache.pixelPackBuffer ();
+        stateCache.bindPixelPackBuffer (slot.pbo);
+        const size_t requiredBytes = size_t(width) * height * 4;
+        if (slot.capacityInBytes < requiredBytes)
+        {
+            glBufferData (GL_PIXEL_PACK_BUFFER, requiredBytes, nullptr, GL_STREAM_READ);
+            slot.capacityInBytes = requiredBytes;
+        }
+        slot.width = width;
+        slot.height = height;
+        return &slot;
+    }
+
+    // Call it after issuing the transfer into the bound PBO.
+    void commitSlot (Slot& slot, const Callback& callback)
+    {
+        GLStateCache::current().bindPixelPackBuffer (prevPixelPackBuffer);
+        slot.fence = glFenceSync (GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slot.callback = callback;
+        ++numPending;
+    }
+
+    void complete (Slot& slot)
+    {
+        glDeleteSync (slot.fence);
+        slot.fence = nullptr;
+
+        ImageSRGBA image (slot.width, slot.height);
+        GLStateCache& stateCache = GLStateCache::current();
+        const uint32_t prevBuffer = stateCache.pixelPackBuffer ();
+        stateCache.bindPixelPackBuffer (slot.pbo);
+        const size_t sizeInBytes = size_t(slot.width) * slot.height * 4;
+        const uint8_t* data = (const uint8_t*)glMapBufferRange (GL_PIXEL_PACK_BUFFER, 0, sizeInBytes, GL_MAP_READ_BIT);
+        if (data)
+        {
+            for (int r = 0; r < slot.height; ++r)
+                memcpy (image.atRowPtr(r), data + size_t(r) * slot.width * 4, slot.width * 4);
+            glUnmapBuffer (GL_PIXEL_PACK_BUFFER);
+        }
+        else
+        {
+            dl_assert (false, "Could not map the readback buffer.");
+        }
+        stateCache.bindPixelPackBuffer (prevBuffer);
+
+        // The callback could request a new readback.
+        Callback callback = std::move (slot.callback);
+        slot.callback = nullptr;
+        firstPending = (firstPending + 1) % slots.size();
+        --numPending;
+        if (data && callback)
+            callback (std::move(image));
+    }
+};
+
+GLAsyncReadback::GLAsyncReadback (int numBuffers)
+: impl (new Impl())
+{
+    impl->slots.resize (std::max (1, numBuffers));
+}
+
+GLAsyncReadback::~GLAsyncReadback ()
+{
+    releaseGL ();
+}
+
+void GLAsyncReadback::releaseGL ()
+{
+    for (auto& slot : impl->slots)
+    {
+        if (slot.fence)
+            glDeleteSync (slot.fence);
+        if (slot.pbo)
+            GLStateCache::current().deleteBuffer (slot.pbo);
+        slot = {};
+    }
+
+    if (impl->readFbo)
+    {
+        GLStateCache::current().deleteFramebuffer (impl->readFbo);
+        impl->readFbo = 0;
+    }
+    impl->firstPending = 0;
+    impl->numPending = 0;
+}
+
+bool GLAsyncReadback::requestTexture (const GLTexture& texture, const Callback& callback)
+{
+    Impl::Slot* slot = impl->acquireSlot (texture.width(), texture.height());
+    if (!slot)
+        return false;
+
+    GLRestoreStateAfterScope_Texture _;
+    GLStateCache::current().bindTexture2D (texture.textureId());
+    // With a PBO bound the pointer is an offset in the buffer.
+    glGetTexImage (GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    impl->commitSlot (*slot, callback);
+    return true;
+}
+
+bool GLAsyncReadback::requestTextureRect (const GLTexture& texture, const dl::Rect& textureRect, const Callback& callback)
+{
+    const dl::Rect rect = textureRect.intersect (dl::Rect::from_x_y_w_h (0, 0, texture.width(), texture.height()));
+    const int width = int(rect.size.x);
+    const int height = int(rect.size.y);
+    if (width == 0 || height == 0)
+        return false;
+
+    Impl::Slot* slot = impl->acquireSlot (width, height);
+    if (!slot)
+        return false;
+
+    if (impl->readFbo == 0)
+        glGenFramebuffers (1, &impl->readFbo);
+
+    GLStateCache& stateCache = GLStateCache::current();
+    const uint32_t prevReadFbo = stateCache.readFramebuffer ();
+    stateCache.bindReadFramebuffer (impl->readFbo);
+    glFramebufferTexture2D (GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture.textureId(), 0);
+    glReadPixels (int(rect.origin.x), int(rect.origin.y), width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glFramebufferTexture2D (GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+    stateCache.bindReadFramebuffer (prevReadFbo);
+    impl->commitSlot (*slot, callback);
+    return true;
+}
+
+bool GLAsyncReadback::requestReadPixels (int width, int height, const Callback& callback)
+{
+    Impl::Slot* slot = impl->acquireSlot (width, height);
+    if (!slot)
+        return false;
+
+    glReadPixels (0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    impl->commitSlot (*slot, callback);
+    return true;
+}
+
+int GLAsyncReadback::processCompleted (bool waitForAll)
+{
+    int numCompleted = 0;
+    while (impl->numPending > 0)
+    {
+        Impl::Slot& slot = impl->slots[impl->firstPending];
+        // The flush makes sure that the fence eventually gets signaled. A
+        // lost context or a hung GPU could still block forever, so bound it.
+        const GLuint64 maxWaitNs = 1000000000;
+        const GLuint64 timeout = waitForAll ? maxWaitNs : 0;
+        const GLenum status = glClientWaitSync (slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+        if (status == GL_TIMEOUT_EXPIRED)
+        {
+            if (waitForAll)
+                fprintf (stderr, "ERROR: readback still not done after %.1fs, giving up.\n", maxWaitNs * 1e-9);
+            break;
+        }
+
+        dl_assert (status != GL_WAIT_FAILED, "glClientWaitSync failed.");
+        impl->complete (slot);
+        ++numCompleted;
+    }
+    return numCompleted;
+}
+
+int GLAsyncReadback::numPending () const
+{
+    return impl->numPending;
+}
+
+} // dl
+
+// --------------------------------------------------------------------------------
+// GLGpuTimers
+// --------------------------------------------------------------------------------
+
+namespace dl
+{
+
+namespace
+{
+
+    struct GpuTimersState
+    {
+        // Enough to never run out with a few frames of latency.
+        static constexpr int NumQueriesPerRing = 8;
+        // Samples kept for the stats of each section.
+        static constexpr int NumSamplesPerSection = 240;
+
+        struct QueryRing
+        {
+            std::array<GLuint, NumQueriesPerRing> queries {};
+            std::string sectionName;
+            int firstPending = 0;
+            int numPending = 0;
+        };
+
+        struct Samples
+        {
+            std::vector<double> valuesMs;
+            // Oldest value when the buffer is full.
+            int next = 0;
+
+            void add (double valueMs)
+            {
+                if (valuesMs.size() < NumSamplesPerSection)
+                {
+                    valuesMs.push_back (valueMs);
+                    return;
+                }
+                valuesMs[next] = valueMs;
+                next = (next + 1) % NumSamplesPerSection;
+            }
+        };
+
+        bool enabled = false;
+        int nestingLevel = 0;
+        QueryRing* activeRing = nullptr;
+
+        // Query objects are not shared between contexts, so there is one ring
+        // per context and section.
+        std::map<std::pair<const void*, std::string>, QueryRing> rings;
+        std::map<std::string, Samples> samples;
+
+        void collect (QueryRing& ring)
+        {
+            while (ring.numPending > 0)
+            {
+                const GLuint query = ring.queries[ring.firstPending];
+                GLint available = 0;
+                glGetQueryObjectiv (query, GL_QUERY_RESULT_AVAILABLE, &available);
+                if (!available)
+                    break;
+
+                GLuint64 elapsedNs = 0;
+                glGetQueryObjectui64v (query, GL_QUERY_RESULT, &elapsedNs);
+                samples[ring.sectionName].add (elapsedNs * 1e-6);
+                ring.firstPending = (ring.firstPending + 1) % NumQueriesPerRing;
+                --ring.numPending;
+            }
+        }
+    };
+
+    GpuTimersState& gpuTimersState ()
+    {
+        static GpuTimersState state;
+        return state;
+    }
+
+} // anonymous
+
+void GLGpuTimers::setEnabled (bool enabled)
+{
+    gpuTimersState().enabled = enabled;
+}
+
+bool GLGpuTimers::isEnabled ()
+{
+    return gpuTimersState().enabled;
+}
+
+void GLGpuTimers::beginSection (const char* name)
+{
+    auto& state = gpuTimersState();
+    ++state.nestingLevel;
+    if (!state.enabled || state.nestingLevel > 1 || !glHasTimerQueries ())
+        return;
+
+    auto& ring = state.rings[std::make_pair (currentNativeContext(), name)];
+    if (ring.queries[0] == 0)
+    {
+        glGenQueries (GpuTimersState::NumQueriesPerRing, ring.queries.data());
+        ring.sectionName = name;
+    }
+
+    state.collect (ring);
+    // All the queries are still in flight, skip this one.
+    if (ring.numPending == GpuTimersState::NumQueriesPerRing)
+        return;
+
+    const int queryIndex = (ring.firstPending + ring.numPending) % GpuTimersState::NumQueriesPerRing;
+    glBeginQuery (GL_TIME_ELAPSED, ring.queries[queryIndex]);
+    state.activeRing = &ring;
+}
+
+void GLGpuTimers::endSection ()
+{
+    auto& state = gpuTimersState();
+    dl_assert (state.nestingLevel > 0, "endSection without beginSection.");
+    --state.nestingLevel;
+    if (state.nestingLevel > 0 || !state.activeRing)
+        return;
+
+    glEndQuery (GL_TIME_ELAPSED);
+    ++state.activeRing->numPending;
+    state.activeRing = nullptr;
+}
+
+void GLGpuTimers::forgetContext (const void* nativeContext)
+{
+    auto& state = gpuTimersState();
+    const bool isCurrent = currentNativeContext() == nativeContext;
+    for (auto it = state.rings.begin(); it != state.rings.end(); )
+    {
+        if (it->first.first != nativeContext)
+        {
+            ++it;
+            continue;
+        }
+
+        if (isCurrent)
+            glDeleteQueries (GpuTimersState::NumQueriesPerRing, it->second.queries.data());
+        if (state.activeRing == &it->second)
+            state.activeRing = nullptr;
+        it = state.rings.erase (it);
+    }
+}
+
+void GLGpuTimers::collectResults ()
+{
+    auto& state = gpuTimersState();
+    if (state.rings.empty())
+        return;
+
+    const void* currentContext = currentNativeContext();
+    for (auto& it : state.rings)
+    {
+        if (it.first.first == currentContext)
+            state.collect (it.second);
+    }
+}
+
+std::vector<GLGpuTimers::Stats> GLGpuTimers::stats ()
+{
+    std::vector<Stats> allStats;
+    for (const auto& it : gpuTimersState().samples)
+    {
+        std::vector<double> values = it.second.valuesMs;
+        if (values.empty())
+            continue;
+
+        Stats stats;
+        stats.name = it.first;
+        stats.numSamples = int(values.size());
+        stats.minMs = *std::min_element (values.begin(), values.end());
+        stats.meanMs = std::accumulate (values.begin(), values.end(), 0.0) / values.size();
+        const size_t p95Index = std::min (values.size() - 1, size_t(values.size() * 0.95));
+        std::nth_element (values.begin(), values.begin() + p95Index, values.end());
+        stats.p95Ms = values[p95Index];
+        allStats.push_back (stats);
+    }
+    return allStats;
+}
+
+void GLGpuTimers::resetStats ()
+{
+    gpuTimersState().samples.clear ();
 }
 
 } // dl
@@ -501,7 +1913,8 @@ void GLImageRenderer::initializeGL ()
 
     // Setup the layout.
     glBindBuffer (GL_ARRAY_BUFFER, _vbo);
-    glBufferData (GL_ARRAY_BUFFER, vertices.size () * sizeof (DrawVert), (const GLvoid*)vertices.data (), GL_STATIC_DRAW);
+    glBufferData (GL_ARRAY_BUFFER, vertices.size () * sizeof (DrawVert), (const GLvoid*)vertices.data (), GL_DYNAMIC_DRAW);
+    _uvRect = dl::Rect::from_x_y_w_h (0, 0, 1, 1);
 
     glBindVertexArray (_vao);
     glEnableVertexAttribArray ((GLuint)GLShader::Attribute::VertexPos);
@@ -523,9 +1936,33 @@ void GLImageRenderer::initializeGL ()
 }
 
 void GLImageRenderer::render ()
+{
+    render (dl::Rect::from_x_y_w_h (0, 0, 1, 1));
+}
+
+void GLImageRenderer::render (const dl::Rect& uvRect)
 {
     glBindVertexArray (_vao);
     glBindBuffer (GL_ARRAY_BUFFER, _vbo);
+
+    // Only update the vertices when the area changes, it's usually always the full texture.
+    if (uvRect.origin.x != _uvRect.origin.x || uvRect.origin.y != _uvRect.origin.y
+        || uvRect.size.x != _uvRect.size.x || uvRect.size.y != _uvRect.size.y)
+    {
+        const float u0 = uvRect.origin.x;
+        const float v0 = uvRect.origin.y;
+        const float u1 = uvRect.origin.x + uvRect.size.x;
+        const float v1 = uvRect.origin.y + uvRect.size.y;
+        const std::array<DrawVert, 4> vertices = {
+            DrawVert { {-1,-1}, {u0,v0} }, // bottom left
+            DrawVert { {-1, 1}, {u0,v1} }, // top left
+            DrawVert { { 1, 1}, {u1,v1} }, // top right
+            DrawVert { { 1,-1}, {u1,v0} }, // bottom right
+        };
+        glBufferSubData (GL_ARRAY_BUFFER, 0, vertices.size () * sizeof (DrawVert), (const GLvoid*)vertices.data ());
+        _uvRect = uvRect;
+    }
+
     glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, _elementbuffer);
 
     glDrawElements (GL_TRIANGLES, 6, GL_UNSIGNED_BYTE, 0); // uses the GL_ELEMENT_ARRAY_BUFFER
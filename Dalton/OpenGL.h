@@ -10,14 +10,33 @@
 
 #include <memory>
 #include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
 
 namespace dl
 {
 
+class ImagePyramid;
+class GLAsyncReadback;
+
 void checkGLError ();
 
 const char* glslVersion();
 
+// Requires a current context.
+int glMaxTextureSize ();
+
+// Immutable texture storage, GL 4.2 or ARB_texture_storage. Not available
+// on macOS. Requires a current context.
+bool glHasTextureStorage ();
+
+// GL_TIME_ELAPSED queries, GL 3.3 or ARB_timer_query. Requires a current context.
+bool glHasTimerQueries ();
+
+// GL 3.3 or ARB_sampler_objects. Requires a current context.
+bool glHasSamplerObjects ();
+
 struct GLShaderHandles
 {
     uint32_t shaderHandle = 0;
@@ -44,12 +63,19 @@ public:
     ~GLShader();
     
     void initialize (const char* glslVersionString, const char* vertexShader, const char* fragmentShader);
+    bool isInitialized () const { return _glHandles.shaderHandle != 0; }
 
     void enable (int32_t textureId = 0);
     void disable ();
 
     const GLShaderHandles& glHandles () const { return _glHandles; }
 
+    // Linked programs get saved there with glGetProgramBinary and reloaded
+    // by the next initialize calls with the same sources, skipping the
+    // compilation. The files are keyed by the driver vendor, renderer
+    // and version. Empty to disable it, the default. The folder must exist.
+    static void setProgramCacheDirectory (const std::string& path);
+
 private:
     struct Impl;
     friend struct Impl;
@@ -58,14 +84,128 @@ private:
     GLShaderHandles _glHandles;
 };
 
+// Bindings of the current context that Dalton changes all the time, so
+// saving and restoring them does not need glGet round-trips, which can
+// stall the driver. Unknown values get queried once. All the binds of
+// Dalton go through it, and code that changes these bindings behind its
+// back must restore them afterwards, like the ImGui backend does, or call
+// invalidate. The texture binding is the one of the active unit, Dalton
+// only uses unit 0.
+class GLStateCache
+{
+public:
+    // The one of the current context, created on first use.
+    static GLStateCache& current ();
+    // Call it before destroying a context, another one could get the same address.
+    static void forgetContext (const void* nativeContext);
+
+public:
+    void invalidate ();
+
+    uint32_t program ();
+    void useProgram (uint32_t program);
+
+    // Binds both the draw and the read framebuffers.
+    void bindFramebuffer (uint32_t fbo);
+    uint32_t drawFramebuffer ();
+    uint32_t readFramebuffer ();
+    void bindReadFramebuffer (uint32_t fbo);
+    void deleteFramebuffer (uint32_t fbo);
+
+    uint32_t texture2D ();
+    void bindTexture2D (uint32_t texture);
+    void deleteTexture (uint32_t texture);
+
+    uint32_t pixelPackBuffer ();
+    void bindPixelPackBuffer (uint32_t buffer);
+    void deleteBuffer (uint32_t buffer);
+
+    // Saves the current texture, popTexture2D restores it. A texture that got
+    // deleted in between gets restored as 0, like GL does for the bound one.
+    void pushTexture2D ();
+    void popTexture2D ();
+
+    // Sampler object for linear filtering, trilinear with mipmaps. Binding it
+    // overrides the filtering parameters of the textures. 0 if sampler objects
+    // are not supported.
+    uint32_t linearSampler ();
+
+private:
+    // -1 when unknown.
+    int64_t _program = -1;
+    int64_t _drawFramebuffer = -1;
+    int64_t _readFramebuffer = -1;
+    int64_t _texture2D = -1;
+    int64_t _pixelPackBuffer = -1;
+    std::vector<uint32_t> _savedTextures2D;
+    uint32_t _linearSampler = 0;
+};
+
 struct GLRestoreStateAfterScope_Texture
 {
     GLRestoreStateAfterScope_Texture();
     ~GLRestoreStateAfterScope_Texture();
 
 private:
-    int32_t _prevTexture = 0;
+    GLStateCache& _stateCache;
 };
+
+// Keeps the immutable storage of the released textures, so the next
+// texture of the same size reuses it instead of allocating GPU memory
+// again, e.g. for the filter framebuffers when zooming back and forth or
+// when a window gets closed and another one opened. The buckets are exact
+// sizes, since a texture is always sampled over its full size. Over the
+// byte budget the least recently released textures get deleted.
+// Textures are shared by the contexts of a share group, but not across
+// groups, so it is disabled by default (budget of 0). Only enable it when
+// all the contexts share their objects, like the windows of DaltonLensGUI.
+// Framebuffer objects can't be shared, only their color textures get pooled.
+// All the calls must come from the GL thread.
+class GLTexturePool
+{
+public:
+    static GLTexturePool& shared ();
+
+    // Evicts textures if the new budget is smaller.
+    void setBudgetInBytes (size_t budget);
+    size_t budgetInBytes () const { return _budgetInBytes; }
+    bool isEnabled () const { return _budgetInBytes > 0; }
+
+    size_t pooledBytes () const { return _pooledBytes; }
+    int numPooledTextures () const { return int(_entries.size()); }
+
+    // Returns 0 if there is no texture with that storage in the pool.
+    uint32_t acquire (int width, int height, int numLevels);
+    // Deletes the texture right away when disabled.
+    void release (uint32_t textureId, int width, int height, int numLevels);
+
+    // Deletes all the pooled textures, requires a context of the share group.
+    void clear ();
+
+private:
+    struct Entry
+    {
+        uint32_t textureId = 0;
+        int width = 0;
+        int height = 0;
+        int numLevels = 0;
+        size_t numBytes = 0;
+    };
+
+    void evictToFitBudget ();
+
+private:
+    // Most recently released first.
+    std::vector<Entry> _entries;
+    size_t _budgetInBytes = 0;
+    size_t _pooledBytes = 0;
+};
+
+// The storage is immutable (glTexStorage2D) when the driver supports it,
+// and gets reused as long as the size does not change, so repeated uploads
+// of same-size images keep the same texture id. Large uploads are streamed
+// through an orphaned GL_PIXEL_UNPACK_BUFFER to avoid stalling when the
+// texture is still being used by the previous frame.
 class GLTexture
 {
 public:
@@ -78,33 +218,161 @@ public:
     void initializeWithExistingTextureID (uint32_t textureId, int width, int height);
     void releaseGL ();
 
+    // No-op if the storage already has that size. Otherwise the
+    // texture id can change when using immutable storage.
     void ensureAllocatedForRGBA (int width, int height);
     void upload (const dl::ImageSRGBA& im);
     void uploadRgba(const uint8_t* rgbaBuffer, int width, int height, int bytesPerRow = -1);
+    // Updates only the given area of the texture, taken from the same area of im.
+    // The texture must already have the same size as im.
+    void uploadSubRect (const dl::ImageSRGBA& im, int x, int y, int width, int height);
+    // Same, but the pixels come from firstPixel, which maps to (x,y).
+    void uploadRgbaSubRect (const uint8_t* firstPixel, int x, int y, int width, int height, int bytesPerRow);
     void download (dl::ImageSRGBA& im);
 
+    // Uploads levels 1..n from a pyramid computed on the CPU. Level 0 needs
+    // to be uploaded first. Any level 0 upload drops the mipmaps.
+    // The first call can change the texture id to allocate the mipmap levels.
+    void uploadMipmaps (const ImagePyramid& pyramid);
+    // Computes levels 1..n on the GPU from level 0. Same remark on the id.
+    void generateMipmaps ();
+    bool hasMipmaps () const { return _numMipLevels > 1; }
+
     uint32_t textureId() const { return _textureId; }
 
+    // Changes whenever level 0 gets new content, unique across all the
+    // textures. Uploads update it, and so does GLFrameBuffer::enable for
+    // its color texture. Call markContentChanged after drawing into the
+    // texture by other means.
+    uint64_t contentGeneration () const { return _contentGeneration; }
+    void markContentChanged ();
+
+    // Uses trilinear filtering for minification when mipmaps are available.
     void setLinearInterpolationEnabled (bool enabled);
 
+private:
+    void dropMipmapsIfAny ();
+    void applyFilteringParams ();
+    void allocateStorage (int width, int height, int numLevels);
+    // Gives the storage back to the pool, or deletes it. Leaves the id to 0.
+    void releaseStorage ();
+    void ensureStorageForAllMipmapLevels ();
+    void uploadPixels (int level, int x, int y, int width, int height, const uint8_t* firstPixel, int bytesPerRow);
+
 private:
     uint32_t _textureId = 0;
     bool _linearInterpolationEnabled = false;
     int _width = 0;
     int _height = 0;
+    int _numMipLevels = 1;
+
+    // Number of allocated levels, 0 if nothing was allocated yet.
+    int _storageLevels = 0;
+    bool _immutableStorage = false;
+    // From initializeWithExistingTextureID, never goes to the pool.
+    bool _externalStorage = false;
+
+    uint32_t _unpackBuffer = 0;
+    uint64_t _contentGeneration = 0;
 };
 
-// Offscreen GL context.
+// Splits images that can be larger than GL_MAX_TEXTURE_SIZE into a grid
+// of textures. The tiles only display their imageRect, which don't overlap,
+// but their textures also get a border of pixels from the neighbor tiles.
+// Linear filtering and the mipmap levels up to log2(maxTileBorder) then
+// don't leave seams between the tiles. Most images fit in a single tile.
+class GLTiledTexture
+{
+public:
+    struct Tile
+    {
+        // Area displayed by the tile, in image coordinates.
+        dl::Rect imageRect;
+        // Area of the image stored in the texture, imageRect plus the border.
+        dl::Rect textureRect;
+        GLTexture texture;
+    };
+
+    // Smaller with small tiles, see tileBorder.
+    static constexpr int maxTileBorder = 64;
+
+public:
+    GLTiledTexture ();
+    ~GLTiledTexture ();
+
+    int width () const { return _width; }
+    int height () const { return _height; }
+
+    // Mostly for testing, <= 0 means glMaxTextureSize. Takes effect on the
+    // next allocation.
+    void setMaxTileSize (int size) { _requestedMaxTileSize = size; }
+    int maxTileSize () const;
+    // Number of pixels of the neighbor tiles in each texture.
+    int tileBorder () const { return _tileBorder; }
+
+    void releaseGL ();
+
+    // No-op if the size did not change. Otherwise the tiles get recreated.
+    void ensureAllocatedForRGBA (int width, int height);
+    void upload (const dl::ImageSRGBA& im);
+    // The tiled texture must already have the same size as im.
+    void uploadSubRect (const dl::ImageSRGBA& im, int x, int y, int width, int height);
+
+    void generateMipmaps ();
+    void setLinearInterpolationEnabled (bool enabled);
+
+    int numTiles () const { return int(_tiles.size()); }
+    const Tile& tile (int i) const { return *_tiles[i]; }
+    Tile& tile (int i) { return *_tiles[i]; }
+
+    // Returns -1 if the pixel is outside of the image.
+    int tileIndexForPixel (int x, int y) const;
+
+private:
+    std::vector<std::unique_ptr<Tile>> _tiles;
+    int _width = 0;
+    int _height = 0;
+    int _requestedMaxTileSize = 0;
+    int _allocatedMaxTileSize = 0;
+    int _tileBorder = 0;
+    // Distance between the origins of two consecutive tiles.
+    int _tileStep = 0;
+    int _numTileCols = 0;
+    bool _linearInterpolationEnabled = false;
+};
+
+// Offscreen GL context. The GLFW backend needs a display, while the
+// surfaceless EGL one (Linux only) can run in daemons and containers
+// without any X server, including on Mesa llvmpipe with no GPU.
+// The GL functions still come from gl3w, so gl3wInit needs to be called
+// once a context is current. With EGL this relies on libglvnd, which
+// dispatches the libGL entry points to the current EGL context.
 class GLContext
 {
 public:
-    GLContext(GLContext* parentContext = nullptr);
+    enum class Backend
+    {
+        // EGLSurfaceless if the DALTONLENS_GL_BACKEND environment
+        // variable is "egl", GLFW otherwise.
+        Default,
+        GLFW,
+        EGLSurfaceless,
+    };
+
+public:
+    // The parent context must use the same backend. The new context is current.
+    GLContext(GLContext* parentContext = nullptr, Backend backend = Backend::Default);
     ~GLContext ();
 
+    // False if the context could not be created, e.g. no EGL driver.
+    bool isValid () const;
+    Backend backend () const;
+
     void makeCurrent ();
 
 public:
     static void setCurrentToNull ();
+    static Backend defaultBackend ();
 
 private:
     struct Impl;
@@ -118,9 +386,15 @@ public:
     ~GLFrameBuffer ();
 
 public:
+    // Marks the content of the color texture as changed.
     void enable (int width, int height);
     void disable ();
     void downloadBuffer (ImageSRGBA& output) const;
+    // Reads the given area of the buffer to (outputX, outputY) in output,
+    // which must already be allocated and large enough.
+    void downloadBufferArea (const dl::Rect& area, ImageSRGBA& output, int outputX, int outputY) const;
+    // Same, but does not wait for the rendering to finish, see GLAsyncReadback.
+    bool downloadBufferAsync (GLAsyncReadback& readback, const std::function<void(ImageSRGBA&&)>& callback) const;
     GLTexture& outputColorTexture ();
 
 private:
@@ -128,6 +402,93 @@ private:
     std::unique_ptr<Impl> impl;
 };
 
+// Reads back textures or framebuffers without stalling the pipeline. The
+// transfer goes into a ring of GL_PIXEL_PACK_BUFFER objects, and each buffer
+// only gets mapped once its fence got signaled, typically a frame later.
+// All the calls must happen with the same context current.
+class GLAsyncReadback
+{
+public:
+    using Callback = std::function<void(ImageSRGBA&& image)>;
+
+public:
+    // 2 or 3 buffers are enough to read back one image per frame.
+    GLAsyncReadback (int numBuffers = 3);
+    ~GLAsyncReadback ();
+
+    void releaseGL ();
+
+    // Returns false if all the buffers are still in flight, processCompleted
+    // needs to be called first. The image rows are bottom to top, like glReadPixels.
+    bool requestTexture (const GLTexture& texture, const Callback& callback);
+    // Only reads the given area of level 0, in pixels. Cheap enough to
+    // fetch a few pixels every frame.
+    bool requestTextureRect (const GLTexture& texture, const dl::Rect& textureRect, const Callback& callback);
+    // Reads from the currently bound GL_READ_FRAMEBUFFER.
+    bool requestReadPixels (int width, int height, const Callback& callback);
+
+    // Calls the callbacks of the completed transfers, in the request order.
+    // Typically called once per frame. With waitForAll it blocks until all
+    // the pending transfers are done, but gives up with an error after a
+    // second on one of them, it then stays pending. Returns the number of
+    // callbacks called.
+    int processCompleted (bool waitForAll = false);
+    int numPending () const;
+
+private:
+    struct Impl;
+    friend struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+// GPU time of named sections, measured with GL_TIME_ELAPSED queries. Each
+// section and context gets a ring of queries, and the results are only
+// collected once available, typically a few frames later, so nothing waits
+// for the GPU. GL can't nest time queries, so sections started within
+// another one are not measured. Disabled by default, it's a no-op then.
+// All the calls must come from the GL thread.
+class GLGpuTimers
+{
+public:
+    struct Stats
+    {
+        std::string name;
+        int numSamples = 0;
+        // In milliseconds, over the last samples.
+        double minMs = NAN;
+        double meanMs = NAN;
+        double p95Ms = NAN;
+    };
+
+public:
+    static void setEnabled (bool enabled);
+    static bool isEnabled ();
+
+    // Requires a current context. Prefer GLScopedGpuTimer.
+    static void beginSection (const char* name);
+    static void endSection ();
+
+    // Call it before destroying a context, like GLStateCache::forgetContext.
+    // The queries get deleted if it is current, otherwise destroying the
+    // context releases them.
+    static void forgetContext (const void* nativeContext);
+
+    // Collects the available results of the current context, without
+    // waiting. Typically called once per frame, before swapping the buffers.
+    static void collectResults ();
+
+    // Sorted by name.
+    static std::vector<Stats> stats ();
+    static void resetStats ();
+};
+
+class GLScopedGpuTimer
+{
+public:
+    GLScopedGpuTimer (const char* name) { GLGpuTimers::beginSection (name); }
+    ~GLScopedGpuTimer () { GLGpuTimers::endSection (); }
+};
+
 class GLImageRenderer
 {
 public:
@@ -135,11 +496,16 @@ public:
 
     void initializeGL ();
     void render ();
+    // Only samples the given area of the input texture, in UV coordinates,
+    // but still covers the full view. Used to filter a part of an image
+    // into a framebuffer of the size of that part.
+    void render (const dl::Rect& uvRect);
 
 private:
     uint32_t _vbo = 0;
     uint32_t _vao = 0;
     uint32_t _elementbuffer = 0;
+    dl::Rect _uvRect = dl::Rect::from_x_y_w_h (0, 0, 1, 1);
 };
 
 } // dl
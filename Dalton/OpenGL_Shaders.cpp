@@ -217,49 +217,42 @@ const char* fragmentShader_Normal_glsl_130 = R"(
     }
 )";
 
-const char* fragmentShader_FlipRedBlue_glsl_130 = R"(
-    uniform sampler2D Texture;
-    in vec2 Frag_UV;
-    out vec4 Out_Color;
-    void main()
+// Pixel functions, see GLPixelFunction. PREFIX_ gets replaced when
+// generating the shader.
+
+const char* pixelFunction_FlipRedBlue = R"(
+    vec4 PREFIX_apply (vec4 srgba)
     {
-        vec4 rgba = RGB_from_SRGB(texture(Texture, Frag_UV.st));
+        vec4 rgba = RGB_from_SRGB(srgba);
         vec3 yCbCr = YCbCr_from_RGBA(rgba);
         vec3 transformedYCbCr = yCbCr;
         transformedYCbCr.x = yCbCr.x;
         transformedYCbCr.y = yCbCr.z;
         transformedYCbCr.z = yCbCr.y;
-        Out_Color = sRGB_from_RGBClamped(RGBA_from_YCbCr (transformedYCbCr, 1.0));
+        return sRGB_from_RGBClamped(RGBA_from_YCbCr (transformedYCbCr, 1.0));
     }
 )";
 
-const char* fragmentShader_FlipRedBlue_InvertRed_glsl_130 = R"(
-    uniform sampler2D Texture;
-    in vec2 Frag_UV;
-    out vec4 Out_Color;
-    void main()
+const char* pixelFunction_FlipRedBlue_InvertRed = R"(
+    vec4 PREFIX_apply (vec4 srgba)
     {
-        vec4 rgba = RGB_from_SRGB(texture(Texture, Frag_UV.st));
+        vec4 rgba = RGB_from_SRGB(srgba);
         vec3 yCbCr = YCbCr_from_RGBA(rgba);
         vec3 transformedYCbCr = yCbCr;
         transformedYCbCr.x = yCbCr.x;
         transformedYCbCr.y = -yCbCr.z; // flip Cb
         transformedYCbCr.z = yCbCr.y;
-        Out_Color = sRGB_from_RGB(RGBA_from_YCbCr (transformedYCbCr, 1.0));
+        return sRGB_from_RGB(RGBA_from_YCbCr (transformedYCbCr, 1.0));
     }
 )";
 
-const char* fragmentShader_HSVTransform_glsl_130 = R"(
-    uniform float u_hueShift;
-    uniform float u_saturationScale;
-    uniform int u_hueQuantization;
-
-    uniform sampler2D Texture;
-    in vec2 Frag_UV;
-    out vec4 Out_Color;
+const char* pixelFunction_HSVTransform = R"(
+    uniform float PREFIX_u_hueShift;
+    uniform float PREFIX_u_saturationScale;
+    uniform int PREFIX_u_hueQuantization;
 
     // http://www.workwithcolor.com/yellow-color-hue-range-01.htm
-    vec2 quantizeHueLevel1 (int hue360)
+    vec2 PREFIX_quantizeHueLevel1 (int hue360)
     {
         if (hue360 < 10)  return vec2(0, 1);   // red
         if (hue360 < 20)  return vec2(15, 1);  // red-orange
@@ -281,7 +274,7 @@ const char* fragmentShader_HSVTransform_glsl_130 = R"(
     }
 
     // https://www.researchgate.net/figure/Nonuniform-hue-circle-quantization_fig6_224561621
-    vec2 quantizeHueLevel2 (int hue360)
+    vec2 PREFIX_quantizeHueLevel2 (int hue360)
     {
         if (hue360 < 22)  return vec2(0, 1);   // red
         if (hue360 < 45)  return vec2(30, 1);  // orange
@@ -293,84 +286,73 @@ const char* fragmentShader_HSVTransform_glsl_130 = R"(
         return vec2(0,1); // red again
     }
 
-    void main()
-    {        
-        vec4 srgba = texture(Texture, Frag_UV.st);
+    vec4 PREFIX_apply (vec4 srgba)
+    {
         // All in [0,1]
         vec3 hsv = HSV_from_SRGB(srgba.rgb);
-        hsv.x = mod(hsv.x + u_hueShift, 1.0);
-        if (u_hueQuantization != 0)
+        hsv.x = mod(hsv.x + PREFIX_u_hueShift, 1.0);
+        if (PREFIX_u_hueQuantization != 0)
         { 
-            vec2 hueBrightness = u_hueQuantization == 1 ? quantizeHueLevel1(int(hsv.x*360.0)) : quantizeHueLevel2(int(hsv.x*360.0));
+            vec2 hueBrightness = PREFIX_u_hueQuantization == 1 ? PREFIX_quantizeHueLevel1(int(hsv.x*360.0)) : PREFIX_quantizeHueLevel2(int(hsv.x*360.0));
             hsv.x = hueBrightness.x / 360.0;
             hsv.z = min(1.0, hsv.z * hueBrightness.y);
         }
-        hsv.y = min(1.0, hsv.y * u_saturationScale);
-        vec4 transformedSRGB = RGBA_from_HSV(hsv, 1.0);
-        Out_Color = transformedSRGB;
+        hsv.y = min(1.0, hsv.y * PREFIX_u_saturationScale);
+        return RGBA_from_HSV(hsv, 1.0);
     }
 )";
 
-const char* fragmentShader_DaltonizeV1_glsl_130 = R"(
-    uniform sampler2D Texture;
-    uniform int u_kind;
-    uniform bool u_simulateOnly;
-    uniform float u_severity;
-    in vec2 Frag_UV;
-    out vec4 Out_Color;
-    void main()
+const char* pixelFunction_DaltonizeV1 = R"(
+    uniform int PREFIX_u_kind;
+    uniform bool PREFIX_u_simulateOnly;
+    uniform float PREFIX_u_severity;
+
+    vec4 PREFIX_apply (vec4 srgba)
     {
-        vec4 rgba = RGB_from_SRGB(texture(Texture, Frag_UV.st));
+        vec4 rgba = RGB_from_SRGB(srgba);
         vec3 lms = LMS_from_RGBA(rgba);
         vec3 lmsSimulated = vec3(0,1,0);
-        switch (u_kind) {
+        switch (PREFIX_u_kind) {
             case 0: lmsSimulated = applyProtanope_Vienot(lms); break;
             case 1: lmsSimulated = applyDeuteranope_Vienot(lms); break;
             // Vienot 1999 is not accurate for tritanopia.
             case 2: lmsSimulated = applyTritanope_Brettel1997(lms); break;
         }
         // Linear interpolation to specify a similarity.
-        lmsSimulated = mix(lms, lmsSimulated, u_severity);
+        lmsSimulated = mix(lms, lmsSimulated, PREFIX_u_severity);
         vec4 rgbaSimulated = RGBA_from_LMS(lmsSimulated, 1.0);
-        vec4 rgbaOut = u_simulateOnly ? rgbaSimulated : daltonizeV1(rgba, rgbaSimulated);
-        Out_Color = sRGB_from_RGBClamped(rgbaOut);
+        vec4 rgbaOut = PREFIX_u_simulateOnly ? rgbaSimulated : daltonizeV1(rgba, rgbaSimulated);
+        return sRGB_from_RGBClamped(rgbaOut);
     }
 )";
 
-const char* fragmentShader_highlightSameColor = R"(
-    uniform sampler2D Texture;
-    uniform vec3 u_refColor_sRGB;
-    uniform float u_deltaH_360;
-    uniform float u_deltaS_100;
-    uniform float u_deltaV_255;
-    uniform int u_frameCount;
-    in vec2 Frag_UV;
-    out vec4 Out_Color;
+const char* pixelFunction_highlightSameColor = R"(
+    uniform vec3 PREFIX_u_refColor_sRGB;
+    uniform float PREFIX_u_deltaH_360;
+    uniform float PREFIX_u_deltaS_100;
+    uniform float PREFIX_u_deltaV_255;
 
-    bool checkHSVDelta(vec3 hsv1, vec3 hsv2)
+    bool PREFIX_checkHSVDelta(vec3 hsv1, vec3 hsv2)
     {
         vec3 diff = abs(hsv1 - hsv2);
         diff.x = min (diff.x, 1.0-diff.x); // h is modulo 360º
-        return (diff.x*360.0    < u_deltaH_360
-                && diff.y*100.0 < u_deltaS_100
-                && diff.z*255.0 < u_deltaV_255);
+        return (diff.x*360.0    < PREFIX_u_deltaH_360
+                && diff.y*100.0 < PREFIX_u_deltaS_100
+                && diff.z*255.0 < PREFIX_u_deltaV_255);
     }
 
-    void main()
+    vec4 PREFIX_apply (vec4 srgba)
     {
-        vec4 srgba = texture(Texture, Frag_UV.st);
         vec3 hsv = HSV_from_SRGB(srgba.rgb);
-        vec3 ref_hsv = HSV_from_SRGB(u_refColor_sRGB.rgb);
+        vec3 ref_hsv = HSV_from_SRGB(PREFIX_u_refColor_sRGB.rgb);
         
-        bool isSame = checkHSVDelta(ref_hsv, hsv);
-                        
-        float t = u_frameCount;
-        float timeWeight = sin(t / 2.0)*0.5 + 0.5; // between 0 and 1
-        float timeWeightedIntensity = timeWeight;
-        hsv.z = mix (hsv.z, timeWeightedIntensity, isSame);
-
-        vec4 transformedSRGB = RGBA_from_HSV(hsv, 1.0);
-        Out_Color = transformedSRGB;
+        bool isSame = PREFIX_checkHSVDelta(ref_hsv, hsv);
+        if (!isSame)
+            return vec4(srgba.rgb, 0.0);
+
+        // Full brightness, the blinking intensity gets applied when compositing.
+        hsv.z = 1.0;
+        return RGBA_from_HSV(hsv, 1.0);
     }
 )";
 
@@ -15,14 +15,16 @@ extern const char* defaultFragmentShader_glsl_130;
 
 extern const char* fragmentShader_Normal_glsl_130;
 
-extern const char* fragmentShader_HSVTransform_glsl_130;
+// Pixel functions for the filters, see GLPixelFunction.
 
-extern const char* fragmentShader_FlipRedBlue_glsl_130;
+extern const char* pixelFunction_HSVTransform;
 
-extern const char* fragmentShader_FlipRedBlue_InvertRed_glsl_130;
+extern const char* pixelFunction_FlipRedBlue;
 
-extern const char* fragmentShader_DaltonizeV1_glsl_130;
+extern const char* pixelFunction_FlipRedBlue_InvertRed;
 
-extern const char* fragmentShader_highlightSameColor;
+extern const char* pixelFunction_DaltonizeV1;
+
+extern const char* pixelFunction_highlightSameColor;
 
 } // dl
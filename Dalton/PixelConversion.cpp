@@ -0,0 +1,384 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#include "PixelConversion.h"
+
+#include <Dalton/Utils.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+# define DL_HAS_X86_SIMD 1
+# include <immintrin.h>
+# if defined(_MSC_VER) && !defined(__clang__)
+#  include <intrin.h>
+#  define DL_TARGET(x)
+# else
+#  define DL_TARGET(x) __attribute__((target(x)))
+# endif
+#endif
+
+namespace dl
+{
+
+namespace
+{
+
+    void convertBGRXRows_Scalar (const uint8_t* src, int srcBytesPerRow, int width, int rowBegin, int rowEnd, ImageSRGBA& output)
+    {
+        for (int r = rowBegin; r < rowEnd; ++r)
+        {
+            const uint8_t* srcPtr = src + size_t(srcBytesPerRow) * r;
+            PixelSRGBA* dstPtr = output.atRowPtr(r);
+            for (int c = 0; c < width; ++c, srcPtr += 4)
+                dstPtr[c] = PixelSRGBA(srcPtr[2], srcPtr[1], srcPtr[0], 255);
+        }
+    }
+
+#if DL_HAS_X86_SIMD
+
+    DL_TARGET("ssse3")
+    void convertBGRXRows_SSSE3 (const uint8_t* src, int srcBytesPerRow, int width, int rowBegin, int rowEnd, ImageSRGBA& output)
+    {
+        const __m128i shuffle = _mm_setr_epi8 (2, 1, 0, -1, 6, 5, 4, -1, 10, 9, 8, -1, 14, 13, 12, -1);
+        const __m128i alpha = _mm_set1_epi32 (int(0xff000000));
+        for (int r = rowBegin; r < rowEnd; ++r)
+        {
+            const uint8_t* srcPtr = src + size_t(srcBytesPerRow) * r;
+            PixelSRGBA* dstPtr = output.atRowPtr(r);
+            int c = 0;
+            for (; c + 4 <= width; c += 4)
+            {
+                __m128i v = _mm_loadu_si128 (reinterpret_cast<const __m128i*>(srcPtr + c*4));
+                v = _mm_or_si128 (_mm_shuffle_epi8 (v, shuffle), alpha);
+                _mm_storeu_si128 (reinterpret_cast<__m128i*>(dstPtr + c), v);
+            }
+            for (; c < width; ++c)
+                dstPtr[c] = PixelSRGBA(srcPtr[c*4+2], srcPtr[c*4+1], srcPtr[c*4], 255);
+        }
+    }
+
+    DL_TARGET("avx2")
+    void convertBGRXRows_AVX2 (const uint8_t* src, int srcBytesPerRow, int width, int rowBegin, int rowEnd, ImageSRGBA& output)
+    {
+        // The shuffle works within each 128 bits lane, which is fine since pixels don't cross lanes.
+        const __m256i shuffle = _mm256_setr_epi8 (2, 1, 0, -1, 6, 5, 4, -1, 10, 9, 8, -1, 14, 13, 12, -1,
+                                                  2, 1, 0, -1, 6, 5, 4, -1, 10, 9, 8, -1, 14, 13, 12, -1);
+        const __m256i alpha = _mm256_set1_epi32 (int(0xff000000));
+        for (int r = rowBegin; r < rowEnd; ++r)
+        {
+            const uint8_t* srcPtr = src + size_t(srcBytesPerRow) * r;
+            PixelSRGBA* dstPtr = output.atRowPtr(r);
+            int c = 0;
+            for (; c + 8 <= width; c += 8)
+            {
+                __m256i v = _mm256_loadu_si256 (reinterpret_cast<const __m256i*>(srcPtr + c*4));
+                v = _mm256_or_si256 (_mm256_shuffle_epi8 (v, shuffle), alpha);
+                _mm256_storeu_si256 (reinterpret_cast<__m256i*>(dstPtr + c), v);
+            }
+            for (; c < width; ++c)
+                dstPtr[c] = PixelSRGBA(srcPtr[c*4+2], srcPtr[c*4+1], srcPtr[c*4], 255);
+        }
+    }
+
+    struct CpuFeatures
+    {
+        bool ssse3 = false;
+        bool avx2 = false;
+
+        CpuFeatures ()
+        {
+# if defined(_MSC_VER) && !defined(__clang__)
+            int info[4];
+            __cpuid (info, 0);
+            const int maxLeaf = info[0];
+            __cpuid (info, 1);
+            ssse3 = (info[2] & (1 << 9)) != 0;
+            const bool osUsesXSave = (info[2] & (1 << 27)) != 0;
+            if (maxLeaf >= 7 && osUsesXSave && (_xgetbv(0) & 0x6) == 0x6)
+            {
+                __cpuidex (info, 7, 0);
+                avx2 = (info[1] & (1 << 5)) != 0;
+            }
+# else
+            __builtin_cpu_init ();
+            ssse3 = __builtin_cpu_supports ("ssse3");
+            avx2 = __builtin_cpu_supports ("avx2");
+# endif
+        }
+    };
+
+    const CpuFeatures& cpuFeatures ()
+    {
+        static CpuFeatures features;
+        return features;
+    }
+
+#endif // DL_HAS_X86_SIMD
+
+    struct ChannelUnpacker
+    {
+        uint32_t mask = 0;
+        int shift = 0;
+        int numBits = 0;
+        // Maps the raw value to [0,255] when numBits <= 8.
+        uint8_t lut[256];
+
+        void initialize (uint32_t mask)
+        {
+            this->mask = mask;
+            shift = 0;
+            numBits = 0;
+            if (mask == 0)
+                return;
+
+            while (((mask >> shift) & 1) == 0)
+                ++shift;
+            while (numBits < 32 - shift && ((mask >> (shift + numBits)) & 1))
+                ++numBits;
+
+            if (numBits <= 8)
+            {
+                const int maxValue = (1 << numBits) - 1;
+                for (int v = 0; v <= maxValue; ++v)
+                    lut[v] = uint8_t((v * 255 + maxValue/2) / maxValue);
+            }
+        }
+
+        inline uint8_t unpack (uint32_t pixel) const
+        {
+            const uint32_t v = (pixel & mask) >> shift;
+            if (numBits <= 8)
+                return numBits == 0 ? 0 : lut[v];
+            return uint8_t(v >> (numBits - 8));
+        }
+    };
+
+    void convertGenericRows (const uint8_t* src, int srcBytesPerRow, int width, int rowBegin, int rowEnd,
+                             const PackedPixelFormat& format,
+                             const ChannelUnpacker& red, const ChannelUnpacker& green, const ChannelUnpacker& blue,
+                             ImageSRGBA& output)
+    {
+        const int bytesPerPixel = format.bitsPerPixel / 8;
+        for (int r = rowBegin; r < rowEnd; ++r)
+        {
+            const uint8_t* srcPtr = src + size_t(srcBytesPerRow) * r;
+            PixelSRGBA* dstPtr = output.atRowPtr(r);
+            for (int c = 0; c < width; ++c, srcPtr += bytesPerPixel)
+            {
+                uint32_t pixel = 0;
+                if (format.msbFirst)
+                {
+                    for (int i = 0; i < bytesPerPixel; ++i)
+                        pixel = (pixel << 8) | srcPtr[i];
+                }
+                else
+                {
+                    for (int i = bytesPerPixel-1; i >= 0; --i)
+                        pixel = (pixel << 8) | srcPtr[i];
+                }
+
+                dstPtr[c] = PixelSRGBA(red.unpack(pixel), green.unpack(pixel), blue.unpack(pixel), 255);
+            }
+        }
+    }
+
+    // unpackPixel (const uint8_t* srcPixel, int rgb[3]) adds the channels to rgb.
+    template <class UnpackPixelFunc>
+    void convertAndDownsampleRows (const uint8_t* src, int srcBytesPerRow, int width, int height,
+                                   int bytesPerPixel, int factor,
+                                   int outRowBegin, int outRowEnd,
+                                   UnpackPixelFunc unpackPixel,
+                                   ImageSRGBA& output)
+    {
+        const int outWidth = output.width();
+        std::vector<int> sums (outWidth * 3);
+        for (int outRow = outRowBegin; outRow < outRowEnd; ++outRow)
+        {
+            std::fill (sums.begin(), sums.end(), 0);
+            const int rowBegin = outRow * factor;
+            const int rowEnd = std::min (height, rowBegin + factor);
+            for (int r = rowBegin; r < rowEnd; ++r)
+            {
+                const uint8_t* srcPtr = src + size_t(srcBytesPerRow) * r;
+                int* sumPtr = sums.data();
+                for (int c = 0; c < width; c += factor, sumPtr += 3)
+                {
+                    const int blockEnd = std::min (width, c + factor);
+                    for (int cc = c; cc < blockEnd; ++cc)
+                        unpackPixel (srcPtr + cc*bytesPerPixel, sumPtr);
+                }
+            }
+
+            PixelSRGBA* dstPtr = output.atRowPtr(outRow);
+            const int numRows = rowEnd - rowBegin;
+            for (int outCol = 0; outCol < outWidth; ++outCol)
+            {
+                const int numPixels = numRows * (std::min (width, (outCol + 1) * factor) - outCol * factor);
+                const int* sumPtr = sums.data() + outCol*3;
+                dstPtr[outCol] = PixelSRGBA((sumPtr[0] + numPixels/2) / numPixels,
+                                            (sumPtr[1] + numPixels/2) / numPixels,
+                                            (sumPtr[2] + numPixels/2) / numPixels,
+                                            255);
+            }
+        }
+    }
+
+} // anonymous
+
+bool PackedPixelFormat::isBGRX () const
+{
+    return bitsPerPixel == 32
+        && redMask == 0xff0000
+        && greenMask == 0xff00
+        && blueMask == 0xff
+        && !msbFirst;
+}
+
+bool cpuSupportsPixelConversionPath (PixelConversionPath path)
+{
+    switch (path)
+    {
+        case PixelConversionPath::Auto:
+        case PixelConversionPath::Scalar:
+            return true;
+#if DL_HAS_X86_SIMD
+        case PixelConversionPath::SSSE3: return cpuFeatures().ssse3;
+        case PixelConversionPath::AVX2: return cpuFeatures().avx2;
+#endif
+        default:
+            return false;
+    }
+}
+
+void convertPackedPixelsToSRGBA (const uint8_t* src, int srcBytesPerRow,
+                                 int width, int height,
+                                 const PackedPixelFormat& format,
+                                 ImageSRGBA& output,
+                                 PixelConversionPath path)
+{
+    output.ensureAllocatedBufferForSize (width, height);
+
+    // Memory bandwidth bound, no need for more than a few threads and
+    // not worth spawning them for small areas.
+    const int minRowsPerChunk = std::max (1, (1 << 18) / std::max (1, width));
+
+    if (format.isBGRX())
+    {
+        if (path == PixelConversionPath::Auto)
+        {
+            path = PixelConversionPath::Scalar;
+            if (cpuSupportsPixelConversionPath (PixelConversionPath::SSSE3))
+                path = PixelConversionPath::SSSE3;
+            if (cpuSupportsPixelConversionPath (PixelConversionPath::AVX2))
+                path = PixelConversionPath::AVX2;
+        }
+
+        if (!cpuSupportsPixelConversionPath (path))
+            path = PixelConversionPath::Scalar;
+
+        auto convertRows = convertBGRXRows_Scalar;
+#if DL_HAS_X86_SIMD
+        if (path == PixelConversionPath::SSSE3)
+            convertRows = convertBGRXRows_SSSE3;
+        else if (path == PixelConversionPath::AVX2)
+            convertRows = convertBGRXRows_AVX2;
+#endif
+
+        parallelFor (0, height, [&](int rowBegin, int rowEnd) {
+            convertRows (src, srcBytesPerRow, width, rowBegin, rowEnd, output);
+        }, minRowsPerChunk);
+        return;
+    }
+
+    if (format.bitsPerPixel != 16 && format.bitsPerPixel != 24 && format.bitsPerPixel != 32)
+    {
+        dl_assert (false, "Unsupported pixel format with %d bits per pixel.", format.bitsPerPixel);
+        output.fill (PixelSRGBA(0,0,0,255));
+        return;
+    }
+
+    ChannelUnpacker red, green, blue;
+    red.initialize (format.redMask);
+    green.initialize (format.greenMask);
+    blue.initialize (format.blueMask);
+
+    parallelFor (0, height, [&](int rowBegin, int rowEnd) {
+        convertGenericRows (src, srcBytesPerRow, width, rowBegin, rowEnd, format, red, green, blue, output);
+    }, minRowsPerChunk);
+}
+
+void convertPackedPixelsToSRGBADownsampled (const uint8_t* src, int srcBytesPerRow,
+                                            int width, int height,
+                                            const PackedPixelFormat& format,
+                                            int factor,
+                                            ImageSRGBA& output)
+{
+    if (factor <= 1)
+    {
+        convertPackedPixelsToSRGBA (src, srcBytesPerRow, width, height, format, output);
+        return;
+    }
+
+    const int outWidth = (width + factor - 1) / factor;
+    const int outHeight = (height + factor - 1) / factor;
+    output.ensureAllocatedBufferForSize (outWidth, outHeight);
+
+    // Each chunk reads factor times more rows than it writes.
+    const int minRowsPerChunk = std::max (1, (1 << 18) / std::max (1, width * factor));
+
+    if (format.isBGRX())
+    {
+        auto unpackBGRX = [](const uint8_t* p, int* rgb) {
+            rgb[0] += p[2];
+            rgb[1] += p[1];
+            rgb[2] += p[0];
+        };
+
+        parallelFor (0, outHeight, [&](int rowBegin, int rowEnd) {
+            convertAndDownsampleRows (src, srcBytesPerRow, width, height, 4, factor, rowBegin, rowEnd, unpackBGRX, output);
+        }, minRowsPerChunk);
+        return;
+    }
+
+    if (format.bitsPerPixel != 16 && format.bitsPerPixel != 24 && format.bitsPerPixel != 32)
+    {
+        dl_assert (false, "Unsupported pixel format with %d bits per pixel.", format.bitsPerPixel);
+        output.fill (PixelSRGBA(0,0,0,255));
+        return;
+    }
+
+    ChannelUnpacker red, green, blue;
+    red.initialize (format.redMask);
+    green.initialize (format.greenMask);
+    blue.initialize (format.blueMask);
+
+    const int bytesPerPixel = format.bitsPerPixel / 8;
+    auto unpackGeneric = [&](const uint8_t* p, int* rgb) {
+        uint32_t pixel = 0;
+        if (format.msbFirst)
+        {
+            for (int i = 0; i < bytesPerPixel; ++i)
+                pixel = (pixel << 8) | p[i];
+        }
+        else
+        {
+            for (int i = bytesPerPixel-1; i >= 0; --i)
+                pixel = (pixel << 8) | p[i];
+        }
+        rgb[0] += red.unpack (pixel);
+        rgb[1] += green.unpack (pixel);
+        rgb[2] += blue.unpack (pixel);
+    };
+
+    parallelFor (0, outHeight, [&](int rowBegin, int rowEnd) {
+        convertAndDownsampleRows (src, srcBytesPerRow, width, height, bytesPerPixel, factor, rowBegin, rowEnd, unpackGeneric, output);
+    }, minRowsPerChunk);
+}
+
+} // dl
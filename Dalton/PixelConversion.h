@@ -0,0 +1,58 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#pragma once
+
+#include <Dalton/Image.h>
+
+#include <cstdint>
+
+namespace dl
+{
+
+    // Layout of packed pixels as found in X11 images.
+    // Masks are relative to the pixel value read in the given byte order.
+    struct PackedPixelFormat
+    {
+        int bitsPerPixel = 32; // 16, 24 or 32
+        uint32_t redMask = 0xff0000;
+        uint32_t greenMask = 0xff00;
+        uint32_t blueMask = 0xff;
+        bool msbFirst = false;
+
+        bool isBGRX () const;
+    };
+
+    enum class PixelConversionPath
+    {
+        Auto, // best supported by the CPU
+        Scalar,
+        SSSE3,
+        AVX2,
+    };
+
+    bool cpuSupportsPixelConversionPath (PixelConversionPath path);
+
+    // Output has alpha set to 255. Rows are processed in parallel.
+    // The common BGRX layout goes through a SIMD shuffle, any other
+    // layout derives the shifts and scaling from the masks.
+    void convertPackedPixelsToSRGBA (const uint8_t* src, int srcBytesPerRow,
+                                     int width, int height,
+                                     const PackedPixelFormat& format,
+                                     ImageSRGBA& output,
+                                     PixelConversionPath path = PixelConversionPath::Auto);
+
+    // Same, but each factor x factor block gets averaged into a single output
+    // pixel (box filter) in the same pass, e.g. for a quick preview of a large
+    // capture. The output size gets rounded up, the blocks on the right and
+    // bottom borders can be partial.
+    void convertPackedPixelsToSRGBADownsampled (const uint8_t* src, int srcBytesPerRow,
+                                                int width, int height,
+                                                const PackedPixelFormat& format,
+                                                int factor,
+                                                ImageSRGBA& output);
+
+} // dl
@@ -0,0 +1,67 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <utility>
+
+namespace dl
+{
+
+// Lock-free bounded queue for exactly one producer thread and one consumer
+// thread. Elements are moved in and out, so it works well to pass around
+// ownership of large pre-allocated buffers.
+template <class T, int Capacity>
+class SPSCQueue
+{
+public:
+    // Producer only. Returns false if the queue is full, v is then left untouched.
+    bool tryPush (T&& v)
+    {
+        const int tail = _tail.load (std::memory_order_relaxed);
+        const int nextTail = increment (tail);
+        if (nextTail == _head.load (std::memory_order_acquire))
+            return false;
+
+        _slots[tail] = std::move (v);
+        _tail.store (nextTail, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only. Returns false if the queue is empty.
+    bool tryPop (T& v)
+    {
+        const int head = _head.load (std::memory_order_relaxed);
+        if (head == _tail.load (std::memory_order_acquire))
+            return false;
+
+        v = std::move (_slots[head]);
+        _head.store (increment (head), std::memory_order_release);
+        return true;
+    }
+
+    // Only a hint when called from the other thread.
+    bool empty () const
+    {
+        return _head.load (std::memory_order_acquire) == _tail.load (std::memory_order_acquire);
+    }
+
+private:
+    static int increment (int idx) { return (idx + 1) % NumSlots; }
+
+private:
+    // One slot always stays empty to distinguish full from empty.
+    static constexpr int NumSlots = Capacity + 1;
+    std::array<T, NumSlots> _slots;
+
+    // Separate cache lines to avoid false sharing between the two threads.
+    alignas(64) std::atomic<int> _head { 0 }; // written by the consumer
+    alignas(64) std::atomic<int> _tail { 0 }; // written by the producer
+};
+
+} // dl
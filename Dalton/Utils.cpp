@@ -12,6 +12,8 @@
 #include <chrono>
 #include <cstdarg>
 #include <thread>
+#include <vector>
+#include <algorithm>
 
 #if PLATFORM_UNIX
 // getpid
@@ -116,6 +118,26 @@ namespace dl
         _lastCallTs = nowTs;
     }
 
+    double refineRefreshPeriod (double period, double nominalPeriod,
+                                double prevVblankTime, int64_t prevVblankCount,
+                                double vblankTime, int64_t vblankCount)
+    {
+        if (vblankCount <= prevVblankCount || vblankTime <= prevVblankTime)
+            return period;
+
+        const double measuredPeriod = (vblankTime - prevVblankTime) / (vblankCount - prevVblankCount);
+        if (std::abs (measuredPeriod - nominalPeriod) >= 0.1 * nominalPeriod)
+            return period;
+
+        return 0.9 * period + 0.1 * measuredPeriod;
+    }
+
+    double nextVblankTime (double vblankTime, double period, double now)
+    {
+        const double numPeriodsToNextVblank = std::max (1.0, std::ceil ((now - vblankTime) / period));
+        return vblankTime + numPeriodsToNextVblank * period;
+    }
+
     std::string currentThreadId ()
     {
         std::ostringstream ss;
@@ -123,4 +145,33 @@ namespace dl
         return ss.str();
     }
 
+    void parallelFor (int begin, int end, const std::function<void(int,int)>& func, int minChunkSize)
+    {
+        const int numElements = end - begin;
+        if (numElements <= 0)
+            return;
+
+        const int maxThreads = std::max (1, int(std::thread::hardware_concurrency()));
+        const int numChunks = std::max (1, std::min (maxThreads, numElements / std::max (1, minChunkSize)));
+        if (numChunks == 1)
+        {
+            func (begin, end);
+            return;
+        }
+
+        std::vector<std::thread> threads;
+        threads.reserve (numChunks - 1);
+        const int chunkSize = (numElements + numChunks - 1) / numChunks;
+        for (int chunkBegin = begin + chunkSize; chunkBegin < end; chunkBegin += chunkSize)
+        {
+            const int chunkEnd = std::min (chunkBegin + chunkSize, end);
+            threads.emplace_back ([&func, chunkBegin, chunkEnd]() { func (chunkBegin, chunkEnd); });
+        }
+
+        func (begin, std::min (begin + chunkSize, end));
+
+        for (auto& t : threads)
+            t.join ();
+    }
+
 } // dl
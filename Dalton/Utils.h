@@ -7,8 +7,10 @@
 #pragma once
 
 #include <cstdio>
+#include <cstdint>
 #include <string>
 #include <cmath>
+#include <functional>
 
 #define DL_MULTI_STATEMENT_MACRO(X) do { X } while(0)
 
@@ -68,6 +70,22 @@ namespace dl
         double _lastCallTs = NAN;
     };
 
+    // Display refresh timing, see DisplayLinkTimer. The times are in seconds
+    // and the vblank counts are the frame counters of the display.
+    // The period only moves towards the one measured between the two vblanks
+    // if it is within 10% of the nominal one, the rest is considered an
+    // outlier (e.g. the window moved to another monitor).
+    double refineRefreshPeriod (double period, double nominalPeriod,
+                                double prevVblankTime, int64_t prevVblankCount,
+                                double vblankTime, int64_t vblankCount);
+    // First vblank after now, and at least one period after vblankTime.
+    double nextVblankTime (double vblankTime, double period, double now);
+
     std::string currentThreadId ();
 
+    // Splits [begin,end) into contiguous chunks of at least minChunkSize
+    // elements and calls func(chunkBegin, chunkEnd) on each of them from
+    // a few short-lived threads. The caller thread takes the first chunk.
+    void parallelFor (int begin, int end, const std::function<void(int,int)>& func, int minChunkSize = 1);
+
 } // dl
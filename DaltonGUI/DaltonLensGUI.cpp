@@ -7,12 +7,14 @@
 #include "DaltonLensGUI.h"
 
 #include <DaltonGUI/ImageViewer.h>
+#include <DaltonGUI/ImageViewerWindow.h>
 #include <DaltonGUI/GrabScreenAreaWindow.h>
 #include <DaltonGUI/HelpWindow.h>
 #include <DaltonGUI/PlatformSpecific.h>
 #include <DaltonGUI/DaltonLensPrefs.h>
 
 #include <Dalton/Utils.h>
+#include <Dalton/OpenGL.h>
 
 #define IMGUI_DEFINE_MATH_OPERATORS 1
 #include "imgui.h"
@@ -314,6 +316,13 @@ DaltonLensGUI::~DaltonLensGUI()
         // ImGui_ImplGlfw_Shutdown();
         // ImGui::DestroyContext();
         
+        // The pooled textures belong to the shared objects of the main context.
+        glfwMakeContextCurrent (impl->mainContextWindow);
+        GLTexturePool::shared().clear ();
+        GLTexturePool::shared().setBudgetInBytes (0);
+
+        GLStateCache::forgetContext (impl->mainContextWindow);
+        GLGpuTimers::forgetContext (impl->mainContextWindow);
         glfwDestroyWindow(impl->mainContextWindow);
         glfwTerminate();
     }
@@ -365,6 +374,13 @@ bool DaltonLensGUI::initialize ()
         return false;
     }
     
+    // Skips the shader compilation on the next launches.
+    GLShader::setProgramCacheDirectory (getUserCacheDirectory ("shaders"));
+
+    // All the windows share the objects of mainContextWindow, so the
+    // textures of a closed viewer can be reused by the next one.
+    GLTexturePool::shared().setBudgetInBytes (256 * 1024 * 1024);
+
     glfwSwapInterval(1); // no vsync on that dummy window to avoid delaying other windows.
     
     glfwSetWindowPos(impl->mainContextWindow, 0, 0);    
@@ -382,6 +398,14 @@ bool DaltonLensGUI::initialize ()
         // So we now just set a flag and make sure that we'll process
         // it at the end of runOnce.
         impl->gotToggleGrabScreenEvent = true;
+
+        // The capture itself runs in the background and does not need the
+        // GL context, so it can start right away instead of waiting for the
+        // state machine. startGrabbing will pick it up.
+        if (impl->currentState != Impl::State::GrabScreen)
+        {
+            impl->grabScreenWindow.startPreCapture (dl::currentDateInSeconds());
+        }
     });
 
     if (DaltonLensPrefs::showHelpOnStartup())
@@ -401,6 +425,54 @@ void DaltonLensGUI::runOnce ()
         impl->gotToggleGrabScreenEvent = false;
         toogleGrabScreenArea ();
     }
+
+    // The windows process the events in their frames, when idle nobody
+    // would and the X connection would stay readable forever.
+    if (!needsContinuousUpdates ())
+        glfwPollEvents ();
+}
+
+void DaltonLensGUI::processInputEvents ()
+{
+    impl->keyboardMonitor.runOnce ();
+    // The callbacks of the windows set their ImGui context, so the events
+    // just get queued until their next frame.
+    glfwPollEvents ();
+}
+
+bool DaltonLensGUI::needsContinuousUpdates () const
+{
+    return impl->currentState != Impl::State::Disabled
+        || impl->nextState != impl->currentState
+        || impl->helpRequested
+        || impl->gotToggleGrabScreenEvent
+        || impl->imageViewer.isEnabled ()
+        || impl->helpWindow.isEnabled ();
+}
+
+GLFWwindow* DaltonLensGUI::presentingWindow ()
+{
+    GLFWwindow* candidates[] = {
+        impl->grabScreenWindow.isGrabbing () ? impl->grabScreenWindow.glfwWindow () : nullptr,
+        impl->helpWindow.isEnabled () ? impl->helpWindow.glfwWindow () : nullptr,
+        impl->imageViewer.isEnabled () && impl->imageViewer.activeViewerWindow () ? impl->imageViewer.activeViewerWindow ()->glfwWindow () : nullptr,
+    };
+
+    for (GLFWwindow* window : candidates)
+    {
+        if (window && glfwGetWindowAttrib (window, GLFW_VISIBLE))
+            return window;
+    }
+    return nullptr;
+}
+
+void DaltonLensGUI::getEventFileDescriptors (std::vector<int>& fds) const
+{
+    for (const int fd : { getWindowSystemFileDescriptor (), impl->keyboardMonitor.eventFileDescriptor () })
+    {
+        if (fd >= 0)
+            fds.push_back (fd);
+    }
 }
 
 void DaltonLensGUI::notifySpaceChanged()
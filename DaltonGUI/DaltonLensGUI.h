@@ -8,6 +8,9 @@
 
 #include <memory>
 #include <functional>
+#include <vector>
+
+struct GLFWwindow;
 
 namespace dl
 {
@@ -24,6 +27,24 @@ public:
     bool initialize ();
     
     void runOnce ();
+
+    // True while a window is visible or a state change is pending, runOnce
+    // should then be called at the display rate. Otherwise it only needs
+    // to be called when one of the event file descriptors is readable.
+    bool needsContinuousUpdates () const;
+
+    // The visible window that gets rendered at the display rate, if any.
+    // The help window wins over the viewer, like for the key focus.
+    GLFWwindow* presentingWindow ();
+
+    // Only processes the hotkeys and the window system events, nothing gets
+    // rendered. For the wakeups between two display refreshes, the next
+    // runOnce will handle what they triggered.
+    void processInputEvents ();
+
+    // Linux only, empty elsewhere. X connections of the windows and of the
+    // hotkeys, to wait for them with poll.
+    void getEventFileDescriptors (std::vector<int>& fds) const;
     
     void helpRequested ();
     
@@ -22,6 +22,7 @@ struct DaltonLensPrefs::Impl
     struct {
         bool _showHelpOnStartup;
         int _deficiencyKind;
+        bool _captureAllMonitors;
     } cache;
 };
 
@@ -32,6 +33,8 @@ DaltonLensPrefs::DaltonLensPrefs()
     
     // Deuteranopia is the most common one, make it the default.
     impl->cache._deficiencyKind = impl->prefs.getInt("deficiencyKind", 1);
+
+    impl->cache._captureAllMonitors = impl->prefs.getBool("captureAllMonitors", false);
 }
 
 DaltonLensPrefs::~DaltonLensPrefs() = default;
@@ -72,4 +75,19 @@ void DaltonLensPrefs::setDaltonizeDeficiencyKind (int kind)
     instance()->impl->prefs.sync();
 }
 
+bool DaltonLensPrefs::captureAllMonitors ()
+{
+    return instance()->impl->cache._captureAllMonitors;
+}
+
+void DaltonLensPrefs::setCaptureAllMonitors (bool enabled)
+{
+    if (instance()->impl->cache._captureAllMonitors == enabled)
+        return;
+
+    instance()->impl->cache._captureAllMonitors = enabled;
+    instance()->impl->prefs.setBool("captureAllMonitors", enabled);
+    instance()->impl->prefs.sync();
+}
+
 } // dl
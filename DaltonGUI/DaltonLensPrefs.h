@@ -24,6 +24,10 @@ public:
 
     static int daltonizeDeficiencyKind ();
     static void setDaltonizeDeficiencyKind (int kind);
+
+    // Grab all the monitors instead of just the one under the cursor.
+    static bool captureAllMonitors ();
+    static void setCaptureAllMonitors (bool enabled);
     
 private:
     static DaltonLensPrefs* instance();
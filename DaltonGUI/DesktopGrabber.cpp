@@ -0,0 +1,137 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#include "DesktopGrabber.h"
+
+#include <DaltonGUI/PlatformSpecific.h>
+
+#include <Dalton/Utils.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+namespace dl
+{
+
+namespace
+{
+
+    // Nearest neighbor, only needed when the monitors have different retina scales.
+    void copyScaled (const ImageSRGBA& src, int dstX, int dstY, int dstWidth, int dstHeight, ImageSRGBA& dst)
+    {
+        const bool sameSize = src.width() == dstWidth && src.height() == dstHeight;
+        const int firstRow = std::max (0, dstY);
+        const int endRow = std::min (dst.height(), dstY + dstHeight);
+        const int firstCol = std::max (0, dstX);
+        const int endCol = std::min (dst.width(), dstX + dstWidth);
+        for (int r = firstRow; r < endRow; ++r)
+        {
+            const int srcRow = sameSize ? r - dstY : ((r - dstY) * src.height()) / dstHeight;
+            const PixelSRGBA* srcPtr = src.atRowPtr (srcRow);
+            PixelSRGBA* dstPtr = dst.atRowPtr (r);
+            if (sameSize)
+            {
+                memcpy (dstPtr + firstCol, srcPtr + (firstCol - dstX), (endCol - firstCol) * sizeof(PixelSRGBA));
+                continue;
+            }
+
+            for (int c = firstCol; c < endCol; ++c)
+                dstPtr[c] = srcPtr[((c - dstX) * src.width()) / dstWidth];
+        }
+    }
+
+} // anonymous
+
+struct DesktopGrabber::Impl
+{
+    struct Area
+    {
+        ScreenGrabber grabber;
+        ImageSRGBA image;
+    };
+
+    // Kept across grabs so the connections and SHM segments get reused.
+    std::vector<std::unique_ptr<Area>> areas;
+};
+
+DesktopGrabber::DesktopGrabber ()
+: impl (new Impl())
+{
+
+}
+
+DesktopGrabber::~DesktopGrabber ()
+{
+
+}
+
+dl::Rect DesktopGrabber::boundingRect (const std::vector<dl::Rect>& screenRects)
+{
+    if (screenRects.empty())
+        return dl::Rect::from_x_y_w_h (0, 0, 0, 0);
+
+    double x0 = INFINITY, y0 = INFINITY, x1 = -INFINITY, y1 = -INFINITY;
+    for (const auto& r : screenRects)
+    {
+        x0 = std::min (x0, r.origin.x);
+        y0 = std::min (y0, r.origin.y);
+        x1 = std::max (x1, r.origin.x + r.size.x);
+        y1 = std::max (y1, r.origin.y + r.size.y);
+    }
+    return dl::Rect::from_x_y_w_h (x0, y0, x1 - x0, y1 - y0);
+}
+
+bool DesktopGrabber::grabScreenAreas (const std::vector<dl::Rect>& screenRects,
+                                      dl::ImageSRGBA& desktopImage,
+                                      dl::Rect& desktopScreenRect)
+{
+    if (screenRects.empty())
+        return false;
+
+    while (impl->areas.size() < screenRects.size())
+        impl->areas.push_back (std::make_unique<Impl::Area>());
+
+    // One task per area, they mostly wait on the display server.
+    std::atomic<bool> allSucceeded { true };
+    parallelFor (0, int(screenRects.size()), [&](int begin, int end) {
+        for (int i = begin; i < end; ++i)
+        {
+            if (!impl->areas[i]->grabber.grabScreenArea (screenRects[i], impl->areas[i]->image))
+                allSucceeded = false;
+        }
+    });
+
+    if (!allSucceeded)
+        return false;
+
+    desktopScreenRect = boundingRect (screenRects);
+    const double scale = impl->areas[0]->image.width() / screenRects[0].size.x;
+    desktopImage.ensureAllocatedBufferForSize (int(std::round(desktopScreenRect.size.x * scale)),
+                                               int(std::round(desktopScreenRect.size.y * scale)));
+
+    // Monitors don't have to form a rectangle.
+    if (screenRects.size() > 1)
+        desktopImage.fill (PixelSRGBA(0, 0, 0, 255));
+
+    parallelFor (0, int(screenRects.size()), [&](int begin, int end) {
+        for (int i = begin; i < end; ++i)
+        {
+            const dl::Rect& r = screenRects[i];
+            copyScaled (impl->areas[i]->image,
+                        int(std::round((r.origin.x - desktopScreenRect.origin.x) * scale)),
+                        int(std::round((r.origin.y - desktopScreenRect.origin.y) * scale)),
+                        int(std::round(r.size.x * scale)),
+                        int(std::round(r.size.y * scale)),
+                        desktopImage);
+        }
+    });
+
+    return true;
+}
+
+} // dl
@@ -0,0 +1,42 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#pragma once
+
+#include <Dalton/Image.h>
+#include <Dalton/MathUtils.h>
+
+#include <memory>
+#include <vector>
+
+namespace dl
+{
+
+// Grabs several screen areas in parallel, typically one per monitor, and
+// stitches them into a single image covering their bounding box. Each area
+// gets its own ScreenGrabber, so on Linux each one has its own X connection
+// and SHM segment. Pixels not covered by any area are black.
+class DesktopGrabber
+{
+public:
+    DesktopGrabber ();
+    ~DesktopGrabber ();
+
+    // The output image can be larger than the bounding box on retina displays,
+    // the scale is given by the first area.
+    bool grabScreenAreas (const std::vector<dl::Rect>& screenRects,
+                          dl::ImageSRGBA& desktopImage,
+                          dl::Rect& desktopScreenRect);
+
+    static dl::Rect boundingRect (const std::vector<dl::Rect>& screenRects);
+
+private:
+    struct Impl;
+    friend struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+} // dl
@@ -8,7 +8,10 @@
 
 #include "PlatformSpecific.h"
 
+#include <DaltonGUI/ScreenCaptureThread.h>
+
 #include <DaltonGUI/ImageCursorOverlay.h>
+#include <DaltonGUI/DaltonLensPrefs.h>
 
 #include <Dalton/Utils.h>
 #include <Dalton/ColorConversion.h>
@@ -25,6 +28,44 @@
 namespace  dl
 {
 
+namespace
+{
+
+    // The overlay does not need more than that, and the conversion of
+    // 4K or 5K monitors gets 4 to 16 times faster.
+    int previewDownsampleFactor (int fullResolutionWidth)
+    {
+        const int minPreviewWidth = 1920;
+        int factor = 1;
+        while (factor < 4 && fullResolutionWidth / (factor * 2) >= minPreviewWidth)
+            factor *= 2;
+        return factor;
+    }
+
+    bool sameRects (const std::vector<dl::Rect>& lhs, const std::vector<dl::Rect>& rhs)
+    {
+        if (lhs.size() != rhs.size())
+            return false;
+
+        for (size_t i = 0; i < lhs.size(); ++i)
+        {
+            if (lhs[i].origin.x != rhs[i].origin.x || lhs[i].origin.y != rhs[i].origin.y
+                || lhs[i].size.x != rhs[i].size.x || lhs[i].size.y != rhs[i].size.y)
+                return false;
+        }
+        return true;
+    }
+
+    bool containsRect (const dl::Rect& outer, const dl::Rect& inner)
+    {
+        return inner.origin.x >= outer.origin.x
+            && inner.origin.y >= outer.origin.y
+            && inner.origin.x + inner.size.x <= outer.origin.x + outer.size.x
+            && inner.origin.y + inner.size.y <= outer.origin.y + outer.size.y;
+    }
+
+} // anonymous
+
 struct RectSelection
 {
     bool isValid () const { return firstCornerRelativeToWorkArea.x != -10000000; }
@@ -68,25 +109,273 @@ struct GrabScreenAreaWindow::Impl
     ImVec2 monitorWorkAreaTopLeft = ImVec2(-1,-1);
     ImVec2 monitorTopLeft = ImVec2(-1,-1);
     
-    ScreenGrabber grabber;
+    // The grab happens in the background, the window only gets shown
+    // once the frame is ready, otherwise it could capture itself.
+    ScreenCaptureThread captureThread;
+    int64_t pendingGrabRequestId = -1;
+
+    // Single monitor grabs only get a downsampled preview until the
+    // selection is done, see finishGrabbing.
+    struct {
+        int64_t requestId = -1;
+        int downsampleFactor = 1;
+        int fullResolutionWidth = -1;
+        int fullResolutionHeight = -1;
+    } preview;
+
+    // The preview is only for display, the tooltip needs the full resolution
+    // pixels. They get converted on demand around the pointer.
+    struct {
+        int64_t requestId = -1;
+        // In full resolution image coordinates.
+        dl::Rect imageRect;
+        dl::ImageSRGBA image;
+        GLTexture texture;
+    } pointerArea;
+
+    // The selected area of a preview grab gets converted at full resolution
+    // once the selection is done. The window is already hidden then, and
+    // receiveGrabbedFrame completes the grab when the area arrives.
+    struct {
+        int64_t requestId = -1;
+        double deadline = NAN;
+    } finalArea;
+
+    // Started from the hotkey callback, before the state machine gets to
+    // startGrabbing, to save a few frames of latency.
+    struct {
+        int64_t requestId = -1;
+        double hotkeyTime = NAN;
+        std::vector<dl::Rect> screenRects;
+    } preCapture;
+
+    // When grabbing all the monitors the image can be too large for a single
+    // texture. Then only the monitor with the overlay gets uploaded.
+    dl::Rect textureScreenRect;
+    dl::ImageSRGBA textureTileImage;
+    bool textureIsTile = false;
+
+    // Reused across grabs so the texture storage does not get reallocated
+    // when the screen size did not change.
+    std::shared_ptr<GLTexture> overlayTexture;
     
+
     RectSelection currentSelectionInScreen;
 
     ImageCursorOverlay cursorOverlay;
 
+    // Only exists during a grab session, see completeGrabbing.
+    std::unique_ptr<FrontWindowFinder> frontWindowFinder;
+
     void finishGrabbing ();
+    void completeGrabbing ();
+    void receiveGrabbedFrame ();
+    void receiveFinalArea (ScreenCaptureThread::Frame& frame);
+    void receivePointerArea (ScreenCaptureThread::Frame& frame);
+    void updatePointerArea (const ImVec2& mousePosInImage, int roiSize);
+    void resetPointerArea ();
+    std::vector<dl::Rect> captureScreenRects () const;
+    int64_t requestCapture (const std::vector<dl::Rect>& screenRects);
+
+    dl::Rect workAreaScreenRect () const
+    {
+        return dl::Rect::from_x_y_w_h (monitorWorkAreaTopLeft.x, monitorWorkAreaTopLeft.y, monitorWorkAreaSize.x, monitorWorkAreaSize.y);
+    }
 };
 
+void GrabScreenAreaWindow::Impl::receiveGrabbedFrame ()
+{
+    ScreenCaptureThread::Frame frame;
+    while ((this->pendingGrabRequestId >= 0 || this->pointerArea.requestId >= 0 || this->finalArea.requestId >= 0)
+           && this->captureThread.tryPopFrame (frame))
+    {
+        if (frame.requestId == this->finalArea.requestId)
+        {
+            receiveFinalArea (frame);
+            return;
+        }
+
+        if (frame.requestId == this->pointerArea.requestId)
+        {
+            receivePointerArea (frame);
+            continue;
+        }
+
+        // Could be a leftover from a previous grab that got dismissed.
+        if (frame.requestId != this->pendingGrabRequestId)
+        {
+            this->captureThread.recycleFrame (frame);
+            continue;
+        }
+
+        this->pendingGrabRequestId = -1;
+        if (!frame.isValid)
+        {
+            dl_dbg ("Could not record the screen!");
+            this->captureThread.recycleFrame (frame);
+            this->grabbedData = {};
+            finishGrabbing ();
+            return;
+        }
+
+        // Keep the pooled buffer, the capture thread will allocate a new one if needed.
+        this->grabbedData.srgbaImage->swap (*frame.image);
+        this->grabbedData.capturedScreenRect = frame.screenRect;
+        this->grabbedData.timings.captureTime = frame.grabTime;
+        this->preview = {};
+        if (frame.downsampleFactor > 1)
+        {
+            this->preview.requestId = frame.requestId;
+            this->preview.downsampleFactor = frame.downsampleFactor;
+            this->preview.fullResolutionWidth = frame.fullResolutionWidth;
+            this->preview.fullResolutionHeight = frame.fullResolutionHeight;
+        }
+        this->captureThread.recycleFrame (frame);
+
+        // That's the only part that needs the UI thread.
+        const auto& image = *this->grabbedData.srgbaImage;
+        if (this->grabbedData.texture->textureId() == 0)
+            this->grabbedData.texture->initialize ();
+        const int maxTextureSize = glMaxTextureSize ();
+        this->textureIsTile = image.width() > maxTextureSize || image.height() > maxTextureSize;
+        if (this->textureIsTile)
+        {
+            const double scale = image.width() / this->grabbedData.capturedScreenRect.size.x;
+            this->textureScreenRect = workAreaScreenRect ();
+            dl::Rect tileImageRect = this->textureScreenRect;
+            tileImageRect.origin -= this->grabbedData.capturedScreenRect.origin;
+            tileImageRect *= scale;
+            this->textureTileImage = dl::crop (image, tileImageRect);
+            this->grabbedData.texture->upload (this->textureTileImage);
+        }
+        else
+        {
+            this->textureScreenRect = this->grabbedData.capturedScreenRect;
+            this->grabbedData.texture->upload (image);
+        }
+        this->grabbedData.timings.uploadTime = currentDateInSeconds ();
+    }
+}
+
+void GrabScreenAreaWindow::Impl::receiveFinalArea (ScreenCaptureThread::Frame& frame)
+{
+    if (frame.isValid)
+    {
+        this->grabbedData.srgbaImage->swap (*frame.image);
+    }
+    else
+    {
+        dl_dbg ("Could not get the full resolution area.");
+        this->grabbedData.isValid = false;
+    }
+    this->captureThread.recycleFrame (frame);
+    completeGrabbing ();
+}
+
+void GrabScreenAreaWindow::Impl::receivePointerArea (ScreenCaptureThread::Frame& frame)
+{
+    this->pointerArea.requestId = -1;
+    if (frame.isValid)
+    {
+        // Copy it, the pooled buffer must stay large enough for the screen.
+        this->pointerArea.image = *frame.image;
+        this->pointerArea.imageRect = dl::Rect::from_x_y_w_h (frame.screenRect.origin.x, frame.screenRect.origin.y,
+                                                              this->pointerArea.image.width(), this->pointerArea.image.height());
+        if (this->pointerArea.texture.textureId() == 0)
+            this->pointerArea.texture.initialize ();
+        this->pointerArea.texture.upload (this->pointerArea.image);
+    }
+    this->captureThread.recycleFrame (frame);
+}
+
+void GrabScreenAreaWindow::Impl::updatePointerArea (const ImVec2& mousePosInImage, int roiSize)
+{
+    if (this->preview.requestId < 0 || this->pointerArea.requestId >= 0)
+        return;
+
+    const auto fullImageRect = dl::Rect::from_x_y_w_h (0, 0, this->preview.fullResolutionWidth, this->preview.fullResolutionHeight);
+    const int x = int(mousePosInImage.x);
+    const int y = int(mousePosInImage.y);
+    const dl::Rect roiRect = dl::Rect::from_x_y_w_h (x - roiSize/2, y - roiSize/2, roiSize, roiSize).intersect (fullImageRect);
+    if (roiRect.area() <= 0 || containsRect (this->pointerArea.imageRect, roiRect))
+        return;
+
+    // Larger than the ROI so small pointer moves don't need a new conversion.
+    const int areaSize = roiSize * 8;
+    const dl::Rect areaRect = dl::Rect::from_x_y_w_h (x - areaSize/2, y - areaSize/2, areaSize, areaSize).intersect (fullImageRect);
+    this->pointerArea.requestId = this->captureThread.requestFullResolutionArea (this->preview.requestId, areaRect);
+}
+
+void GrabScreenAreaWindow::Impl::resetPointerArea ()
+{
+    this->pointerArea.requestId = -1;
+    this->pointerArea.imageRect = {};
+    this->pointerArea.image = {};
+}
+
+int64_t GrabScreenAreaWindow::Impl::requestCapture (const std::vector<dl::Rect>& screenRects)
+{
+    if (screenRects.size() != 1)
+        return this->captureThread.requestGrab (screenRects);
+
+    float contentScale = 1.f;
+#if __APPLE__
+    // Screen coordinates are in points, the grab is in pixels.
+    float yScale = 1.f;
+    glfwGetMonitorContentScale (this->currentMonitor, &contentScale, &yScale);
+#endif
+    const int factor = previewDownsampleFactor (int(screenRects[0].size.x * contentScale));
+    if (factor == 1)
+        return this->captureThread.requestGrab (screenRects[0]);
+    return this->captureThread.requestPreviewGrab (screenRects[0], factor);
+}
+
+std::vector<dl::Rect> GrabScreenAreaWindow::Impl::captureScreenRects () const
+{
+    const dl::Rect screenRect = workAreaScreenRect ();
+    if (!DaltonLensPrefs::captureAllMonitors ())
+        return { screenRect };
+
+    // Whole monitors, they all get stitched into a single image.
+    std::vector<dl::Rect> screenRects;
+    int numMonitors = 0;
+    GLFWmonitor** monitors = glfwGetMonitors(&numMonitors);
+    for (int i = 0; i < numMonitors; ++i)
+    {
+        int xpos, ypos;
+        glfwGetMonitorPos(monitors[i], &xpos, &ypos);
+        const GLFWvidmode* mode = glfwGetVideoMode(monitors[i]);
+        if (mode)
+            screenRects.push_back (dl::Rect::from_x_y_w_h (xpos, ypos, mode->width, mode->height));
+    }
+
+    if (screenRects.empty())
+        screenRects = { screenRect };
+    return screenRects;
+}
+
 void GrabScreenAreaWindow::Impl::finishGrabbing ()
 {
-    this->grabbingFinished = true;
-    this->grabbedData.isValid = this->currentSelectionInScreen.isValid();
+    if (this->finalArea.requestId >= 0)
+    {
+        // Dismissed while waiting for the full resolution area.
+        this->grabbedData.isValid = false;
+        completeGrabbing ();
+        return;
+    }
+
+    this->pendingGrabRequestId = -1;
+    this->grabbedData.isValid = this->currentSelectionInScreen.isValid()
+                                && this->grabbedData.srgbaImage
+                                && this->grabbedData.srgbaImage->hasData();
     if (this->grabbedData.isValid)
     {
         // Initially grabbedData has the entire screen. We're cropping it here.
         
         // Will be higher than 1 on retina displays.
-        this->grabbedData.screenToImageScale = this->grabbedData.srgbaImage->width() / this->grabbedData.capturedScreenRect.size.x;
+        const int fullResolutionWidth = this->preview.requestId >= 0 ? this->preview.fullResolutionWidth : this->grabbedData.srgbaImage->width();
+        const int fullResolutionHeight = this->preview.requestId >= 0 ? this->preview.fullResolutionHeight : this->grabbedData.srgbaImage->height();
+        this->grabbedData.screenToImageScale = fullResolutionWidth / this->grabbedData.capturedScreenRect.size.x;
         
         // Cropped screen area.
         dl::Rect croppedScreenRect = this->currentSelectionInScreen.asDL();
@@ -97,9 +386,20 @@ void GrabScreenAreaWindow::Impl::finishGrabbing ()
         
         this->grabbedData.capturedScreenRect = croppedScreenRect;
 
-        auto imageRect = dl::Rect::from_x_y_w_h (0, 0, this->grabbedData.srgbaImage->width(), this->grabbedData.srgbaImage->height());
+        auto imageRect = dl::Rect::from_x_y_w_h (0, 0, fullResolutionWidth, fullResolutionHeight);
 
-        if (imageRect.intersect (croppedImageRect).area() > 0)
+        if (imageRect.intersect (croppedImageRect).area() > 0 && this->preview.requestId >= 0)
+        {
+            // Only the selected area gets converted at full resolution. That's
+            // quick, and the overlay can't be grabbed again since it's on top.
+            this->finalArea.requestId = this->captureThread.requestFullResolutionArea (this->preview.requestId, croppedImageRect);
+            this->finalArea.deadline = currentDateInSeconds () + 1.0;
+            this->grabbedData.texture.reset(); // not valid anymore.
+            ImGui::SetMouseCursor(ImGuiMouseCursor_Arrow);
+            imguiGlfwWindow.setEnabled (false);
+            return;
+        }
+        else if (imageRect.intersect (croppedImageRect).area() > 0)
         {
             *this->grabbedData.srgbaImage = dl::crop (*this->grabbedData.srgbaImage, croppedImageRect);
             this->grabbedData.texture.reset(); // not valid anymore.
@@ -111,6 +411,17 @@ void GrabScreenAreaWindow::Impl::finishGrabbing ()
             this->grabbedData.isValid = false;
         }
     }
+    completeGrabbing ();
+}
+
+void GrabScreenAreaWindow::Impl::completeGrabbing ()
+{
+    this->grabbingFinished = true;
+    this->pendingGrabRequestId = -1;
+    this->finalArea = {};
+    this->preview = {};
+    this->frontWindowFinder.reset ();
+    resetPointerArea ();
     ImGui::SetMouseCursor(ImGuiMouseCursor_Arrow);
     imguiGlfwWindow.setEnabled (false);
 }
@@ -198,6 +509,26 @@ void GrabScreenAreaWindow::runOnce ()
     if (impl->grabbingFinished)
         return;
     
+    impl->receiveGrabbedFrame ();
+    if (impl->grabbingFinished)
+        return;
+
+    if (impl->frontWindowFinder)
+        impl->frontWindowFinder->update ();
+
+    // The window is already hidden, only waiting for the selected area.
+    if (impl->finalArea.requestId >= 0)
+    {
+        if (currentDateInSeconds () > impl->finalArea.deadline)
+        {
+            dl_dbg ("Timeout while waiting for the full resolution area.");
+            impl->finishGrabbing ();
+        }
+        return;
+    }
+    
+    const bool frameReceived = impl->pendingGrabRequestId < 0;
+
     const auto frameInfo = impl->imguiGlfwWindow.beginFrame ();
 
     auto& io = ImGui::GetIO();
@@ -221,7 +552,7 @@ void GrabScreenAreaWindow::runOnce ()
 
     if (ImGui::IsKeyPressed(GLFW_KEY_SPACE))
     {
-        dl::Rect frontWindowRect = dl::getFrontWindowGeometry(impl->imguiGlfwWindow.glfwWindow());
+        dl::Rect frontWindowRect = impl->frontWindowFinder ? impl->frontWindowFinder->frontWindowGeometry(impl->imguiGlfwWindow.glfwWindow()) : dl::Rect();
         if (frontWindowRect.size.x >= 0)
         {
             impl->currentSelectionInScreen.firstCornerRelativeToWorkArea = imPos(frontWindowRect);
@@ -285,16 +616,48 @@ void GrabScreenAreaWindow::runOnce ()
         
         const auto imageWidgetTopLeft = ImGui::GetCursorPos();
         const auto imageWidgetSize = impl->monitorWorkAreaSize;
-        ImGui::Image(reinterpret_cast<ImTextureID>(impl->grabbedData.texture->textureId()), imageWidgetSize);
-
-        CursorOverlayInfo overlayInfo;
-        overlayInfo.image = impl->grabbedData.srgbaImage.get();
-        overlayInfo.imageTexture = impl->grabbedData.texture.get();
-        overlayInfo.showHelp = true;
-        overlayInfo.imageWidgetSize = imageWidgetSize;
-        overlayInfo.imageWidgetTopLeft = imageWidgetTopLeft;
-        overlayInfo.mousePos = io.MousePos;
-        impl->cursorOverlay.showTooltip(overlayInfo);
+        if (frameReceived)
+        {
+            // The texture can cover more than the work area if all the monitors were grabbed.
+            const dl::Rect& textureRect = impl->textureScreenRect;
+            const ImVec2 uv0 ((impl->monitorWorkAreaTopLeft.x - textureRect.origin.x) / textureRect.size.x,
+                              (impl->monitorWorkAreaTopLeft.y - textureRect.origin.y) / textureRect.size.y);
+            const ImVec2 uv1 = uv0 + ImVec2(impl->monitorWorkAreaSize.x / textureRect.size.x,
+                                            impl->monitorWorkAreaSize.y / textureRect.size.y);
+            ImGui::Image(reinterpret_cast<ImTextureID>(impl->grabbedData.texture->textureId()), imageWidgetSize, uv0, uv1);
+
+            CursorOverlayInfo overlayInfo;
+            if (impl->preview.requestId >= 0)
+            {
+                // Same mapping as the overlay, but to the full resolution image.
+                const ImVec2 widgetPos = (io.MousePos + ImVec2(0.5f,0.5f)) - imageWidgetTopLeft;
+                const ImVec2 mousePosInTexture = (uv1 - uv0) * (widgetPos / imageWidgetSize) + uv0;
+                const ImVec2 fullImageSize (impl->preview.fullResolutionWidth, impl->preview.fullResolutionHeight);
+                impl->updatePointerArea (mousePosInTexture * fullImageSize, int(overlayInfo.roiWindowSize.x));
+
+                // Nothing until the pixels around the pointer are available.
+                overlayInfo.image = &impl->pointerArea.image;
+                overlayInfo.imageTexture = &impl->pointerArea.texture;
+                overlayInfo.fullImageSize = dl::vec2i (impl->preview.fullResolutionWidth, impl->preview.fullResolutionHeight);
+                if (impl->pointerArea.image.hasData())
+                {
+                    overlayInfo.imageOrigin = dl::vec2i (int(impl->pointerArea.imageRect.origin.x), int(impl->pointerArea.imageRect.origin.y));
+                    overlayInfo.textureRect = impl->pointerArea.imageRect;
+                }
+            }
+            else
+            {
+                overlayInfo.image = impl->textureIsTile ? &impl->textureTileImage : impl->grabbedData.srgbaImage.get();
+                overlayInfo.imageTexture = impl->grabbedData.texture.get();
+            }
+            overlayInfo.uvTopLeft = uv0;
+            overlayInfo.uvBottomRight = uv1;
+            overlayInfo.showHelp = true;
+            overlayInfo.imageWidgetSize = imageWidgetSize;
+            overlayInfo.imageWidgetTopLeft = imageWidgetTopLeft;
+            overlayInfo.mousePos = io.MousePos;
+            impl->cursorOverlay.showTooltip(overlayInfo);
+        }
 
         ImVec2 selectionFirstCornerInWindow = impl->currentSelectionInScreen.firstCornerRelativeToWorkArea - impl->monitorWorkAreaTopLeft;
         ImVec2 selectionSecondCornerInWindow = impl->currentSelectionInScreen.secondCornerRelativeToWorkArea - impl->monitorWorkAreaTopLeft;
@@ -328,12 +691,18 @@ void GrabScreenAreaWindow::runOnce ()
         impl->justGotEnabled = false;
         impl->numFramesRemainingBeforeShow = 2;
     }
-    else if (impl->numFramesRemainingBeforeShow > 0)
+    else if (impl->numFramesRemainingBeforeShow > 0 && frameReceived)
     {
         --impl->numFramesRemainingBeforeShow;
         if (impl->numFramesRemainingBeforeShow == 0)
         {
             impl->imguiGlfwWindow.setEnabled(true);
+            impl->grabbedData.timings.overlayShownTime = currentDateInSeconds ();
+            const auto& timings = impl->grabbedData.timings;
+            dl_dbg ("Grab latency: capture %.1fms, upload %.1fms, overlay %.1fms",
+                    (timings.captureTime - timings.requestTime) * 1e3,
+                    (timings.uploadTime - timings.requestTime) * 1e3,
+                    (timings.overlayShownTime - timings.requestTime) * 1e3);
         }
     }
 }
@@ -369,12 +738,24 @@ void GrabScreenAreaWindow::updateMonitorInfo()
     int numMonitors = 0;
     GLFWmonitor** monitors = glfwGetMonitors(&numMonitors);
     
+    int largestMonitorWidth = 0;
+    int largestMonitorHeight = 0;
     for (int i = 0; i < numMonitors; ++i)
     {
         int xpos, ypos, width, height;
         glfwGetMonitorWorkarea(monitors[i], &xpos, &ypos, &width, &height);
         dl_dbg ("Monitor %d (%x): %d %d %d %d", i, monitors[i], xpos, ypos, width, height);
+
+        const GLFWvidmode* mode = glfwGetVideoMode(monitors[i]);
+        if (mode && mode->width * mode->height > largestMonitorWidth * largestMonitorHeight)
+        {
+            largestMonitorWidth = mode->width;
+            largestMonitorHeight = mode->height;
+        }
     }
+
+    // Any grab will fit in there, so it won't get reallocated.
+    impl->captureThread.reserveForSize (largestMonitorWidth, largestMonitorHeight);
     
     dl_dbg("Primary monitor = %x", glfwGetPrimaryMonitor());
     dl_dbg("Selected monitor with the mouse cursor = %x", monitor);
@@ -396,25 +777,64 @@ bool GrabScreenAreaWindow::startGrabbing ()
     
     impl->currentSelectionInScreen = {};
     
-    dl::Rect screenRect;
-    screenRect.origin = dl::Point(impl->monitorWorkAreaTopLeft.x, impl->monitorWorkAreaTopLeft.y);
-    screenRect.size = dl::Point(impl->monitorWorkAreaSize.x, impl->monitorWorkAreaSize.y);
+    const dl::Rect screenRect = impl->workAreaScreenRect ();
     
     // Initially we grab the entire screen.
     impl->grabbedData = {};
     impl->grabbedData.srgbaImage = std::make_shared<dl::ImageSRGBA>();
-    impl->grabbedData.texture = std::make_shared<GLTexture>();
+    if (!impl->overlayTexture)
+        impl->overlayTexture = std::make_shared<GLTexture>();
+    impl->grabbedData.texture = impl->overlayTexture;
     impl->grabbedData.capturedScreenRect = screenRect;
-
-    bool ok = impl->grabber.grabScreenArea (screenRect, *impl->grabbedData.srgbaImage, *impl->grabbedData.texture);
-    if (!ok)
+    impl->textureTileImage = {};
+    impl->textureIsTile = false;
+    impl->preview = {};
+    impl->finalArea = {};
+    impl->frontWindowFinder = std::make_unique<FrontWindowFinder> ();
+    impl->resetPointerArea ();
+
+    // Might need to show a dialog, so that can't be done by the capture thread.
+    if (!checkScreenCapturePermission ())
     {
-        dl_dbg ("Could not record the screen!");
-        // Make it invalid.
         impl->grabbedData = {};
+        impl->preCapture = {};
+        return false;
+    }
+
+    const std::vector<dl::Rect> screenRects = impl->captureScreenRects ();
+
+    // The hotkey might already have started the capture of the same area.
+    const double now = currentDateInSeconds ();
+    const double maxPreCaptureAge = 0.5;
+    if (impl->preCapture.requestId >= 0
+        && now - impl->preCapture.hotkeyTime < maxPreCaptureAge
+        && sameRects (impl->preCapture.screenRects, screenRects))
+    {
+        impl->pendingGrabRequestId = impl->preCapture.requestId;
+        impl->grabbedData.timings.requestTime = impl->preCapture.hotkeyTime;
+    }
+    else
+    {
+        // Don't block the UI thread, the result gets uploaded in runOnce.
+        impl->captureThread.discardPendingFrames ();
+        impl->pendingGrabRequestId = impl->requestCapture (screenRects);
+        impl->grabbedData.timings.requestTime = now;
     }
+    impl->preCapture = {};
+    return true;
+}
+
+void GrabScreenAreaWindow::startPreCapture (double hotkeyTime)
+{
+    if (isGrabbing())
+        return;
 
-    return ok;
+    // The monitor under the pointer, like startGrabbing will do.
+    updateMonitorInfo ();
+    impl->captureThread.discardPendingFrames ();
+    impl->preCapture.screenRects = impl->captureScreenRects ();
+    impl->preCapture.requestId = impl->requestCapture (impl->preCapture.screenRects);
+    impl->preCapture.hotkeyTime = hotkeyTime;
 }
 
 bool GrabScreenAreaWindow::isGrabbing() const
@@ -422,6 +842,11 @@ bool GrabScreenAreaWindow::isGrabbing() const
     return !impl->grabbingFinished;
 }
 
+GLFWwindow* GrabScreenAreaWindow::glfwWindow ()
+{
+    return impl->imguiGlfwWindow.glfwWindow ();
+}
+
 void GrabScreenAreaWindow::dismiss ()
 {
     impl->finishGrabbing();
@@ -20,6 +20,20 @@
 namespace dl
 {
 
+// To measure the latency between the hotkey and the overlay.
+// All in seconds, NAN when not available.
+struct GrabScreenTimings
+{
+    // Hotkey press, or start of the grab if it did not come from the hotkey.
+    double requestTime = NAN;
+    // Screen grabbed by the capture thread.
+    double captureTime = NAN;
+    // Frame received and uploaded by the UI thread.
+    double uploadTime = NAN;
+    // Overlay window shown.
+    double overlayShownTime = NAN;
+};
+
 struct GrabScreenData
 {
     bool isValid = false;
@@ -29,6 +43,7 @@ struct GrabScreenData
     float screenToImageScale = 1.f;
     std::shared_ptr<dl::ImageSRGBA> srgbaImage;
     std::shared_ptr<GLTexture> texture;
+    GrabScreenTimings timings;
 };
 
 // Manages a single ImGui window.
@@ -44,11 +59,16 @@ public:
     void shutdown ();
     void runOnce ();
     bool startGrabbing ();
+    // Can be called as soon as the hotkey gets pressed, before startGrabbing,
+    // to capture the monitor under the pointer in the background. It does not
+    // touch the GL context, so it is safe to call from the event callbacks.
+    void startPreCapture (double hotkeyTime);
     void dismiss ();
     void forceFocusAfterSpaceChange();
     
     bool isGrabbing() const;
     bool grabbingFinished() const;
+    GLFWwindow* glfwWindow ();
     const GrabScreenData& grabbedData () const;
     
 private:
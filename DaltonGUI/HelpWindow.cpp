@@ -147,6 +147,11 @@ bool HelpWindow::isEnabled () const
     return impl->imguiGlfwWindow.isEnabled ();
 }
 
+GLFWwindow* HelpWindow::glfwWindow ()
+{
+    return impl->imguiGlfwWindow.glfwWindow ();
+}
+
 static void AddUnderLine( ImColor col_ )
 {
     ImVec2 min = ImGui::GetItemRectMin();
@@ -29,6 +29,7 @@ public:
     void shutdown ();
     void setEnabled (bool enabled);
     bool isEnabled () const;
+    GLFWwindow* glfwWindow ();
     
 private:
     struct Impl;
@@ -30,11 +30,6 @@
 namespace dl
 {
 
-void HighlightRegionState::updateFrameCount ()
-{
-    mutableData.shaderParams.frameCount = ImGui::GetFrameCount();
-}
-
 void HighlightRegionState::clearSelection()
 {
     mutableData.shaderParams.hasActiveColor = false;
@@ -42,7 +42,6 @@ public:
     void togglePlotMode();
     void updateDeltas();
     bool hasActiveColor() const { return mutableData.shaderParams.hasActiveColor; }
-    void updateFrameCount ();
     void handleInputEvents ();
 
 private:
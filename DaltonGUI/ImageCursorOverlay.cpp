@@ -40,6 +40,8 @@ void ImageCursorOverlay::showTooltip(const CursorOverlayInfo& d, bool showAsTool
     const float padding = monoFontSize / 2.f;
 
     ImVec2 imageSize (image.width(), image.height());
+    if (d.fullImageSize.x > 0)
+        imageSize = ImVec2 (d.fullImageSize.x, d.fullImageSize.y);
     
     ImVec2 mousePosInImage (0,0);
     ImVec2 mousePosInTexture (0,0);
@@ -53,7 +55,8 @@ void ImageCursorOverlay::showTooltip(const CursorOverlayInfo& d, bool showAsTool
         mousePosInImage = mousePosInTexture * imageSize;
     }
     
-    if (!image.contains(mousePosInImage.x, mousePosInImage.y))
+    const ImVec2 mousePosInAvailableImage = mousePosInImage - ImVec2(d.imageOrigin.x, d.imageOrigin.y);
+    if (!image.contains(mousePosInAvailableImage.x, mousePosInAvailableImage.y))
         return;
     
     {
@@ -68,7 +71,7 @@ void ImageCursorOverlay::showTooltip(const CursorOverlayInfo& d, bool showAsTool
             ImGui::BeginTooltip();
         }
         
-        const auto sRgb = image((int)mousePosInImage.x, (int)mousePosInImage.y);
+        const auto sRgb = image((int)mousePosInAvailableImage.x, (int)mousePosInAvailableImage.y);
         
         const int squareSize = 10*monoFontSize;
 
@@ -78,9 +81,16 @@ void ImageCursorOverlay::showTooltip(const CursorOverlayInfo& d, bool showAsTool
             const int zoomLenInPixels = int(d.roiWindowSize.x);
             ImVec2 pixelSizeInZoom = zoomItemSize / ImVec2(zoomLenInPixels,zoomLenInPixels);
             
-            const ImVec2 zoomLen_uv (float(zoomLenInPixels) / image.width(), float(zoomLenInPixels) / image.height());
+            const ImVec2 zoomLen_uv (float(zoomLenInPixels) / imageSize.x, float(zoomLenInPixels) / imageSize.y);
             ImVec2 zoom_uv0 = mousePosInTexture - zoomLen_uv*0.5f;
             ImVec2 zoom_uv1 = mousePosInTexture + zoomLen_uv*0.5f;
+            if (d.textureRect.area() > 0.)
+            {
+                const ImVec2 rectOrigin (d.textureRect.origin.x, d.textureRect.origin.y);
+                const ImVec2 rectSize (d.textureRect.size.x, d.textureRect.size.y);
+                zoom_uv0 = (zoom_uv0 * imageSize - rectOrigin) / rectSize;
+                zoom_uv1 = (zoom_uv1 * imageSize - rectOrigin) / rectSize;
+            }
             
             ImVec2 zoomImageTopLeft = ImGui::GetCursorScreenPos();
             ImGui::Image(reinterpret_cast<ImTextureID>(imageTexture.textureId()), zoomItemSize, zoom_uv0, zoom_uv1);
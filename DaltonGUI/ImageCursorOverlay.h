@@ -23,6 +23,16 @@ struct CursorOverlayInfo
     
     const dl::ImageSRGBA* image = nullptr;
     GLTexture* imageTexture = nullptr;
+
+    // The image can also be just an area of the full image, e.g. the filtered
+    // pixels around the cursor read back from the GPU. Its first pixel is then
+    // at imageOrigin, and fullImageSize must be set.
+    dl::vec2i imageOrigin = dl::vec2i(0, 0);
+    dl::vec2i fullImageSize = dl::vec2i(-1, -1);
+    // Area of the full image covered by imageTexture, in pixels. Empty if it
+    // covers the full image.
+    dl::Rect textureRect = dl::Rect::from_x_y_w_h (0, 0, 0, 0);
+
     bool showHelp = false;
     ImVec2 imageWidgetTopLeft;
     ImVec2 imageWidgetSize;
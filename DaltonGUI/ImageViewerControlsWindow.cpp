@@ -9,17 +9,20 @@
 #include <DaltonGUI/ImguiUtils.h>
 #include <DaltonGUI/ImguiGLFWWindow.h>
 #include <DaltonGUI/ImageViewerWindow.h>
+#include <DaltonGUI/GrabScreenAreaWindow.h>
 #include <DaltonGUI/ImageViewerWindowState.h>
 #include <DaltonGUI/GLFWUtils.h>
 #include <DaltonGUI/ImageCursorOverlay.h>
 #include <DaltonGUI/PlatformSpecific.h>
 
+#include <Dalton/OpenGL.h>
 #include <Dalton/Utils.h>
 
 #define IMGUI_DEFINE_MATH_OPERATORS 1
 #include "imgui.h"
 
 #include <cstdio>
+#include <cmath>
 
 namespace dl
 {
@@ -51,6 +54,41 @@ struct ImageViewerControlsWindow::Impl
     ImVec2 windowSizeAtCurrentDpi = ImVec2(-1,-1);
     
     ImageCursorOverlay cursorOverlay;
+
+    // Debug panel, toggled with the G key.
+    bool showGpuTimings = false;
+
+    void renderGpuTimings ()
+    {
+        ImGui::SetNextWindowBgAlpha (0.9f);
+        if (ImGui::Begin ("GPU timings", &showGpuTimings, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoFocusOnAppearing))
+        {
+            auto& io = ImGui::GetIO();
+            ImguiGLFWWindow::PushMonoSpaceFont(io, true /* small */);
+            if (!glHasTimerQueries ())
+                ImGui::Text ("Timer queries are not supported.");
+            
+            ImGui::Text ("%-28s %6s %6s %6s %5s", "Section (ms)", "min", "mean", "p95", "n");
+            for (const auto& stats : GLGpuTimers::stats())
+            {
+                ImGui::Text ("%-28.28s %6.2f %6.2f %6.2f %5d",
+                             stats.name.c_str(),
+                             stats.minMs,
+                             stats.meanMs,
+                             stats.p95Ms,
+                             stats.numSamples);
+            }
+            ImGui::PopFont();
+
+            if (ImGui::Button ("Reset"))
+                GLGpuTimers::resetStats ();
+        }
+        ImGui::End();
+
+        // Closed with the button.
+        if (!showGpuTimings)
+            GLGpuTimers::setEnabled (false);
+    }
 };
 
 ImageViewerControlsWindow::ImageViewerControlsWindow()
@@ -218,6 +256,10 @@ void ImageViewerControlsWindow::runOnce ()
             if (ImGui::MenuItem("Double size", ">", false)) activeImageWindow->processKeyEvent ('>');
             if (ImGui::MenuItem("Half size", "<", false)) activeImageWindow->processKeyEvent ('<');
             if (ImGui::MenuItem("Restore aspect ratio", "a", false)) activeImageWindow->processKeyEvent (GLFW_KEY_A);
+            if (ScreenGrabber::liveCaptureIsSupported())
+            {
+                if (ImGui::MenuItem("Live capture", "l", activeImageWindow->mutableState().liveCapture)) activeImageWindow->processKeyEvent (GLFW_KEY_L);
+            }
             ImGui::EndMenu();
         }
 
@@ -354,6 +396,8 @@ void ImageViewerControlsWindow::runOnce ()
                 3
             );
             ImGui::Checkbox("Only simulate color vision deficiency", &viewerState.daltonizeParams.simulateOnly);
+            if (!viewerState.daltonizeParams.simulateOnly)
+                ImGui::Checkbox("Simulate the corrected image", &viewerState.simulateDaltonizeCorrection);
             ImGui::SliderFloat("Severity", &viewerState.daltonizeParams.severity, 0.f, 1.f, "%.2f");
         }
 
@@ -382,12 +426,30 @@ void ImageViewerControlsWindow::runOnce ()
         if (ImGui::IsKeyPressed(GLFW_KEY_F))
         {
             ImGui::Text("%.1f FPS", io.Framerate);
+
+            const auto& timings = activeImageWindow->grabTimings();
+            if (!std::isnan(timings.overlayShownTime))
+            {
+                ImGui::Text("Hotkey to capture %.1fms, to overlay %.1fms",
+                            (timings.captureTime - timings.requestTime) * 1e3,
+                            (timings.overlayShownTime - timings.requestTime) * 1e3);
+            }
+        }
+
+        if (ImGui::IsKeyPressed(GLFW_KEY_G, false /* no repeat */))
+        {
+            impl->showGpuTimings = !impl->showGpuTimings;
+            GLGpuTimers::setEnabled (impl->showGpuTimings);
+            GLGpuTimers::resetStats ();
         }
 
         impl->inputState.shiftIsPressed = io.KeyShift;
     }
     ImGui::End();
 
+    if (impl->showGpuTimings)
+        impl->renderGpuTimings ();
+
     // ImGui::ShowDemoWindow();
     // ImGui::ShowUserGuide();
     
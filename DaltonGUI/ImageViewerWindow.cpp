@@ -13,6 +13,7 @@
 #include <DaltonGUI/ImageCursorOverlay.h>
 #include <DaltonGUI/ImguiUtils.h>
 #include <DaltonGUI/PlatformSpecific.h>
+#include <DaltonGUI/ScreenCaptureThread.h>
 #include <DaltonGUI/ImguiGLFWWindow.h>
 #include <DaltonGUI/HighlightSimilarColor.h>
 #include <DaltonGUI/ImageViewerControlsWindow.h>
@@ -29,6 +30,7 @@
 #include <Dalton/MathUtils.h>
 #include <Dalton/ColorConversion.h>
 #include <Dalton/Filters.h>
+#include <Dalton/ImagePyramid.h>
 
 // Note: need to include that before GLFW3 for some reason.
 #include <GL/gl3w.h>
@@ -93,8 +95,46 @@ struct ImageViewerWindow::Impl
     struct {
         bool requested = false;
         std::string outPath;
+
+        // The filtered tiles get read back one by one and assembled there.
+        ImageSRGBA image;
+        int numRequestedTiles = 0;
+        int numReceivedTiles = 0;
+        bool blendHighlightOverInput = false;
+        float highlightIntensity = 1.f;
+
+        void onTileReceived (const ImageSRGBA& tileIm, const dl::Rect& tileRect, int numTiles)
+        {
+            const int x = int(tileRect.origin.x);
+            const int y = int(tileRect.origin.y);
+            for (int r = 0; r < tileIm.height(); ++r)
+                memcpy (image.atRowPtr(y + r) + x, tileIm.atRowPtr(r), tileIm.width() * sizeof(PixelSRGBA));
+
+            if (++numReceivedTiles < numTiles)
+                return;
+
+            // Same as the blending done on screen. The unselected pixels keep their
+            // input color and the selected ones are at full intensity.
+            if (blendHighlightOverInput)
+            {
+                const float intensity = highlightIntensity;
+                image.apply ([intensity](int c, int r, PixelSRGBA& p) {
+                    if (p.a != 0)
+                    {
+                        p.r = uint8_t(p.r * intensity + 0.5f);
+                        p.g = uint8_t(p.g * intensity + 0.5f);
+                        p.b = uint8_t(p.b * intensity + 0.5f);
+                    }
+                    p.a = 255;
+                });
+            }
+            writePngImage (outPath, image);
+        }
     } saveToFile;
 
+    // Saving does not need to stall the rendering.
+    GLAsyncReadback readback;
+
     struct {
         bool inProgress = false;
         bool needToResize = false;
@@ -112,13 +152,38 @@ struct ImageViewerWindow::Impl
         Filter_FlipRedBlue flipRedBlue;
         Filter_FlipRedBlueAndInvertRed flipRedBlueAndInvertRed;
         Filter_HighlightSimilarColors highlightSimilarColors;
+        // Stacked after daltonize to check the correction.
+        Filter_Daltonize daltonizeSimulation;
     } filters;
     
-    GLFilterProcessor filterProcessor;
+    // One per tile of gpuTexture, each one only filters the visible part of its tile.
+    std::vector<std::unique_ptr<GLFilterGraph>> filterGraphs;
 
-    GLTexture gpuTexture;
+    // Filtered pixels around the pointer, so the cursor overlay can show the
+    // filtered colors without downloading the full image. They arrive a
+    // frame or two after the request.
+    struct {
+        GLAsyncReadback readback { 2 };
+        ImageSRGBA image;
+        // Area of the full image, in pixels.
+        dl::Rect imageRect = dl::Rect::from_x_y_w_h (0, 0, 0, 0);
+        // Of the filtered texture when they got requested.
+        uint64_t contentGeneration = 0;
+    } filteredPixels;
+
+    // Split in tiles when larger than GL_MAX_TEXTURE_SIZE, most of the
+    // time there is a single one.
+    GLTiledTexture gpuTexture;
     dl::ImageSRGBA im;
+    // Only computed when the image gets displayed smaller than its size.
+    ImagePyramid imPyramid;
     std::string imagePath;
+
+    // Area of the screen that the image comes from, for live capture.
+    dl::Rect capturedScreenRect;
+    GrabScreenTimings grabTimings;
+    ScreenCaptureThread liveCapture;
+    int64_t liveCaptureId = -1;
     
     ImVec2 monitorSize = ImVec2(-1,-1);
     
@@ -153,24 +218,119 @@ struct ImageViewerWindow::Impl
                                       imageWidgetRect.current.size.y + windowBorderSize * 2);
     }
 
-    GLFilter* filterForMode (DaltonViewerMode modeForCurrentFrame)
+    // The damaged areas are grabbed by the capture thread, we just
+    // need to copy and upload them.
+    void applyLiveFrames ()
+    {
+        ScreenCaptureThread::Frame frame;
+        while (liveCapture.tryPopFrame (frame))
+        {
+            if (frame.requestId == liveCaptureId && frame.isValid)
+            {
+                const ImageSRGBA& frameImage = *frame.image;
+                const bool sizeChanged = frameImage.width() != im.width() || frameImage.height() != im.height();
+                im.ensureAllocatedBufferForSize (frameImage.width(), frameImage.height());
+                for (const auto& r : frame.updatedRects)
+                {
+                    const int x = int(r.origin.x);
+                    const int y = int(r.origin.y);
+                    const int w = int(r.size.x);
+                    const int h = int(r.size.y);
+                    for (int row = y; row < y + h; ++row)
+                        memcpy (im.atRowPtr(row) + x, frameImage.atRowPtr(row) + x, w * sizeof(PixelSRGBA));
+                    if (!sizeChanged)
+                        gpuTexture.uploadSubRect (im, x, y, w, h);
+                }
+
+                if (sizeChanged)
+                    gpuTexture.upload (im);
+            }
+            liveCapture.recycleFrame (frame);
+        }
+    }
+
+    // filteredRegion is the area of the full image covered by filteredTexture.
+    void updateFilteredPixels (const GLTexture& filteredTexture, const dl::Rect& filteredRegion, const ImVec2& mousePosInImage, int roiSize)
+    {
+        filteredPixels.readback.processCompleted ();
+        
+        const dl::Point mousePixel (int(mousePosInImage.x), int(mousePosInImage.y));
+        const bool isUpToDate = (filteredPixels.contentGeneration == filteredTexture.contentGeneration()
+                                 && filteredPixels.imageRect.contains (mousePixel));
+        if (isUpToDate || filteredPixels.readback.numPending() > 0)
+            return;
+
+        // Larger than the ROI, so small pointer moves don't need a new readback.
+        const dl::Rect rectInImage = dl::Rect::from_x_y_w_h (mousePixel.x - roiSize,
+                                                             mousePixel.y - roiSize,
+                                                             2*roiSize + 1,
+                                                             2*roiSize + 1).intersect (filteredRegion);
+        dl::Rect rectInTexture = rectInImage;
+        rectInTexture.origin -= filteredRegion.origin;
+        const uint64_t contentGeneration = filteredTexture.contentGeneration();
+        filteredPixels.readback.requestTextureRect (filteredTexture, rectInTexture, [this, rectInImage, contentGeneration](ImageSRGBA&& im) {
+            filteredPixels.image = std::move (im);
+            filteredPixels.imageRect = rectInImage;
+            filteredPixels.contentGeneration = contentGeneration;
+        });
+    }
+
+    // Created on first use, the filter shaders get compiled lazily anyway.
+    GLFilterGraph& filterGraphForTile (int tileIndex)
+    {
+        while (int(filterGraphs.size()) <= tileIndex)
+        {
+            filterGraphs.push_back (std::make_unique<GLFilterGraph>());
+            filterGraphs.back()->initializeGL ();
+        }
+        return *filterGraphs[tileIndex];
+    }
+
+    // Called from the ImGui draw callbacks. A sampler object overrides the
+    // filtering of the textures, so their parameters don't need to change
+    // twice per frame.
+    void setLinearInterpolationEnabled (bool enabled)
+    {
+        if (glHasSamplerObjects ())
+        {
+            glBindSampler (0, enabled ? GLStateCache::current().linearSampler() : 0);
+            return;
+        }
+
+        // The ImGui backend changed the bindings and restores them after
+        // rendering, so the cache must not keep what it sees here.
+        GLStateCache::current().invalidate ();
+        gpuTexture.setLinearInterpolationEnabled (enabled);
+        for (auto& filterGraph : filterGraphs)
+            filterGraph->filteredTexture().setLinearInterpolationEnabled (enabled);
+        GLStateCache::current().invalidate ();
+    }
+
+    std::vector<GLFilter*> filtersForMode (DaltonViewerMode modeForCurrentFrame)
     {
         switch (modeForCurrentFrame)
         {
-            case DaltonViewerMode::Original:    return nullptr;
-            case DaltonViewerMode::HSVTransform: return &filters.hsvTransform;
-            case DaltonViewerMode::Daltonize:   return &filters.daltonize;
-            case DaltonViewerMode::FlipRedBlue: return &filters.flipRedBlue;
-            case DaltonViewerMode::FlipRedBlueInvertRed: return &filters.flipRedBlueAndInvertRed;
+            case DaltonViewerMode::Original:    return {};
+            case DaltonViewerMode::HSVTransform: return { &filters.hsvTransform };
+            case DaltonViewerMode::FlipRedBlue: return { &filters.flipRedBlue };
+            case DaltonViewerMode::FlipRedBlueInvertRed: return { &filters.flipRedBlueAndInvertRed };
+
+            case DaltonViewerMode::Daltonize:
+            {
+                const auto& params = mutableState.daltonizeParams;
+                if (mutableState.simulateDaltonizeCorrection && !params.simulateOnly)
+                    return { &filters.daltonize, &filters.daltonizeSimulation };
+                return { &filters.daltonize };
+            }
             
             case DaltonViewerMode::HighlightRegions: 
             {
                 if (mutableState.highlightRegion.hasActiveColor())
-                    return &filters.highlightSimilarColors;
-                return nullptr;
+                    return { &filters.highlightSimilarColors };
+                return {};
             }
 
-            default: return nullptr;
+            default: return {};
         }
     }
 };
@@ -191,6 +351,11 @@ bool ImageViewerWindow::isEnabled () const
     return impl->enabled;
 }
 
+GLFWwindow* ImageViewerWindow::glfwWindow ()
+{
+    return impl->imguiGlfwWindow.glfwWindow ();
+}
+
 void ImageViewerWindow::setEnabled (bool enabled)
 {
     if (impl->enabled == enabled)
@@ -205,6 +370,8 @@ void ImageViewerWindow::setEnabled (bool enabled)
     else
     {
         impl->mutableState.activeMode = DaltonViewerMode::None;
+        impl->mutableState.liveCapture = false;
+        impl->liveCapture.stopLiveCapture ();
         impl->imguiGlfwWindow.setEnabled(false);
     }
 }
@@ -240,16 +407,7 @@ bool ImageViewerWindow::initialize (GLFWwindow* parentWindow, ImageViewerControl
     // This leads to issues with the window going to the back after a workspace switch.
     // setWindowFlagsToAlwaysShowOnActiveDesktop(impl->imguiGlfwWindow.glfwWindow());
     
-    impl->filterProcessor.initializeGL();
-    impl->filters.daltonize.initializeGL();
-    impl->filters.hsvTransform.initializeGL();
-    impl->filters.flipRedBlue.initializeGL();
-    impl->filters.flipRedBlueAndInvertRed.initializeGL();
-    impl->filters.highlightSimilarColors.initializeGL();
-
     checkGLError ();
-
-    impl->gpuTexture.initialize();
     
     return true;
 }
@@ -296,7 +454,7 @@ void ImageViewerWindow::checkImguiGlobalImageKeyEvents ()
     // These key events are valid also in the control window.
     auto& io = ImGui::GetIO();
 
-    for (const auto code : {GLFW_KEY_UP, GLFW_KEY_DOWN, GLFW_KEY_LEFT, GLFW_KEY_RIGHT, GLFW_KEY_S, GLFW_KEY_W, GLFW_KEY_N, GLFW_KEY_A, GLFW_KEY_SPACE })
+    for (const auto code : {GLFW_KEY_UP, GLFW_KEY_DOWN, GLFW_KEY_LEFT, GLFW_KEY_RIGHT, GLFW_KEY_S, GLFW_KEY_W, GLFW_KEY_N, GLFW_KEY_A, GLFW_KEY_L, GLFW_KEY_SPACE })
     {
         if (ImGui::IsKeyPressed(code))
             processKeyEvent(code);
@@ -410,6 +568,14 @@ void ImageViewerWindow::processKeyEvent (int keycode)
             }
             break;
         }
+
+        case GLFW_KEY_L:
+        {
+            // Only makes sense for screen grabs.
+            if (impl->capturedScreenRect.origin.isValid() && ScreenGrabber::liveCaptureIsSupported())
+                impl->mutableState.liveCapture = !impl->mutableState.liveCapture;
+            break;
+        }
     }
 }
 
@@ -447,6 +613,11 @@ const CursorOverlayInfo& ImageViewerWindow::cursorOverlayInfo() const
     return impl->cursorOverlayInfo;
 }
 
+const GrabScreenTimings& ImageViewerWindow::grabTimings() const
+{
+    return impl->grabTimings;
+}
+
 void ImageViewerWindow::showGrabbedData (const GrabScreenData& grabbedData, dl::Rect& updatedWindowGeometry)
 {
     GLFWmonitor* monitor = glfwGetPrimaryMonitor();
@@ -456,11 +627,16 @@ void ImageViewerWindow::showGrabbedData (const GrabScreenData& grabbedData, dl::
     impl->im.ensureAllocatedBufferForSize(grabbedData.srgbaImage->width(), grabbedData.srgbaImage->height());
     impl->im.copyDataFrom(*grabbedData.srgbaImage);
     impl->imagePath = "DaltonLens";
+    impl->capturedScreenRect = grabbedData.capturedScreenRect;
+    impl->grabTimings = grabbedData.timings;
+    impl->mutableState.liveCapture = false;
+    impl->liveCapture.stopLiveCapture ();
 
     // dl::writePngImage("/tmp/debug.png", impl->im);
     
     impl->imguiGlfwWindow.enableContexts ();
     impl->gpuTexture.upload(impl->im);
+    impl->filteredPixels.imageRect = dl::Rect::from_x_y_w_h (0, 0, 0, 0);
     impl->imageWidgetRect.normal.origin = grabbedData.capturedScreenRect.origin;
     impl->imageWidgetRect.normal.size = grabbedData.capturedScreenRect.size;
     impl->imageWidgetRect.current = impl->imageWidgetRect.normal;
@@ -509,8 +685,6 @@ void ImageViewerWindow::runOnce ()
         impl->imageWidgetRect.current.size.y = frameInfo.windowContentHeight;
     }
 
-    impl->mutableState.highlightRegion.updateFrameCount ();
-   
     auto& io = ImGui::GetIO();    
     
     impl->mutableState.inputState.shiftIsPressed = io.KeyShift;
@@ -543,6 +717,26 @@ void ImageViewerWindow::runOnce ()
     
     dl::Rect platformWindowGeometry = impl->imguiGlfwWindow.geometry();
 
+    if (impl->mutableState.liveCapture != impl->liveCapture.isLiveCaptureActive())
+    {
+        impl->liveCapture.discardPendingFrames ();
+        if (impl->mutableState.liveCapture)
+        {
+            // Set before starting so that even the first full grab leaves our window out.
+            impl->liveCapture.setLiveCaptureExcludedRect (platformWindowGeometry);
+            impl->liveCaptureId = impl->liveCapture.startLiveCapture (impl->capturedScreenRect);
+        }
+        else
+            impl->liveCapture.stopLiveCapture ();
+    }
+
+    if (impl->liveCapture.isLiveCaptureActive ())
+    {
+        // Our own window is excluded, otherwise it would keep capturing its own rendering.
+        impl->liveCapture.setLiveCaptureExcludedRect (platformWindowGeometry);
+        impl->applyLiveFrames ();
+    }
+
     ImGui::SetNextWindowPos(ImVec2(0, 0), ImGuiCond_Always);
     ImGui::SetNextWindowSize(ImVec2(frameInfo.windowContentWidth, frameInfo.windowContentHeight), ImGuiCond_Always);
 
@@ -605,32 +799,151 @@ void ImageViewerWindow::runOnce ()
             case DaltonViewerMode::Daltonize:
             {
                 impl->filters.daltonize.setParams (impl->mutableState.daltonizeParams);
+                Filter_Daltonize::Params simulationParams = impl->mutableState.daltonizeParams;
+                simulationParams.simulateOnly = true;
+                impl->filters.daltonizeSimulation.setParams (simulationParams);
                 break;
             }
 
             default: break;
         }
 
-        GLFilter* activeFilter = impl->filterForMode(impl->mutableState.modeForCurrentFrame);
-        GLTexture* imageTexture = &impl->gpuTexture;
-        if (activeFilter)
+        const std::vector<GLFilter*> activeFilters = impl->filtersForMode(impl->mutableState.modeForCurrentFrame);
+
+        // The highlighted colors get blended over the input, with a blinking intensity.
+        const bool blendHighlightOverInput = !activeFilters.empty() && activeFilters.back() == &impl->filters.highlightSimilarColors;
+        const float highlightIntensity = Filter_HighlightSimilarColors::blinkIntensity (currentDateInSeconds());
+
+        // Zoomed out, e.g. a multi-monitor grab shown on one screen. Sample from the
+        // mipmaps to avoid aliasing and reading the full resolution texture.
+        const auto imageWidgetSize = imSize(impl->imageWidgetRect.current);
+        const float widgetWidthInPixels = imageWidgetSize.x * io.DisplayFramebufferScale.x;
+        const bool isMinified = widgetWidthInPixels < (impl->im.width() / float(impl->zoom.zoomFactor));
+
+        // Visible area of the image, in pixels. Not rounded, to map the tiles to the widget.
+        const int imWidth = impl->gpuTexture.width();
+        const int imHeight = impl->gpuTexture.height();
+        const dl::Rect visibleUV = dl::Rect::from_x_y_w_h (uv0.x, uv0.y, uv1.x - uv0.x, uv1.y - uv0.y);
+        const dl::Rect visibleImageArea = dl::Rect::from_x_y_w_h (uv0.x * imWidth, uv0.y * imHeight,
+                                                                  visibleUV.size.x * imWidth, visibleUV.size.y * imHeight);
+        const dl::Rect visibleRect = GLFilterGraph::textureRectForUVRect (visibleUV, imWidth, imHeight);
+
+        // What gets displayed for each tile, the filtered texture only covers a part of the tile.
+        struct DisplayedTile
+        {
+            GLTexture* texture = nullptr;
+            // Area of the full image covered by texture, in pixels.
+            dl::Rect textureRegion;
+        };
+        std::vector<DisplayedTile> displayedTiles (impl->gpuTexture.numTiles());
+        
+        for (int tileIdx = 0; tileIdx < impl->gpuTexture.numTiles(); ++tileIdx)
         {
-            impl->filterProcessor.render (
-                *activeFilter,
-                impl->gpuTexture.textureId (),
-                impl->gpuTexture.width (),
-                impl->gpuTexture.height ()
-            );
-            imageTexture = &impl->filterProcessor.filteredTexture();
+            GLTiledTexture::Tile& tile = impl->gpuTexture.tile(tileIdx);
+            const dl::Rect visibleTileRect = visibleRect.intersect (tile.imageRect);
+            if (visibleTileRect.area() == 0. && !impl->saveToFile.requested)
+                continue;
+            
+            DisplayedTile& displayed = displayedTiles[tileIdx];
+            displayed.texture = &tile.texture;
+            displayed.textureRegion = tile.textureRect;
+            bool filteredTextureChanged = false;
+            if (!activeFilters.empty())
+            {
+                GLFilterGraph& filterGraph = impl->filterGraphForTile (tileIdx);
+                filterGraph.setFilters (activeFilters);
+
+                // When zoomed in only filter the visible area. Keep some margin around it,
+                // and keep the same area as long as it stays visible and not much larger,
+                // so panning does not filter again on every frame. Saving needs the full image.
+                // The regions are in tile texture coordinates.
+                const dl::Rect tileArea = dl::Rect::from_x_y_w_h (0, 0, tile.textureRect.size.x, tile.textureRect.size.y);
+                if (impl->saveToFile.requested)
+                {
+                    filterGraph.setRegionOfInterest (tileArea);
+                }
+                else
+                {
+                    dl::Rect visibleRectInTile = visibleTileRect;
+                    visibleRectInTile.origin -= tile.textureRect.origin;
+                    const dl::Rect currentRegion = filterGraph.filteredRegion ();
+                    const bool regionIsTooSmall = currentRegion.intersect (visibleRectInTile).area() < visibleRectInTile.area();
+                    const bool regionIsTooLarge = currentRegion.area() > 4. * visibleRectInTile.area();
+                    // The tile size can change with the image.
+                    const bool regionIsOutside = currentRegion.intersect (tileArea).area() < currentRegion.area();
+                    if (regionIsTooSmall || regionIsTooLarge || regionIsOutside)
+                    {
+                        const double margin = std::floor (std::max (visibleRect.size.x, visibleRect.size.y) / 4);
+                        const dl::Rect roi = dl::Rect::from_x_y_w_h (visibleRectInTile.origin.x - margin,
+                                                                     visibleRectInTile.origin.y - margin,
+                                                                     visibleRectInTile.size.x + 2*margin,
+                                                                     visibleRectInTile.size.y + 2*margin);
+                        filterGraph.setRegionOfInterest (roi.intersect (tileArea));
+                    }
+                }
+
+                // Most frames the image and the params are the same, no need to render.
+                filteredTextureChanged = filterGraph.renderIfChanged (tile.texture);
+                displayed.texture = &filterGraph.filteredTexture();
+                displayed.textureRegion = filterGraph.filteredRegion ();
+                displayed.textureRegion.origin += tile.textureRect.origin;
+            }
+
+            if (isMinified)
+            {
+                if (!tile.texture.hasMipmaps())
+                {
+                    // Live updates invalidate the mipmaps all the time, let the GPU regenerate them.
+                    // The CPU pyramid is for the full image, so only usable with a single tile.
+                    if (impl->liveCapture.isLiveCaptureActive () || impl->gpuTexture.numTiles() > 1)
+                    {
+                        tile.texture.generateMipmaps ();
+                    }
+                    else
+                    {
+                        impl->imPyramid.compute (impl->im);
+                        tile.texture.uploadMipmaps (impl->imPyramid);
+                    }
+                }
+
+                if (displayed.texture != &tile.texture && (filteredTextureChanged || !displayed.texture->hasMipmaps()))
+                    displayed.texture->generateMipmaps ();
+            }
         }
 
         if (impl->saveToFile.requested)
         {
-            impl->saveToFile.requested = false;
-            ImageSRGBA im;
-            imageTexture->download (im);
-            writePngImage (impl->saveToFile.outPath, im);
+            // The tiles get assembled as they arrive, and the file gets written with the last one.
+            if (impl->saveToFile.numRequestedTiles == 0)
+            {
+                impl->saveToFile.image.ensureAllocatedBufferForSize (imWidth, imHeight);
+                impl->saveToFile.numReceivedTiles = 0;
+                impl->saveToFile.blendHighlightOverInput = blendHighlightOverInput;
+                impl->saveToFile.highlightIntensity = highlightIntensity;
+            }
+
+            while (impl->saveToFile.numRequestedTiles < int(displayedTiles.size()))
+            {
+                const int tileIdx = impl->saveToFile.numRequestedTiles;
+                // The borders overlap the neighbor tiles, but with the same pixels.
+                const dl::Rect tileRect = impl->gpuTexture.tile(tileIdx).textureRect;
+                const int numTiles = int(displayedTiles.size());
+                const bool requested = impl->readback.requestTexture (*displayedTiles[tileIdx].texture, [this, tileRect, numTiles](ImageSRGBA&& tileIm) {
+                    impl->saveToFile.onTileReceived (tileIm, tileRect, numTiles);
+                });
+                // Otherwise try again next frame.
+                if (!requested)
+                    break;
+                ++impl->saveToFile.numRequestedTiles;
+            }
+
+            if (impl->saveToFile.numRequestedTiles == int(displayedTiles.size()))
+            {
+                impl->saveToFile.requested = false;
+                impl->saveToFile.numRequestedTiles = 0;
+            }
         }
+        impl->readback.processCompleted ();
         
         const bool imageHasNonMultipleSize = int(impl->imageWidgetRect.current.size.x) % int(impl->imageWidgetRect.normal.size.x) != 0;
         const bool hasZoom = impl->zoom.zoomFactor != 1;
@@ -641,27 +954,62 @@ void ImageViewerWindow::runOnce ()
             ImGui::GetWindowDrawList()->AddCallback([](const ImDrawList *parent_list, const ImDrawCmd *cmd)
                                                     {
                                                         ImageViewerWindow *that = reinterpret_cast<ImageViewerWindow *>(cmd->UserCallbackData);
-                                                        // Doing both since we're not sure which one will be used.
-                                                        // Could store it as a member, but well.
-                                                        that->impl->gpuTexture.setLinearInterpolationEnabled(true);
-                                                        that->impl->filterProcessor.filteredTexture().setLinearInterpolationEnabled(true);
+                                                        that->impl->setLinearInterpolationEnabled(true);
                                                     },
                                                     this);
         }
 
-        const auto imageWidgetSize = imSize(impl->imageWidgetRect.current);
-        ImGui::Image(reinterpret_cast<ImTextureID>(imageTexture->textureId()),
-                     imageWidgetSize,
-                     uv0,
-                     uv1);        
+        // Each tile covers its own part of the widget.
+        auto imageToWidget = [&](double x, double y) {
+            return ImVec2 (imageWidgetTopLeft.x + float((x - visibleImageArea.origin.x) / visibleImageArea.size.x) * imageWidgetSize.x,
+                           imageWidgetTopLeft.y + float((y - visibleImageArea.origin.y) / visibleImageArea.size.y) * imageWidgetSize.y);
+        };
+        auto uvInRegion = [](const dl::Rect& region, double x, double y) {
+            return ImVec2 (float((x - region.origin.x) / region.size.x),
+                           float((y - region.origin.y) / region.size.y));
+        };
+        ImDrawList* drawList = ImGui::GetWindowDrawList();
+        for (int tileIdx = 0; tileIdx < impl->gpuTexture.numTiles(); ++tileIdx)
+        {
+            const GLTiledTexture::Tile& tile = impl->gpuTexture.tile(tileIdx);
+            const DisplayedTile& displayed = displayedTiles[tileIdx];
+            const dl::Rect area = visibleImageArea.intersect (tile.imageRect);
+            if (!displayed.texture || area.area() == 0.)
+                continue;
+
+            const double x0 = area.origin.x, y0 = area.origin.y;
+            const double x1 = x0 + area.size.x, y1 = y0 + area.size.y;
+            const ImVec2 p0 = imageToWidget (x0, y0);
+            const ImVec2 p1 = imageToWidget (x1, y1);
+            if (blendHighlightOverInput)
+            {
+                drawList->AddImage(reinterpret_cast<ImTextureID>(tile.texture.textureId()),
+                                   p0, p1,
+                                   uvInRegion (tile.textureRect, x0, y0),
+                                   uvInRegion (tile.textureRect, x1, y1));
+                drawList->AddImage(reinterpret_cast<ImTextureID>(displayed.texture->textureId()),
+                                   p0, p1,
+                                   uvInRegion (displayed.textureRegion, x0, y0),
+                                   uvInRegion (displayed.textureRegion, x1, y1),
+                                   ImGui::GetColorU32(ImVec4(highlightIntensity, highlightIntensity, highlightIntensity, 1.f)));
+            }
+            else
+            {
+                drawList->AddImage(reinterpret_cast<ImTextureID>(displayed.texture->textureId()),
+                                   p0, p1,
+                                   uvInRegion (displayed.textureRegion, x0, y0),
+                                   uvInRegion (displayed.textureRegion, x1, y1));
+            }
+        }
+        // The item for the hover and click handling.
+        ImGui::Dummy(imageWidgetSize);
 
         if (useLinearFiltering)
         {
             ImGui::GetWindowDrawList()->AddCallback([](const ImDrawList *parent_list, const ImDrawCmd *cmd)
                                                     {
                                                         ImageViewerWindow *that = reinterpret_cast<ImageViewerWindow *>(cmd->UserCallbackData);
-                                                        that->impl->gpuTexture.setLinearInterpolationEnabled(false);
-                                                        that->impl->filterProcessor.filteredTexture().setLinearInterpolationEnabled(false);
+                                                        that->impl->setLinearInterpolationEnabled(false);
                                                     },
                                                     this);
         }
@@ -678,27 +1026,52 @@ void ImageViewerWindow::runOnce ()
             mousePosInImage = mousePosInTexture * ImVec2(impl->im.width(), impl->im.height());
         }
         
+        const int cursorRoiSize = 15;
         bool showCursorOverlay = false;
         const bool pointerOverTheImage = ImGui::IsItemHovered() && impl->im.contains(mousePosInImage.x, mousePosInImage.y);
-        if (pointerOverTheImage)
+        // The overlay only shows the tile under the pointer.
+        const int tileUnderPointer = pointerOverTheImage ? impl->gpuTexture.tileIndexForPixel (int(mousePosInImage.x), int(mousePosInImage.y)) : -1;
+        const DisplayedTile* displayedTile = tileUnderPointer >= 0 ? &displayedTiles[tileUnderPointer] : nullptr;
+        // The highlighted colors blink, the selected color info is more useful then.
+        const bool showFilteredPixels = !activeFilters.empty() && !blendHighlightOverInput;
+        if (displayedTile && displayedTile->texture)
         {
-            // Unfortunately we can't easily show it in every mode because the image
-            // is only in the GPU. We'd need to implement a cache + CPU retrieval.
-            bool showBecauseOfHighlightMode = (impl->mutableState.modeForCurrentFrame == DaltonViewerMode::HighlightRegions && !impl->mutableState.highlightRegion.hasActiveColor());
-            bool showBecauseOfOriginal = (impl->mutableState.modeForCurrentFrame == DaltonViewerMode::Original);
-            showCursorOverlay = (showBecauseOfHighlightMode || showBecauseOfOriginal);
+            if (showFilteredPixels)
+            {
+                // Only the pixels around the pointer get read back, and we need
+                // to wait for them the first time.
+                impl->updateFilteredPixels (*displayedTile->texture, displayedTile->textureRegion, mousePosInImage, cursorRoiSize);
+                showCursorOverlay = impl->filteredPixels.imageRect.contains (dl::Point(int(mousePosInImage.x), int(mousePosInImage.y)));
+            }
+            else
+            {
+                showCursorOverlay = !blendHighlightOverInput;
+            }
         }
         
         if (showCursorOverlay)
         {
-            impl->cursorOverlayInfo.image = &impl->im;
-            impl->cursorOverlayInfo.imageTexture = &impl->gpuTexture;
+            if (showFilteredPixels)
+            {
+                impl->cursorOverlayInfo.image = &impl->filteredPixels.image;
+                impl->cursorOverlayInfo.imageTexture = displayedTile->texture;
+                impl->cursorOverlayInfo.imageOrigin = dl::vec2i (int(impl->filteredPixels.imageRect.origin.x), int(impl->filteredPixels.imageRect.origin.y));
+                impl->cursorOverlayInfo.fullImageSize = dl::vec2i (impl->im.width(), impl->im.height());
+            }
+            else
+            {
+                impl->cursorOverlayInfo.image = &impl->im;
+                impl->cursorOverlayInfo.imageTexture = displayedTile->texture;
+                impl->cursorOverlayInfo.imageOrigin = dl::vec2i (0, 0);
+                impl->cursorOverlayInfo.fullImageSize = dl::vec2i (-1, -1);
+            }
+            impl->cursorOverlayInfo.textureRect = displayedTile->textureRegion;
             impl->cursorOverlayInfo.showHelp = false;
             impl->cursorOverlayInfo.imageWidgetSize = imageWidgetSize;
             impl->cursorOverlayInfo.imageWidgetTopLeft = imageWidgetTopLeft;
             impl->cursorOverlayInfo.uvTopLeft = uv0;
             impl->cursorOverlayInfo.uvBottomRight = uv1;
-            impl->cursorOverlayInfo.roiWindowSize = ImVec2(15, 15);
+            impl->cursorOverlayInfo.roiWindowSize = ImVec2(cursorRoiSize, cursorRoiSize);
             impl->cursorOverlayInfo.mousePos = io.MousePos;
             // Option: show it next to the mouse.
             // impl->inlineCursorOverlay.showTooltip(impl->cursorOverlayInfo);
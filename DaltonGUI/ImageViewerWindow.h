@@ -19,6 +19,7 @@ namespace dl
 {
 
 struct GrabScreenData;
+struct GrabScreenTimings;
 
 struct ImageViewerWindowState;
 struct CursorOverlayInfo;
@@ -36,6 +37,9 @@ public:
     void showGrabbedData (const GrabScreenData& grabbedData, dl::Rect& updatedWindowGeometry);
     
     const CursorOverlayInfo& cursorOverlayInfo() const;
+
+    // Timings of the grab that produced the current image.
+    const GrabScreenTimings& grabTimings() const;
     
     void shutdown ();
     void runOnce ();
@@ -44,6 +48,7 @@ public:
     void setEnabled (bool enabled);
 
     dl::Rect geometry () const;
+    GLFWwindow* glfwWindow ();
 
     void processKeyEvent (int keycode);
     void checkImguiGlobalImageKeyEvents ();
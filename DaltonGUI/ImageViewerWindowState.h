@@ -38,9 +38,16 @@ struct ImageViewerWindowState
     DaltonViewerMode modeForCurrentFrame = DaltonViewerMode::None;
     
     Filter_Daltonize::Params daltonizeParams;
+    // Shows the corrected image as seen with the deficiency, to check
+    // that the correction actually helps.
+    bool simulateDaltonizeCorrection = false;
 
     Filter_HSVTransform::Params hsvTransform;
 
+    // Keep re-grabbing the captured area. Changes below the viewer
+    // window itself are ignored, so it needs to be moved aside.
+    bool liveCapture = false;
+
     struct InputState
     {
         bool shiftIsPressed = false;
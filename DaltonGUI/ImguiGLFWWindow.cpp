@@ -266,6 +266,8 @@ void ImguiGLFWWindow::shutdown()
         ImGui::DestroyContext(impl->imGuiContext);
         impl->imGuiContext = nullptr;
 
+        GLStateCache::forgetContext (impl->window);
+        GLGpuTimers::forgetContext (impl->window);
         glfwDestroyWindow (impl->window);
         impl->window = nullptr;
 
@@ -501,7 +503,11 @@ void ImguiGLFWWindow::endFrame ()
     glClearColor(0.1, 0.1, 0.1, 1);
     glClear(GL_COLOR_BUFFER_BIT);
 
-    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    {
+        GLScopedGpuTimer timer ("ImGui render");
+        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    }
+    GLGpuTimers::collectResults ();
 
     // Update and Render additional Platform Windows
     // This is used by the highlight similar color companion window.
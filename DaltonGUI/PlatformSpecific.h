@@ -10,6 +10,9 @@
 #include <Dalton/Image.h>
 #include <Dalton/OpenGL.h>
 
+#include <memory>
+#include <vector>
+
 struct GLFWwindow;
 
 namespace dl
@@ -23,8 +26,33 @@ dl::Point getMouseCursor();
 
 dl::Rect getFrontWindowGeometry(GLFWwindow* grabWindowHandle);
 
+// Same as getFrontWindowGeometry, but meant to live for one grab session.
+// On Linux it keeps a local copy of the window tree that follows the X
+// events, so update() needs to get called every frame to drain them.
+class FrontWindowFinder
+{
+public:
+    FrontWindowFinder ();
+    ~FrontWindowFinder ();
+
+    void update ();
+    dl::Rect frontWindowGeometry (GLFWwindow* grabWindowHandle);
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
 void setAppFocusEnabled (bool enabled);
 
+// Connection to the display server used by the GLFW windows, readable when
+// it has pending events. Only on Linux, -1 elsewhere.
+int getWindowSystemFileDescriptor ();
+
+// Needs to be called from the main thread. On macOS it explains to the
+// user how to grant the screen recording permission if it is missing.
+bool checkScreenCapturePermission ();
+
 class ScreenGrabber
 {
 public:
@@ -32,14 +60,63 @@ public:
     ~ScreenGrabber ();
     
 public:
+    // Optional hint to allocate the capture buffers upfront, e.g.
+    // for the largest monitor, so the first grab does not pay for it.
+    void reserveForSize (int width, int height);
+
     bool grabScreenArea (const dl::Rect& screenRect, dl::ImageSRGBA& cpuArea, GLTexture& gpuTexture);
     
+    // CPU-only version that does not touch OpenGL. It can be called from a
+    // background thread as long as each thread uses its own ScreenGrabber.
+    bool grabScreenArea (const dl::Rect& screenRect, dl::ImageSRGBA& cpuArea);
+
+    // Quick preview of a large area. The grab itself is full resolution, but
+    // each downsampleFactor x downsampleFactor block gets averaged during the
+    // pixel conversion, so the conversion work is divided by up to factor^2.
+    // The raw pixels are kept until the next grab, and convertLastGrabArea
+    // can then convert any part of it at full resolution. fullWidth and
+    // fullHeight get the size of the full resolution image.
+    bool grabScreenAreaPreview (const dl::Rect& screenRect, int downsampleFactor,
+                                dl::ImageSRGBA& previewImage,
+                                int& fullWidth, int& fullHeight);
+
+    // imageRect is in full resolution image coordinates, and gets clipped
+    // like dl::crop. Returns false if there was no preview grab since
+    // the last regular grab.
+    bool convertLastGrabArea (const dl::Rect& imageRect, dl::ImageSRGBA& output);
+
+    // Live capture of a fixed screen area. The first update grabs the whole
+    // area, the next ones only re-grab and upload the parts that the system
+    // reported as damaged (XDamage on Linux). Without damage tracking the
+    // whole area gets re-grabbed at a reduced rate.
+    // The window showing the result sits over the captured area, so live
+    // capture is only supported where the grabs can leave it out (Linux).
+    static bool liveCaptureIsSupported ();
+    void startLiveCapture (const dl::Rect& screenRect);
+    void stopLiveCapture ();
+    bool isLiveCaptureActive () const;
+
+    // True if the last grab went through the MIT-SHM segment. Linux only.
+    bool usesSharedMemory () const;
+    // Returns true if cpuArea and gpuTexture were updated. The pixels under
+    // excludedScreenRect are never grabbed and keep their previous content,
+    // this is typically the window showing the result, otherwise it would
+    // capture its own output.
+    bool updateLiveCapture (dl::ImageSRGBA& cpuArea, GLTexture& gpuTexture, const dl::Rect& excludedScreenRect = dl::Rect());
+
+    // CPU-only version, updatedRects gets the modified areas in image coordinates.
+    bool updateLiveCapture (dl::ImageSRGBA& cpuArea, std::vector<dl::Rect>& updatedRects, const dl::Rect& excludedScreenRect = dl::Rect());
+    
 private:
     struct Impl;
     friend struct Impl;
     std::unique_ptr<Impl> impl;
 };
 
+// Calls the callback at the refresh rate of the display. On macOS it is
+// driven by the main run loop. On Linux the main loop needs to poll
+// fileDescriptor and call runOnce when it is readable, and the ticks get
+// aligned on the vblanks when the driver reports them. Requires glfwInit.
 class DisplayLinkTimer
 {
 public:
@@ -47,6 +124,19 @@ public:
     ~DisplayLinkTimer ();
     
     void setCallback (const std::function<void(void)>& callback);
+
+    // Stops the ticks without losing the callback, e.g. when no window is visible.
+    void setPaused (bool paused);
+
+    // Linux only. The visible window whose swaps the ticks get aligned on,
+    // with nullptr they just follow the refined refresh period.
+    void setPresentingWindow (GLFWwindow* window);
+
+    // Linux only, -1 elsewhere. Readable when runOnce has a tick to process.
+    int fileDescriptor () const;
+
+    // Linux only, calls the callback if the display refreshed since the last call.
+    void runOnce ();
     
 private:
     struct Impl;
@@ -65,7 +155,12 @@ public:
     
     void setKeyboardCtrlAltCmdSpaceCallback (const std::function<void(void)>& callback);
 
+    // Calls the callbacks of the hotkeys received since the last call. On
+    // Linux and Windows the hotkeys are monitored by a dedicated thread.
     void runOnce ();
+
+    // Readable when runOnce has hotkeys to process. Only on Linux, -1 elsewhere.
+    int eventFileDescriptor () const;
     
 private:
     struct Impl;
@@ -79,6 +174,10 @@ void openURLInBrowser(const char* url);
 
 void getVersionAndBuildNumber(std::string& version, std::string& build);
 
+// Per-user folder for data that can be regenerated, like the shader
+// binaries. Created if needed, returns an empty string on failure.
+std::string getUserCacheDirectory (const std::string& subFolder);
+
 struct StartupManager
 {
     StartupManager ();
@@ -8,31 +8,142 @@
 
 #include <Dalton/Utils.h>
 #include <Dalton/OpenGL.h>
+#include <Dalton/PixelConversion.h>
+#include <Dalton/SPSCQueue.h>
 
 #include "DaltonGeneratedConfig.h"
 
 #include <GLFW/glfw3.h>
 #define GLFW_EXPOSE_NATIVE_X11 1
+#define GLFW_EXPOSE_NATIVE_GLX 1
 #include <GLFW/glfw3native.h>
 
 #include <xdo/xdo_mini.h>
 
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
+#include <X11/Xatom.h>
+#include <X11/extensions/XShm.h>
+#if DL_HAVE_XDAMAGE
+# include <X11/extensions/Xdamage.h>
+#endif
+
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <poll.h>
 
 #include <thread>
 #include <mutex>
+#include <unordered_map>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
 
 // getpid
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <unistd.h>
+#include <cerrno>
 
 namespace dl
 {
 
+// A timerfd ticking at the refresh rate of the primary monitor. When the
+// presenting window supports GLX_OML_sync_control, the period is refined
+// and the ticks re-aligned on the last vblank after each one, so they
+// follow the actual frames instead of drifting.
 struct DisplayLinkTimer::Impl
-{};
+{
+    std::function<void(void)> callback = nullptr;
+    int timerFd = -1;
+    bool paused = false;
+    GLFWwindow* presentingWindow = nullptr;
+
+    double nominalPeriodInSeconds = 1.0 / 60.0;
+    double periodInSeconds = 1.0 / 60.0;
+
+    struct {
+        bool checked = false;
+        PFNGLXGETSYNCVALUESOMLPROC getSyncValues = nullptr;
+        // Samples are only comparable for the same window.
+        GLFWwindow* lastWindow = nullptr;
+        int64_t lastUst = -1;
+        int64_t lastMsc = -1;
+    } oml;
+
+    ~Impl ()
+    {
+        if (timerFd >= 0)
+            close (timerFd);
+    }
+
+    // firstTickTime uses the clock of currentDateInSeconds, the steady
+    // clock is CLOCK_MONOTONIC on Linux.
+    void arm (double firstTickTime)
+    {
+        itimerspec spec = {};
+        spec.it_value.tv_sec = time_t(firstTickTime);
+        spec.it_value.tv_nsec = long((firstTickTime - std::floor(firstTickTime)) * 1e9);
+        const long periodNs = long(periodInSeconds * 1e9);
+        spec.it_interval.tv_sec = periodNs / 1000000000L;
+        spec.it_interval.tv_nsec = periodNs % 1000000000L;
+        timerfd_settime (timerFd, TFD_TIMER_ABSTIME, &spec, nullptr);
+    }
+
+    void disarm ()
+    {
+        itimerspec spec = {};
+        timerfd_settime (timerFd, 0, &spec, nullptr);
+    }
+
+    // Returns false if the vblank timestamps are not available.
+    bool alignOnLastVblank ()
+    {
+        // Not the current context, that's often the hidden main one.
+        GLFWwindow* window = presentingWindow;
+        if (!window || glfwGetWindowAttrib (window, GLFW_CONTEXT_CREATION_API) != GLFW_NATIVE_CONTEXT_API)
+            return false;
+
+        Display* display = glfwGetX11Display ();
+        if (!oml.checked)
+        {
+            oml.checked = true;
+            const char* extensions = glXQueryExtensionsString (display, DefaultScreen(display));
+            if (extensions && strstr (extensions, "GLX_OML_sync_control"))
+                oml.getSyncValues = (PFNGLXGETSYNCVALUESOMLPROC)glXGetProcAddressARB ((const GLubyte*)"glXGetSyncValuesOML");
+        }
+
+        if (!oml.getSyncValues)
+            return false;
 
+        int64_t ust = 0, msc = 0, sbc = 0;
+        if (!oml.getSyncValues (display, glfwGetGLXWindow (window), &ust, &msc, &sbc))
+            return false;
+
+        // UST is CLOCK_MONOTONIC in microseconds with Mesa, but the
+        // extension does not guarantee it, so check that it is plausible.
+        const double now = currentDateInSeconds ();
+        const double vblankTime = ust * 1e-6;
+        if (std::abs (now - vblankTime) > 1.0)
+            return false;
+
+        if (window == oml.lastWindow)
+        {
+            periodInSeconds = refineRefreshPeriod (periodInSeconds, nominalPeriodInSeconds,
+                                                   oml.lastUst * 1e-6, oml.lastMsc,
+                                                   vblankTime, msc);
+        }
+        oml.lastWindow = window;
+        oml.lastUst = ust;
+        oml.lastMsc = msc;
+
+        arm (nextVblankTime (vblankTime, periodInSeconds, now));
+        return true;
+    }
+};
 
 DisplayLinkTimer::DisplayLinkTimer ()
 : impl (new Impl())
@@ -46,7 +157,68 @@ DisplayLinkTimer::~DisplayLinkTimer ()
 
 void DisplayLinkTimer::setCallback (const std::function<void(void)>& callback)
 {
-    dl_assert (false, "not implemented");
+    impl->callback = callback;
+
+    if (impl->timerFd < 0)
+    {
+        impl->timerFd = timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (impl->timerFd < 0)
+        {
+            fprintf (stderr, "ERROR: timerfd_create failed: %s\n", strerror(errno));
+            return;
+        }
+    }
+
+    GLFWmonitor* monitor = glfwGetPrimaryMonitor ();
+    const GLFWvidmode* mode = monitor ? glfwGetVideoMode (monitor) : nullptr;
+    if (mode && mode->refreshRate > 0)
+        impl->nominalPeriodInSeconds = 1.0 / mode->refreshRate;
+    impl->periodInSeconds = impl->nominalPeriodInSeconds;
+
+    if (!impl->paused)
+        impl->arm (currentDateInSeconds() + impl->periodInSeconds);
+}
+
+void DisplayLinkTimer::setPaused (bool paused)
+{
+    if (impl->paused == paused)
+        return;
+
+    impl->paused = paused;
+    if (impl->timerFd < 0)
+        return;
+
+    if (paused)
+        impl->disarm ();
+    else
+        impl->arm (currentDateInSeconds() + impl->periodInSeconds);
+}
+
+void DisplayLinkTimer::setPresentingWindow (GLFWwindow* window)
+{
+    impl->presentingWindow = window;
+}
+
+int DisplayLinkTimer::fileDescriptor () const
+{
+    return impl->timerFd;
+}
+
+void DisplayLinkTimer::runOnce ()
+{
+    if (impl->timerFd < 0)
+        return;
+
+    uint64_t numTicks = 0;
+    if (read (impl->timerFd, &numTicks, sizeof(numTicks)) != sizeof(numTicks) || numTicks == 0)
+        return;
+
+    if (impl->callback)
+        impl->callback ();
+
+    // The callback typically rendered and swapped, so the timestamps are fresh.
+    if (!impl->paused)
+        impl->alignOnLastVblank ();
 }
 
 } // dl
@@ -63,21 +235,67 @@ struct KeyboardMonitor::Impl
         std::function<void(void)> callback = nullptr;
     };
 
-    Display* dpy = XOpenDisplay(0);
-    Window root = DefaultRootWindow(dpy);
+    enum class Event { CtrlCmdAltSpace };
+
+    // Only used by the hotkey thread once it started.
+    Display* dpy = nullptr;
+    Window root = 0;
 
     Shortcut ctrlCmdAltSpace;
+
+    // Hotkey thread => UI thread, signaled by wakeupFd.
+    SPSCQueue<Event, 64> events;
+    int wakeupFd = -1;
+    // Written by the UI thread to stop the hotkey thread.
+    int stopFd = -1;
+    std::thread hotkeyThread;
+
+    void signal (int fd)
+    {
+        const uint64_t one = 1;
+        (void)write (fd, &one, sizeof(one));
+    }
+
+    // Blocks on the X connection, so the hotkeys get queued right away
+    // whatever the UI thread is doing.
+    void runHotkeyThread ()
+    {
+        pollfd fds[2] = { { ConnectionNumber(dpy), POLLIN, 0 }, { stopFd, POLLIN, 0 } };
+        while (true)
+        {
+            while (XPending(dpy))
+            {
+                XEvent ev;
+                XNextEvent(dpy, &ev);
+                if (ev.type == KeyPress && ev.xkey.keycode == ctrlCmdAltSpace.keycode)
+                {
+                    dl_dbg ("Hot key pressed!");
+                    if (events.tryPush (Event::CtrlCmdAltSpace))
+                        signal (wakeupFd);
+                }
+            }
+
+            if (poll (fds, 2, -1) < 0 && errno != EINTR)
+            {
+                fprintf (stderr, "ERROR: poll failed in the hotkey thread: %s\n", strerror(errno));
+                break;
+            }
+
+            if (fds[1].revents & POLLIN)
+                break;
+        }
+    }
 };
 
 KeyboardMonitor::KeyboardMonitor ()
 : impl (new Impl())
 {
-    impl->ctrlCmdAltSpace.modifiers = ControlMask | Mod1Mask | Mod4Mask;
-    impl->ctrlCmdAltSpace.keycode = XKeysymToKeycode(impl->dpy, XK_space);
-
     impl->dpy = XOpenDisplay(0);
     impl->root = DefaultRootWindow(impl->dpy);
 
+    impl->ctrlCmdAltSpace.modifiers = ControlMask | Mod1Mask | Mod4Mask;
+    impl->ctrlCmdAltSpace.keycode = XKeysymToKeycode(impl->dpy, XK_space);
+
     Bool owner_events = False;
     int pointer_mode = GrabModeAsync;
     int keyboard_mode = GrabModeAsync;
@@ -91,10 +309,35 @@ KeyboardMonitor::KeyboardMonitor ()
     }
 
     XSelectInput(impl->dpy, impl->root, KeyPressMask);
+    XFlush(impl->dpy);
+
+    impl->wakeupFd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+    impl->stopFd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (impl->wakeupFd < 0 || impl->stopFd < 0)
+    {
+        fprintf (stderr, "ERROR: could not create the hotkey eventfds: %s\n", strerror(errno));
+        return;
+    }
+
+    impl->hotkeyThread = std::thread ([this]() {
+        impl->runHotkeyThread ();
+    });
 }
 
 KeyboardMonitor::~KeyboardMonitor ()
 {
+    if (impl->hotkeyThread.joinable())
+    {
+        impl->signal (impl->stopFd);
+        impl->hotkeyThread.join ();
+    }
+
+    for (const int fd : { impl->wakeupFd, impl->stopFd })
+    {
+        if (fd >= 0)
+            close (fd);
+    }
+
     for (const auto &shortcut : { impl->ctrlCmdAltSpace })
     {
         for (const auto modifiers : { shortcut.modifiers, shortcut.modifiers | LockMask, shortcut.modifiers | Mod2Mask, shortcut.modifiers | LockMask | Mod2Mask })
@@ -119,27 +362,30 @@ void KeyboardMonitor::setKeyboardCtrlAltCmdSpaceCallback (const std::function<vo
 
 void KeyboardMonitor::runOnce ()
 {
-    if (!XPending(impl->dpy))
-        return;
-
-    XEvent ev;
-    XNextEvent(impl->dpy, &ev);
-    switch (ev.type)
+    if (impl->wakeupFd >= 0)
     {
-    case KeyPress:
+        uint64_t numSignals = 0;
+        (void)read (impl->wakeupFd, &numSignals, sizeof(numSignals));
+    }
+
+    Impl::Event event;
+    while (impl->events.tryPop (event))
     {
-        dl_dbg ("Hot key pressed!");
-        if (ev.xkey.keycode == impl->ctrlCmdAltSpace.keycode)
+        switch (event)
         {
-            if (impl->ctrlCmdAltSpace.callback)
-                impl->ctrlCmdAltSpace.callback();
+            case Impl::Event::CtrlCmdAltSpace:
+            {
+                if (impl->ctrlCmdAltSpace.callback)
+                    impl->ctrlCmdAltSpace.callback();
+                break;
+            }
         }
-        break;
     }
+}
 
-    default:
-        break;
-    }
+int KeyboardMonitor::eventFileDescriptor () const
+{
+    return impl->wakeupFd;
 }
 
 } // dl
@@ -147,13 +393,342 @@ void KeyboardMonitor::runOnce ()
 namespace dl
 {
 
+namespace {
+
+// X errors are asynchronous and the default handler exits the app.
+// XShmAttach fails on remote connections, so we trap errors during the setup.
+// The handler is process-wide and the grabs can run in parallel, so the
+// whole install / sync / restore sequence is serialized by the trap mutex.
+std::mutex xErrorTrapMutex;
+bool xErrorTrapped = false;
+int trapXError (Display*, XErrorEvent*)
+{
+    xErrorTrapped = true;
+    return 0;
+}
+
+struct ScopedXErrorTrap
+{
+    ScopedXErrorTrap () : lock (xErrorTrapMutex)
+    {
+        xErrorTrapped = false;
+        prevHandler = XSetErrorHandler (trapXError);
+    }
+
+    ~ScopedXErrorTrap ()
+    {
+        XSetErrorHandler (prevHandler);
+        xErrorTrapped = false;
+    }
+
+    // Only meaningful after an XSync on the trapped display.
+    bool errorTrapped () const { return xErrorTrapped; }
+
+    std::lock_guard<std::mutex> lock;
+    XErrorHandler prevHandler = nullptr;
+};
+
+} // anonymous
+
 struct ScreenGrabber::Impl
 {
+    // Each grabber gets its own connection so that it can be used
+    // from a background thread without racing with GLFW's display.
+    Display* display = nullptr;
+
+    // MIT-SHM segment that persists across grabs. The server writes directly
+    // into it instead of sending a newly allocated image over the socket.
+    struct {
+        bool checked = false;
+        bool available = false;
+        XShmSegmentInfo segmentInfo = {};
+        size_t capacityInBytes = 0;
+        // Lightweight header on top of the segment, only recreated when
+        // the grab size changes.
+        XImage* image = nullptr;
+        bool usedByLastGrab = false;
+    } shm;
+
+    struct {
+        bool active = false;
+        dl::Rect screenRect;
+        bool needsFullGrab = true;
+        double lastFullGrabTime = NAN;
+#if DL_HAVE_XDAMAGE
+        bool damageChecked = false;
+        bool damageAvailable = false;
+        int damageEventBase = 0;
+        Damage damage = 0;
+        XserverRegion damagedRegion = 0;
+#endif
+    } live;
+
+    // Raw pixels of the last preview grab, see convertLastGrabArea.
+    struct {
+        XImage* image = nullptr;
+        // XGetImage result when SHM is not available, otherwise it's the SHM image.
+        bool owned = false;
+    } lastGrab;
+
     ~Impl()
     {
-        
+        releaseLastGrab ();
+        releaseDamage ();
+        releaseShm ();
+
+        if (display)
+            XCloseDisplay (display);
+    }
+
+    bool ensureDisplayOpened ()
+    {
+        if (!display)
+            display = XOpenDisplay (nullptr);
+        return display != nullptr;
+    }
+
+    bool shmIsAvailable ()
+    {
+        if (!shm.checked)
+        {
+            shm.checked = true;
+            shm.available = XShmQueryExtension (display);
+            if (getenv ("DALTONLENS_DISABLE_XSHM") != nullptr)
+            {
+                dl_dbg ("XShm disabled by DALTONLENS_DISABLE_XSHM");
+                shm.available = false;
+            }
+        }
+        return shm.available;
+    }
+
+    bool ensureShmCapacity (size_t requiredBytes)
+    {
+        if (shm.capacityInBytes >= requiredBytes)
+            return true;
+
+        releaseShm ();
+
+        shm.segmentInfo.shmid = shmget (IPC_PRIVATE, requiredBytes, IPC_CREAT | 0600);
+        if (shm.segmentInfo.shmid < 0)
+        {
+            dl_dbg ("shmget failed, falling back to XGetImage.");
+            shm.available = false;
+            return false;
+        }
+
+        shm.segmentInfo.shmaddr = (char*) shmat (shm.segmentInfo.shmid, nullptr, 0);
+        // Mark it for deletion right away, it'll get released once both
+        // the server and us are detached, even if we crash.
+        shmctl (shm.segmentInfo.shmid, IPC_RMID, nullptr);
+        if (shm.segmentInfo.shmaddr == (char*)-1)
+        {
+            dl_dbg ("shmat failed, falling back to XGetImage.");
+            shm.segmentInfo = {};
+            shm.available = false;
+            return false;
+        }
+        shm.segmentInfo.readOnly = False;
+
+        XSync (display, False);
+        bool attached = false;
+        {
+            ScopedXErrorTrap errorTrap;
+            attached = XShmAttach (display, &shm.segmentInfo);
+            XSync (display, False);
+            attached = attached && !errorTrap.errorTrapped ();
+        }
+        if (!attached)
+        {
+            dl_dbg ("XShmAttach failed (remote display?), falling back to XGetImage.");
+            shmdt (shm.segmentInfo.shmaddr);
+            shm.segmentInfo = {};
+            shm.available = false;
+            return false;
+        }
+
+        shm.capacityInBytes = requiredBytes;
+        return true;
+    }
+
+    XImage* shmImageForSize (int width, int height)
+    {
+        if (shm.image && shm.image->width == width && shm.image->height == height)
+            return shm.image;
+
+        destroyShmImage ();
+
+        const int screen = DefaultScreen (display);
+        XImage* image = XShmCreateImage (display,
+                                         DefaultVisual (display, screen),
+                                         DefaultDepth (display, screen),
+                                         ZPixmap,
+                                         nullptr,
+                                         &shm.segmentInfo,
+                                         width, height);
+        if (!image)
+            return nullptr;
+
+        if (!ensureShmCapacity (size_t(image->bytes_per_line) * image->height))
+        {
+            XDestroyImage (image);
+            return nullptr;
+        }
+
+        image->data = shm.segmentInfo.shmaddr;
+        shm.image = image;
+        return shm.image;
+    }
+
+    void releaseLastGrab ()
+    {
+        if (lastGrab.owned && lastGrab.image)
+            XDestroyImage (lastGrab.image);
+        lastGrab.image = nullptr;
+        lastGrab.owned = false;
+    }
+
+    void destroyShmImage ()
+    {
+        if (shm.image)
+        {
+            // Does not free the data for SHM images.
+            XDestroyImage (shm.image);
+            shm.image = nullptr;
+        }
+    }
+
+    void releaseShm ()
+    {
+        destroyShmImage ();
+
+        if (shm.capacityInBytes > 0)
+        {
+            XShmDetach (display, &shm.segmentInfo);
+            XSync (display, False);
+            shmdt (shm.segmentInfo.shmaddr);
+            shm.segmentInfo = {};
+            shm.capacityInBytes = 0;
+        }
+    }
+
+    void releaseDamage ()
+    {
+#if DL_HAVE_XDAMAGE
+        if (live.damage)
+        {
+            XDamageDestroy (display, live.damage);
+            live.damage = 0;
+        }
+        if (live.damagedRegion)
+        {
+            XFixesDestroyRegion (display, live.damagedRegion);
+            live.damagedRegion = 0;
+        }
+#endif
+    }
+
+    bool setupDamage ()
+    {
+#if DL_HAVE_XDAMAGE
+        if (!live.damageChecked)
+        {
+            live.damageChecked = true;
+            int errorBase = 0;
+            int fixesEventBase = 0;
+            live.damageAvailable = XDamageQueryExtension (display, &live.damageEventBase, &errorBase)
+                                && XFixesQueryExtension (display, &fixesEventBase, &errorBase);
+            if (!live.damageAvailable)
+                dl_dbg ("XDamage not available, live capture will re-grab everything.");
+        }
+
+        if (!live.damageAvailable)
+            return false;
+
+        if (!live.damage)
+        {
+            // NonEmpty only sends one event until the damage gets subtracted,
+            // so we don't get flooded while the content keeps changing.
+            live.damage = XDamageCreate (display, DefaultRootWindow(display), XDamageReportNonEmpty);
+            live.damagedRegion = XFixesCreateRegion (display, nullptr, 0);
+        }
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // Returns false if damage tracking is not available. The rects are in screen coordinates.
+    bool collectDamagedRects (std::vector<dl::Rect>& rects)
+    {
+        rects.clear ();
+#if DL_HAVE_XDAMAGE
+        if (!live.damage)
+            return false;
+
+        // Only damage events are selected on our connection.
+        bool gotDamage = false;
+        while (XPending (display))
+        {
+            XEvent ev;
+            XNextEvent (display, &ev);
+            if (ev.type == live.damageEventBase + XDamageNotify)
+                gotDamage = true;
+        }
+
+        if (!gotDamage)
+            return true;
+
+        XDamageSubtract (display, live.damage, None, live.damagedRegion);
+        int numRects = 0;
+        XRectangle* xrects = XFixesFetchRegion (display, live.damagedRegion, &numRects);
+        for (int i = 0; i < numRects; ++i)
+            rects.push_back (dl::Rect::from_x_y_w_h (xrects[i].x, xrects[i].y, xrects[i].width, xrects[i].height));
+        if (xrects)
+            XFree (xrects);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // Returns nullptr if SHM can't be used. The image remains owned by the grabber.
+    XImage* grabWithShm (const dl::Rect& screenRect)
+    {
+        shm.usedByLastGrab = false;
+        if (!shmIsAvailable ())
+            return nullptr;
+
+        XImage* image = shmImageForSize (screenRect.size.x, screenRect.size.y);
+        if (!image)
+            return nullptr;
+
+        if (!XShmGetImage (display, DefaultRootWindow(display), image, screenRect.origin.x, screenRect.origin.y, AllPlanes))
+            return nullptr;
+
+        shm.usedByLastGrab = true;
+        return image;
     }
 };
+
+static PackedPixelFormat packedPixelFormatOf (const XImage* img)
+{
+    PackedPixelFormat format;
+    format.bitsPerPixel = img->bits_per_pixel;
+    format.redMask = img->red_mask;
+    format.greenMask = img->green_mask;
+    format.blueMask = img->blue_mask;
+    format.msbFirst = img->byte_order == MSBFirst;
+    return format;
+}
+
+static void convertXImageToSRGBA (const XImage* img, dl::ImageSRGBA& cpuImage)
+{
+    convertPackedPixelsToSRGBA (reinterpret_cast<const uint8_t*>(img->data), img->bytes_per_line,
+                                img->width, img->height,
+                                packedPixelFormatOf (img),
+                                cpuImage);
+}
     
 ScreenGrabber::ScreenGrabber ()
 : impl (new Impl())
@@ -164,88 +739,365 @@ ScreenGrabber::ScreenGrabber ()
 ScreenGrabber::~ScreenGrabber ()
 {
 }
+
+void ScreenGrabber::reserveForSize (int width, int height)
+{
+    if (!impl->ensureDisplayOpened () || !impl->shmIsAvailable ())
+        return;
+
+    // 32 bits visuals are by far the most common, so no need to be exact here.
+    impl->ensureShmCapacity (size_t(width) * height * 4);
+}
+
+bool ScreenGrabber::grabScreenArea (const dl::Rect& screenRect, dl::ImageSRGBA& cpuImage, GLTexture& gpuTexture)
+{
+    if (!grabScreenArea (screenRect, cpuImage))
+        return false;
+
+    // FIXME: is there a reliable way to grab the screenshot directly to a GL texture?
+    // Keep the same texture across grabs, the storage gets reused.
+    if (gpuTexture.textureId() == 0)
+        gpuTexture.initialize ();
+    gpuTexture.upload(cpuImage);
+    return true;
+}
     
 // https://stackoverflow.com/questions/24988164/c-fast-screenshots-in-linux-for-use-with-opencv/39781697
-bool ScreenGrabber::grabScreenArea (const dl::Rect& screenRect, dl::ImageSRGBA& cpuImage, GLTexture& gpuTexture)
+bool ScreenGrabber::grabScreenArea (const dl::Rect& screenRect, dl::ImageSRGBA& cpuImage)
 {
-    // FIXME: is it slow to open/close the display everytime? Could keep it open?
-    Display* display = glfwGetX11Display();
-    if (!display)
+    if (!impl->ensureDisplayOpened ())
         return false;
 
-    Window root = DefaultRootWindow(display);
+    // The SHM content is about to change.
+    impl->releaseLastGrab ();
 
-    XWindowAttributes attributes = {0};
-    XGetWindowAttributes(display, root, &attributes);
+    XImage* shmImage = impl->grabWithShm (screenRect);
+    if (shmImage)
+    {
+        convertXImageToSRGBA (shmImage, cpuImage);
+        return true;
+    }
 
-    XImage* img = XGetImage(display, root, screenRect.origin.x, screenRect.origin.y, screenRect.size.x, screenRect.size.y, AllPlanes, ZPixmap);
+    XImage* img = XGetImage(impl->display, DefaultRootWindow(impl->display), screenRect.origin.x, screenRect.origin.y, screenRect.size.x, screenRect.size.y, AllPlanes, ZPixmap);
     dl_assert (img, "Could not capture the screen");
-    
-    if (img)
+    if (!img)
+        return false;
+
+    convertXImageToSRGBA (img, cpuImage);
+    XDestroyImage(img);
+    return true;
+}
+
+bool ScreenGrabber::grabScreenAreaPreview (const dl::Rect& screenRect, int downsampleFactor,
+                                           dl::ImageSRGBA& previewImage,
+                                           int& fullWidth, int& fullHeight)
+{
+    if (!impl->ensureDisplayOpened ())
+        return false;
+
+    impl->releaseLastGrab ();
+
+    XImage* img = impl->grabWithShm (screenRect);
+    const bool owned = img == nullptr;
+    if (!img)
     {
-        dl_assert (img->bits_per_pixel == 32, "Only RGBA is supported.");
+        img = XGetImage(impl->display, DefaultRootWindow(impl->display), screenRect.origin.x, screenRect.origin.y, screenRect.size.x, screenRect.size.y, AllPlanes, ZPixmap);
+        if (!img)
+            return false;
+    }
 
-        // It's easy to do & xxx_mask but then we need the corresponding bit shift otherwise
-        // it gives a false sense of genericity. Could be done via a trivial lookup table.
-        // But for now let's just assume that these values are accurate often enough to keep
-        // the max performance.
-        dl_assert (img->blue_mask == 0xff, "The code is not generic enough to handle something else properly.");
-        dl_assert (img->green_mask == 0xff00, "The code is not generic enough to handle something else properly.");
-        dl_assert (img->red_mask == 0xff0000, "The code is not generic enough to handle something else properly.");
+    convertPackedPixelsToSRGBADownsampled (reinterpret_cast<const uint8_t*>(img->data), img->bytes_per_line,
+                                           img->width, img->height,
+                                           packedPixelFormatOf (img),
+                                           downsampleFactor,
+                                           previewImage);
+    fullWidth = img->width;
+    fullHeight = img->height;
+    impl->lastGrab.image = img;
+    impl->lastGrab.owned = owned;
+    return true;
+}
+
+bool ScreenGrabber::convertLastGrabArea (const dl::Rect& imageRect, dl::ImageSRGBA& output)
+{
+    const XImage* img = impl->lastGrab.image;
+    if (!img)
+        return false;
+
+    // Same clipping as dl::crop.
+    const int x = std::max (0, int(imageRect.origin.x));
+    const int y = std::max (0, int(imageRect.origin.y));
+    const int width = std::min (img->width - x, int(imageRect.size.x));
+    const int height = std::min (img->height - y, int(imageRect.size.y));
+    if (width <= 0 || height <= 0)
+        return false;
 
-        cpuImage.ensureAllocatedBufferForSize(screenRect.size.x, screenRect.size.y);    
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(img->data)
+                       + size_t(img->bytes_per_line) * y
+                       + size_t(x) * (img->bits_per_pixel / 8);
+    convertPackedPixelsToSRGBA (src, img->bytes_per_line, width, height, packedPixelFormatOf (img), output);
+    return true;
+}
+
+bool ScreenGrabber::liveCaptureIsSupported ()
+{
+    return true;
+}
+
+void ScreenGrabber::startLiveCapture (const dl::Rect& screenRect)
+{
+    stopLiveCapture ();
+
+    if (!impl->ensureDisplayOpened ())
+        return;
+
+    impl->live.active = true;
+    impl->live.screenRect = screenRect;
+    impl->live.needsFullGrab = true;
+    impl->live.lastFullGrabTime = NAN;
+    impl->setupDamage ();
+}
+
+void ScreenGrabber::stopLiveCapture ()
+{
+    impl->releaseDamage ();
+    impl->live.active = false;
+}
+
+bool ScreenGrabber::isLiveCaptureActive () const
+{
+    return impl->live.active;
+}
+
+bool ScreenGrabber::usesSharedMemory () const
+{
+    return impl->shm.usedByLastGrab;
+}
+
+bool ScreenGrabber::updateLiveCapture (dl::ImageSRGBA& cpuArea, GLTexture& gpuTexture, const dl::Rect& excludedScreenRect)
+{
+    std::vector<dl::Rect> updatedRects;
+    if (!updateLiveCapture (cpuArea, updatedRects, excludedScreenRect))
+        return false;
+
+    if (gpuTexture.width() != cpuArea.width() || gpuTexture.height() != cpuArea.height())
+    {
+        gpuTexture.upload (cpuArea);
+        return true;
+    }
 
-        for (int r = 0; r < screenRect.size.y; ++r)
+    for (const auto& r : updatedRects)
+        gpuTexture.uploadSubRect (cpuArea, int(r.origin.x), int(r.origin.y), int(r.size.x), int(r.size.y));
+    return true;
+}
+
+// Appends the parts of r outside of hole, as up to 4 non-overlapping bands.
+static void appendRectMinusHole (const dl::Rect& r, const dl::Rect& hole, std::vector<dl::Rect>& pieces)
+{
+    const dl::Rect inter = r.intersect (hole);
+    if (inter.area() <= 0)
+    {
+        pieces.push_back (r);
+        return;
+    }
+
+    const double x0 = r.origin.x, y0 = r.origin.y, x1 = x0 + r.size.x, y1 = y0 + r.size.y;
+    const double hx0 = inter.origin.x, hy0 = inter.origin.y, hx1 = hx0 + inter.size.x, hy1 = hy0 + inter.size.y;
+    auto appendIfNotEmpty = [&](double px0, double py0, double px1, double py1) {
+        if (px1 > px0 && py1 > py0)
+            pieces.push_back (dl::Rect::from_x_y_w_h (px0, py0, px1 - px0, py1 - py0));
+    };
+    appendIfNotEmpty (x0, y0, x1, hy0); // above
+    appendIfNotEmpty (x0, hy1, x1, y1); // below
+    appendIfNotEmpty (x0, hy0, hx0, hy1); // left
+    appendIfNotEmpty (hx1, hy0, x1, hy1); // right
+}
+
+bool ScreenGrabber::updateLiveCapture (dl::ImageSRGBA& cpuArea, std::vector<dl::Rect>& updatedRects, const dl::Rect& excludedScreenRect)
+{
+    updatedRects.clear ();
+
+    auto& live = impl->live;
+    if (!live.active)
+        return false;
+
+    const dl::Rect& captureRect = live.screenRect;
+    const int width = int(captureRect.size.x);
+    const int height = int(captureRect.size.y);
+
+    if (cpuArea.width() != width || cpuArea.height() != height)
+        live.needsFullGrab = true;
+
+    // The viewer window is over the captured area, grabbing it would
+    // capture its own filtered output. So no path grabs the excluded rect,
+    // only the parts of the area outside of it (in image coordinates).
+    std::vector<dl::Rect> grabbableRegions;
+    const dl::Rect imageRect = dl::Rect::from_x_y_w_h (0, 0, width, height);
+    const bool hasExcludedRect = excludedScreenRect.origin.isValid() && excludedScreenRect.size.isValid();
+    if (hasExcludedRect)
+    {
+        dl::Rect excludedImageRect = excludedScreenRect;
+        excludedImageRect.origin -= captureRect.origin;
+        appendRectMinusHole (imageRect, excludedImageRect, grabbableRegions);
+    }
+    else
+    {
+        grabbableRegions.push_back (imageRect);
+    }
+
+    std::vector<dl::Rect> damagedRects;
+    if (!live.needsFullGrab && !impl->collectDamagedRects (damagedRects))
+    {
+        // No damage tracking, just re-grab everything every now and then.
+        const double minDelayBetweenFullGrabs = 0.1;
+        if (currentDateInSeconds() - live.lastFullGrabTime < minDelayBetweenFullGrabs)
+            return false;
+        live.needsFullGrab = true;
+    }
+
+    std::vector<dl::Rect> rectsToGrab;
+    if (live.needsFullGrab)
+    {
+        // The excluded part keeps its previous content, or stays black
+        // after a resize.
+        if (cpuArea.width() != width || cpuArea.height() != height)
         {
-            const uint32_t* srcRowPtr = reinterpret_cast<const uint32_t*>(img->data + img->bytes_per_line*r);
-            PixelSRGBA* dstRowPtr = cpuImage.atRowPtr(r);
-            const PixelSRGBA* lastDstRowPtr = cpuImage.atRowPtr(r + 1);
-            while (dstRowPtr < lastDstRowPtr)
+            cpuArea.ensureAllocatedBufferForSize (width, height);
+            cpuArea.fill (dl::PixelSRGBA(0, 0, 0, 255));
+        }
+        rectsToGrab = grabbableRegions;
+        live.needsFullGrab = false;
+        live.lastFullGrabTime = currentDateInSeconds();
+    }
+    else
+    {
+        // Switch to image coordinates. The damage was already subtracted
+        // from the server, so everything outside of the excluded rect
+        // needs to be grabbed now.
+        for (auto& r : damagedRects)
+            r.origin -= captureRect.origin;
+
+        // Each grab is a round-trip to the server, so when the damage is
+        // fragmented or covers most of a region a single bigger grab is
+        // faster. The bounding box stays within the region, so it can't
+        // cover the excluded rect.
+        const size_t maxRectsToGrabPerRegion = 4;
+        std::vector<dl::Rect> rectsInRegion;
+        for (const auto& region : grabbableRegions)
+        {
+            rectsInRegion.clear ();
+            dl::Rect boundingBox;
+            double damagedArea = 0;
+            for (const auto& damagedRect : damagedRects)
             {
-                dstRowPtr->b = (*srcRowPtr & 0xff);
-                dstRowPtr->g = (*srcRowPtr & 0xff00) >> 8;
-                dstRowPtr->r = (*srcRowPtr & 0xff0000) >> 16;
-                dstRowPtr->a = 255;
-                ++srcRowPtr;
-                ++dstRowPtr;
+                const dl::Rect r = damagedRect.intersect (region);
+                if (r.area() <= 0)
+                    continue;
+
+                if (rectsInRegion.empty())
+                {
+                    boundingBox = r;
+                }
+                else
+                {
+                    const double x1 = std::max (boundingBox.origin.x + boundingBox.size.x, r.origin.x + r.size.x);
+                    const double y1 = std::max (boundingBox.origin.y + boundingBox.size.y, r.origin.y + r.size.y);
+                    boundingBox.origin.x = std::min (boundingBox.origin.x, r.origin.x);
+                    boundingBox.origin.y = std::min (boundingBox.origin.y, r.origin.y);
+                    boundingBox.size.x = x1 - boundingBox.origin.x;
+                    boundingBox.size.y = y1 - boundingBox.origin.y;
+                }
+                rectsInRegion.push_back (r);
+                damagedArea += r.area();
             }
+
+            if (rectsInRegion.size() > maxRectsToGrabPerRegion || damagedArea > 0.5 * region.area())
+                rectsToGrab.push_back (boundingBox);
+            else
+                rectsToGrab.insert (rectsToGrab.end(), rectsInRegion.begin(), rectsInRegion.end());
         }
+    }
 
-        // FIXME: is there a reliable way to grab the screenshot directly to a GL texture?
-        gpuTexture.initialize ();
-        gpuTexture.upload(cpuImage);
+    if (rectsToGrab.empty())
+        return false;
 
-        XDestroyImage(img);
+    for (const auto& r : rectsToGrab)
+    {
+        const int x = int(r.origin.x);
+        const int y = int(r.origin.y);
+        const int w = int(r.size.x);
+        const int h = int(r.size.y);
+
+        // Grab directly into the persistent image.
+        dl::ImageSRGBA subImage (reinterpret_cast<uint8_t*>(cpuArea.atRowPtr(y) + x),
+                                 w, h, int(cpuArea.bytesPerRow()),
+                                 dl::ImageSRGBA::noopReleaseFunc());
+        const dl::Rect subScreenRect = dl::Rect::from_x_y_w_h (captureRect.origin.x + x, captureRect.origin.y + y, w, h);
+        if (!grabScreenArea (subScreenRect, subImage))
+            return false;
+
+        updatedRects.push_back (r);
     }
-     
-    return img != nullptr;
+    return true;
 }
 
-
-
-struct WindowUnderPointerFinder
+// Keeps a local copy of the window tree, updated from the X events, so that
+// finding the window under the pointer is a local hit test instead of
+// several round trips per window. It uses its own connection to get the
+// events without interfering with GLFW.
+class WindowUnderPointerFinder
 {
+public:
     WindowUnderPointerFinder ()
     {
-        display = glfwGetX11Display();
+        display = XOpenDisplay (nullptr);
+        if (!display)
+            return;
+
         root = DefaultRootWindow(display);
         atom_wmstate = XInternAtom(display, "WM_STATE", False);
+        atom_netwmpid = XInternAtom(display, "_NET_WM_PID", False);
+        atom_netwmname = XInternAtom(display, "_NET_WM_NAME", False);
         daltonLens_pid = getpid();
+
+        // Windows can get destroyed while we query them.
+        ScopedXErrorTrap errorTrap;
+        addWindowRecursively (root, None);
+        XSync (display, False);
     }
 
     ~WindowUnderPointerFinder ()
     {
+        if (display)
+            XCloseDisplay (display);
     }
 
-    struct WindowInfo
+    // The events are only selected while the finder exists, and need to
+    // get drained regularly or they would pile up in the queue.
+    void processPendingEvents ()
     {
-        Window w = 0;
-        dl::Rect rect;
-        std::string name;
-    };
+        if (!display || XPending (display) == 0)
+            return;
+
+        ScopedXErrorTrap errorTrap;
+
+        while (XPending (display) > 0)
+        {
+            XEvent ev;
+            XNextEvent (display, &ev);
+            processEvent (ev);
+        }
+
+        XSync (display, False);
+    }
 
     dl::Rect findWindowGeometryUnderPointer ()
     {
+        if (!display)
+            return dl::Rect();
+
+        processPendingEvents ();
+
         Window root_return = 0;
         Window child_return = 0;
         int root_x_return = 0, root_y_return = 0, win_x_return = 0, win_y_return = 0;
@@ -260,107 +1112,306 @@ struct WindowUnderPointerFinder
             return dl::Rect();
         }
 
-        std::vector<WindowInfo> acc; acc.reserve (256);
-        dl::Point pointer (win_x_return, win_y_return);
-        appendCompatibleChildren (acc, root, pointer);
-        if (acc.empty())
+        dl::Rect frontMostRect;
+        const dl::Point pointer (win_x_return, win_y_return);
+        findFrontMostCandidate (root, dl::Point(0,0), dl::Rect(), pointer, frontMostRect);
+        if (frontMostRect.origin.isValid() && frontMostRect.size.isValid() && frontMostRect.area() > 0)
         {
-            return dl::Rect();
-        }
-
-        WindowInfo frontMost = acc.back();
-
-        if (frontMost.rect.area() > 0)
-        {
-            return frontMost.rect;
+            return frontMostRect;
         }
 
         return dl::Rect();
     }
 
-    void appendCompatibleChildren(std::vector<WindowInfo> &acc, Window parent, const dl::Point& pointer)
+private:
+    struct Node
+    {
+        Window parent = None;
+        // Stacking order, bottom to top, like XQueryTree.
+        std::vector<Window> children;
+        // Relative to the parent, like XWindowAttributes.
+        int x = 0, y = 0;
+        int width = 0, height = 0;
+        int borderWidth = 0;
+        bool mapped = false;
+        // Client window with WM_STATE and a name, not belonging to DaltonLens.
+        bool isCandidate = false;
+    };
+
+    // Returns false if the window does not exist anymore.
+    bool addWindowRecursively (Window w, Window parent)
     {
+        // Select the events before querying the children so that
+        // none gets created without us knowing about it.
+        XSelectInput (display, w, w == root ? SubstructureNotifyMask : (SubstructureNotifyMask | PropertyChangeMask));
+
+        Node& node = nodes[w];
+        node.parent = parent;
+        node.children.clear ();
+        if (w != root)
+        {
+            XWindowAttributes attributes;
+            if (!XGetWindowAttributes(display, w, &attributes))
+            {
+                nodes.erase (w);
+                return false;
+            }
+            node.x = attributes.x;
+            node.y = attributes.y;
+            node.width = attributes.width;
+            node.height = attributes.height;
+            node.borderWidth = attributes.border_width;
+            node.mapped = attributes.map_state != IsUnmapped;
+            updateCandidate (w, node);
+        }
+        else
+        {
+            node.mapped = true;
+        }
+
         Window root_return = 0;
         Window parent_return = 0;
         unsigned int numChildren = 0;
         Window *children = nullptr;
-        XQueryTree(display, parent, &root_return, &parent_return, &children, &numChildren);
+        if (!XQueryTree(display, w, &root_return, &parent_return, &children, &numChildren))
+            return w == root;
 
         for (int i = 0; i < numChildren; ++i)
         {
-            Window child = children[i];
-
-            XWindowAttributes attributes;
-            XGetWindowAttributes(display, parent, &attributes);
-            if (attributes.map_state != IsViewable)
+            // The events selected above may already have added it.
+            if (nodes.count (children[i]))
                 continue;
 
-            dl::Rect rect = dlRectFromAttributes (attributes, parent);
-            if (!rect.contains(pointer))
-                continue;
+            if (addWindowRecursively (children[i], w))
+                node.children.push_back (children[i]);
+        }
 
-            long items = 0;
-            xdo_get_window_property_by_atom(display, child, atom_wmstate, &items, NULL, NULL);
+        XFree(children);
+        return true;
+    }
+
+    void removeWindowRecursively (Window w)
+    {
+        auto it = nodes.find (w);
+        if (it == nodes.end())
+            return;
+
+        detachFromParent (w, it->second);
+        const std::vector<Window> children = std::move(it->second.children);
+        nodes.erase (it);
+        for (Window child : children)
+        {
+            nodes[child].parent = None;
+            removeWindowRecursively (child);
+        }
+    }
 
-            if (items > 0)
+    void detachFromParent (Window w, Node& node)
+    {
+        auto parentIt = nodes.find (node.parent);
+        if (parentIt == nodes.end())
+            return;
+
+        auto& siblings = parentIt->second.children;
+        siblings.erase (std::remove (siblings.begin(), siblings.end(), w), siblings.end());
+    }
+
+    // Puts the window just above the given sibling, or at the bottom if None.
+    void restack (Window w, Node& node, Window above)
+    {
+        auto parentIt = nodes.find (node.parent);
+        if (parentIt == nodes.end())
+            return;
+
+        auto& siblings = parentIt->second.children;
+        siblings.erase (std::remove (siblings.begin(), siblings.end(), w), siblings.end());
+        auto aboveIt = std::find (siblings.begin(), siblings.end(), above);
+        if (aboveIt == siblings.end())
+            siblings.insert (siblings.begin(), w);
+        else
+            siblings.insert (aboveIt + 1, w);
+    }
+
+    void updateCandidate (Window w, Node& node)
+    {
+        node.isCandidate = false;
+
+        long items = 0;
+        unsigned char* wmState = xdo_get_window_property_by_atom(display, w, atom_wmstate, &items, NULL, NULL);
+        if (wmState)
+            XFree (wmState);
+        if (items == 0)
+            return;
+
+        const int window_pid = xdo_get_pid_window (display, w);
+        if (window_pid == daltonLens_pid)
+            return;
+
+        unsigned char* name_ret = nullptr;
+        int name_len_ret = 0;
+        int name_type = 0;
+        xdo_get_window_name(display, w, &name_ret, &name_len_ret, &name_type);
+        if (name_ret)
+        {
+            node.isCandidate = true;
+            XFree (name_ret);
+        }
+    }
+
+    void processEvent (const XEvent& ev)
+    {
+        switch (ev.type)
+        {
+            case CreateNotify:
             {
-                const int window_pid = xdo_get_pid_window (display, child);
-                if (window_pid == daltonLens_pid)
-                {
-                    dl_dbg("Discarding window with PID (%d)", window_pid);
-                    continue;
-                }
+                const XCreateWindowEvent& e = ev.xcreatewindow;
+                if (nodes.count (e.window) || !nodes.count (e.parent))
+                    break;
+                // New windows are on top of their siblings.
+                if (addWindowRecursively (e.window, e.parent))
+                    nodes[e.parent].children.push_back (e.window);
+                break;
+            }
 
-                unsigned char* name_ret_unsigned = nullptr;
-                int name_len_ret = 0;
-                int name_type = 0;
-                xdo_get_window_name(display,
-                                    child,
-                                    &name_ret_unsigned,
-                                    &name_len_ret,
-                                    &name_type);
-                char* name_ret = reinterpret_cast<char*>(name_ret_unsigned);             
-
-                if (name_ret)
+            case DestroyNotify:
+            {
+                removeWindowRecursively (ev.xdestroywindow.window);
+                break;
+            }
+
+            case ReparentNotify:
+            {
+                const XReparentEvent& e = ev.xreparent;
+                auto it = nodes.find (e.window);
+                if (it == nodes.end() || it->second.parent == e.parent)
+                    break;
+
+                // Received from both the old and the new parent.
+                detachFromParent (e.window, it->second);
+                auto newParentIt = nodes.find (e.parent);
+                if (newParentIt == nodes.end())
                 {
-                    WindowInfo info;
-                    info.w = child;
-                    info.rect = rect;
-                    info.name = std::string(name_ret);
-                    acc.push_back (info);
+                    removeWindowRecursively (e.window);
+                    break;
                 }
+                it->second.parent = e.parent;
+                it->second.x = e.x;
+                it->second.y = e.y;
+                newParentIt->second.children.push_back (e.window);
+                break;
+            }
 
-                XFree(name_ret);
+            case ConfigureNotify:
+            {
+                const XConfigureEvent& e = ev.xconfigure;
+                auto it = nodes.find (e.window);
+                if (it == nodes.end())
+                    break;
+                Node& node = it->second;
+                node.x = e.x;
+                node.y = e.y;
+                node.width = e.width;
+                node.height = e.height;
+                node.borderWidth = e.border_width;
+                restack (e.window, node, e.above);
+                break;
             }
 
-            appendCompatibleChildren (acc, child, pointer);
-        }
+            case CirculateNotify:
+            {
+                const XCirculateEvent& e = ev.xcirculate;
+                auto it = nodes.find (e.window);
+                if (it == nodes.end())
+                    break;
+                auto parentIt = nodes.find (it->second.parent);
+                if (parentIt == nodes.end())
+                    break;
+                auto& siblings = parentIt->second.children;
+                siblings.erase (std::remove (siblings.begin(), siblings.end(), e.window), siblings.end());
+                if (e.place == PlaceOnTop)
+                    siblings.push_back (e.window);
+                else
+                    siblings.insert (siblings.begin(), e.window);
+                break;
+            }
 
-        XFree(children);
+            case MapNotify:
+            case UnmapNotify:
+            {
+                const Window w = ev.type == MapNotify ? ev.xmap.window : ev.xunmap.window;
+                auto it = nodes.find (w);
+                if (it != nodes.end())
+                    it->second.mapped = ev.type == MapNotify;
+                break;
+            }
+
+            case PropertyNotify:
+            {
+                const XPropertyEvent& e = ev.xproperty;
+                if (e.atom != atom_wmstate && e.atom != atom_netwmpid
+                    && e.atom != XA_WM_NAME && e.atom != atom_netwmname)
+                    break;
+                auto it = nodes.find (e.window);
+                if (it != nodes.end())
+                    updateCandidate (e.window, it->second);
+                break;
+            }
+
+            default:
+                break;
+        }
     }
 
-    dl::Rect dlRectFromAttributes(const XWindowAttributes &attributes, Window parent) const
+    // Children are visited bottom to top, so the last candidate found is the frontmost.
+    void findFrontMostCandidate (Window w,
+                                 const dl::Point& parentOrigin,
+                                 const dl::Rect& parentRect,
+                                 const dl::Point& pointer,
+                                 dl::Rect& frontMostRect) const
     {
-        int x = attributes.x, y = attributes.y;
-        if (parent != root)
+        auto it = nodes.find (w);
+        if (it == nodes.end())
+            return;
+
+        const Node& node = it->second;
+        if (!node.mapped)
+            return;
+
+        dl::Point origin (0, 0);
+        dl::Rect rect;
+        if (w == root)
+        {
+            rect = dl::Rect::from_x_y_w_h (0, 0, INT_MAX, INT_MAX);
+        }
+        else
         {
-            Window unused_child;
-            XTranslateCoordinates(display, parent, root,
-                                  0, 0, &x, &y, &unused_child);
+            origin = dl::Point (parentOrigin.x + node.x + node.borderWidth,
+                                parentOrigin.y + node.y + node.borderWidth);
+            rect = dl::Rect::from_x_y_w_h (origin.x, origin.y, node.width, node.height);
+            // Children are clipped by their parent.
+            if (!rect.contains (pointer))
+                return;
+
+            if (node.isCandidate)
+            {
+                // Reparenting window managers put the clients into a frame,
+                // use it to include the decorations.
+                frontMostRect = node.parent == root ? rect : parentRect;
+            }
         }
 
-        dl::Rect rect;
-        rect.origin.x = x;
-        rect.origin.y = y;
-        rect.size.x = attributes.width;
-        rect.size.y = attributes.height;
-        return rect;
+        for (Window child : node.children)
+            findFrontMostCandidate (child, origin, rect, pointer, frontMostRect);
     }
 
+private:
     Display *display = nullptr;
     Window root = 0;
-    Atom atom_wmstate;
+    Atom atom_wmstate = None;
+    Atom atom_netwmpid = None;
+    Atom atom_netwmname = None;
     pid_t daltonLens_pid = 0;
+    std::unordered_map<Window, Node> nodes;
 };
 
 dl::Rect getFrontWindowGeometry(GLFWwindow* grabWindowHandle)
@@ -369,6 +1420,32 @@ dl::Rect getFrontWindowGeometry(GLFWwindow* grabWindowHandle)
     return finder.findWindowGeometryUnderPointer ();
 }
 
+struct FrontWindowFinder::Impl
+{
+    // Created on the first lookup, it then only needs to process the events.
+    std::unique_ptr<WindowUnderPointerFinder> finder;
+};
+
+FrontWindowFinder::FrontWindowFinder ()
+: impl (new Impl())
+{
+}
+
+FrontWindowFinder::~FrontWindowFinder () = default;
+
+void FrontWindowFinder::update ()
+{
+    if (impl->finder)
+        impl->finder->processPendingEvents ();
+}
+
+dl::Rect FrontWindowFinder::frontWindowGeometry (GLFWwindow* grabWindowHandle)
+{
+    if (!impl->finder)
+        impl->finder = std::make_unique<WindowUnderPointerFinder> ();
+    return impl->finder->findWindowGeometryUnderPointer ();
+}
+
 } // dl
 
 namespace dl
@@ -379,6 +1456,17 @@ void setAppFocusEnabled (bool enabled)
     // NSApp.activationPolicy = enabled ? NSApplicationActivationPolicyRegular : NSApplicationActivationPolicyAccessory;
 }
 
+int getWindowSystemFileDescriptor ()
+{
+    Display* display = glfwGetX11Display ();
+    return display ? ConnectionNumber (display) : -1;
+}
+
+bool checkScreenCapturePermission ()
+{
+    return true;
+}
+
 dl::Point getMouseCursor()
 {
     // NSPoint mousePos = [NSEvent mouseLocation];
@@ -415,6 +1503,31 @@ void getVersionAndBuildNumber(std::string& version, std::string& build)
     build = PROJECT_VERSION_COMMIT;
 }
 
+std::string getUserCacheDirectory (const std::string& subFolder)
+{
+    // https://specifications.freedesktop.org/basedir-spec/basedir-spec-latest.html
+    std::string path;
+    const char* xdgCacheHome = getenv ("XDG_CACHE_HOME");
+    const char* home = getenv ("HOME");
+    if (xdgCacheHome && *xdgCacheHome)
+        path = xdgCacheHome;
+    else if (home && *home)
+        path = std::string(home) + "/.cache";
+    else
+        return std::string();
+
+    path += "/DaltonLens/" + subFolder;
+    for (size_t pos = path.find ('/', 1); ; pos = path.find ('/', pos + 1))
+    {
+        const std::string parent = path.substr (0, pos);
+        if (mkdir (parent.c_str(), 0700) != 0 && errno != EEXIST)
+            return std::string();
+        if (pos == std::string::npos)
+            break;
+    }
+    return path;
+}
+
 // --------------------------------------------------------------------------------
 // StartupManager
 // --------------------------------------------------------------------------------
@@ -7,6 +7,8 @@
 #include "PlatformSpecific.h"
 
 #include <Dalton/Utils.h>
+#include <Dalton/OpenGL.h>
+#include <Dalton/PixelConversion.h>
 
 #import <Foundation/Foundation.h>
 #import <AppKit/AppKit.h>
@@ -27,6 +29,7 @@ struct DisplayLinkTimer::Impl
 {
     NSTimer* timer = nil;
     std::function<void(void)> callback = nullptr;
+    bool paused = false;
 };
 
 DisplayLinkTimer::DisplayLinkTimer ()
@@ -47,11 +50,30 @@ void DisplayLinkTimer::setCallback (const std::function<void(void)>& callback)
     impl->callback = callback;
     
     impl->timer = [NSTimer scheduledTimerWithTimeInterval:1/60. repeats:YES block:^(NSTimer * _Nonnull timer) {
-       if (impl->callback)
+       if (impl->callback && !impl->paused)
            impl->callback();
     }];
 }
 
+void DisplayLinkTimer::setPaused (bool paused)
+{
+    impl->paused = paused;
+}
+
+void DisplayLinkTimer::setPresentingWindow (GLFWwindow* window)
+{
+}
+
+int DisplayLinkTimer::fileDescriptor () const
+{
+    return -1;
+}
+
+void DisplayLinkTimer::runOnce ()
+{
+    // do nothing, driven by the NSTimer.
+}
+
 } // dl
 
 namespace dl
@@ -110,6 +132,11 @@ void KeyboardMonitor::runOnce ()
     // do nothing, callback based on macOS
 }
 
+int KeyboardMonitor::eventFileDescriptor () const
+{
+    return -1;
+}
+
 } // dl
 
 namespace dl
@@ -117,9 +144,18 @@ namespace dl
 
 struct ScreenGrabber::Impl
 {
+    // No damage tracking here, live capture just re-grabs everything at a reduced rate.
+    struct {
+        bool active = false;
+        dl::Rect screenRect;
+        double lastGrabTime = NAN;
+    } live;
+
     CGContextRef cgContext = nullptr;
     int cgContextWidth = -1;
     int cgContextHeight = -1;
+    // The context has the raw pixels of a preview grab, see convertLastGrabArea.
+    bool contextHasPreviewGrab = false;
     
     ~Impl()
     {
@@ -135,6 +171,36 @@ struct ScreenGrabber::Impl
         }
     }
     
+    // RGBX, as created by createARGBBitmapContext.
+    static PackedPixelFormat contextPixelFormat ()
+    {
+        PackedPixelFormat format;
+        format.redMask = 0xff;
+        format.greenMask = 0xff00;
+        format.blueMask = 0xff0000;
+        return format;
+    }
+
+    // The result is in cgContext.
+    bool grabToContext (const dl::Rect& screenRect)
+    {
+        CGRect cgRect = CGRectMake(screenRect.origin.x, screenRect.origin.y, screenRect.size.x, screenRect.size.y);
+        CGImage* cgImage = CGWindowListCreateImage(cgRect, kCGWindowListOptionOnScreenOnly, kCGNullWindowID, kCGWindowImageDefault);
+        if (cgImage == nullptr)
+        {
+            return false;
+        }
+
+        // The image can be larger than screenRect on retina displays.
+        const int imageWidth = (int)CGImageGetWidth(cgImage);
+        const int imageHeight = (int)CGImageGetHeight(cgImage);
+        ensureCGContextCreatedForSize (imageWidth, imageHeight);
+
+        CGContextDrawImage(cgContext, CGRectMake(0, 0, imageWidth, imageHeight), cgImage);
+        CGImageRelease (cgImage);
+        return true;
+    }
+
     void ensureCGContextCreatedForSize (int width, int height)
     {
         if (this->cgContextWidth != width || this->cgContextHeight != height)
@@ -197,6 +263,11 @@ ScreenGrabber::ScreenGrabber ()
 ScreenGrabber::~ScreenGrabber ()
 {
 }
+
+void ScreenGrabber::reserveForSize (int width, int height)
+{
+    // Nothing to pre-allocate here.
+}
     
 // From https://stackoverflow.com/a/58786245/1737680
 BOOL canRecordScreen ()
@@ -256,37 +327,103 @@ BOOL canRecordScreen ()
     return canRecordScreen;
 }
 
+bool checkScreenCapturePermission ()
+{
+    if (canRecordScreen())
+        return true;
+
+    NSTextView *accessory = [[NSTextView alloc] initWithFrame:NSMakeRect(0,0,200,15)];
+    NSString* msg = @"DaltonLens needs to capture your screen to apply color filters.\n\n"
+                    "To give it permission you need to enable the DaltonLens app in "
+                    "System Preferences / Security & Privacy / Screen Recording.\n\n"
+                    "If this is the first time that you see this dialog, a macOS"
+                    " prompt will propose to take you there directly once you click on OK.";
+    NSFont *font = [NSFont systemFontOfSize:[NSFont systemFontSize]];
+    NSDictionary *textAttributes = [NSDictionary dictionaryWithObject:font forKey:NSFontAttributeName];
+    [accessory insertText:[[NSAttributedString alloc] initWithString:msg attributes:textAttributes]];
+    [accessory setEditable:NO];
+    [accessory setDrawsBackground:NO];
+    accessory.alignment = NSTextAlignmentJustified;
+    
+    NSAlert* alert = [NSAlert new];
+    [alert setMessageText: @"Screen recording permission required."];
+    [alert setAlertStyle:NSAlertStyleCritical];
+    alert.accessoryView = accessory;
+    [alert runModal];
+    
+    // Make sure we'll trigger a prompt.
+    CGImage* cgImage = CGWindowListCreateImage(CGRectMake(0, 0, 1, 1), kCGWindowListOptionOnScreenOnly, kCGNullWindowID, kCGWindowImageDefault);
+    CGImageRelease (cgImage);
+    
+    return false;
+}
+
+bool ScreenGrabber::liveCaptureIsSupported ()
+{
+    // The full re-grabs would include the viewer window.
+    return false;
+}
+
+void ScreenGrabber::startLiveCapture (const dl::Rect& screenRect)
+{
+    impl->live.active = true;
+    impl->live.screenRect = screenRect;
+    impl->live.lastGrabTime = NAN;
+}
+
+void ScreenGrabber::stopLiveCapture ()
+{
+    impl->live.active = false;
+}
+
+bool ScreenGrabber::isLiveCaptureActive () const
+{
+    return impl->live.active;
+}
+
+bool ScreenGrabber::usesSharedMemory () const
+{
+    return false;
+}
+
+bool ScreenGrabber::updateLiveCapture (dl::ImageSRGBA& cpuArea, GLTexture& gpuTexture, const dl::Rect& excludedScreenRect)
+{
+    std::vector<dl::Rect> updatedRects;
+    if (!updateLiveCapture (cpuArea, updatedRects, excludedScreenRect))
+        return false;
+
+    if (gpuTexture.width() == cpuArea.width() && gpuTexture.height() == cpuArea.height())
+        gpuTexture.uploadSubRect (cpuArea, 0, 0, cpuArea.width(), cpuArea.height());
+    else
+        gpuTexture.upload (cpuArea);
+    return true;
+}
+
+bool ScreenGrabber::updateLiveCapture (dl::ImageSRGBA& cpuArea, std::vector<dl::Rect>& updatedRects, const dl::Rect& excludedScreenRect)
+{
+    updatedRects.clear ();
+    if (!impl->live.active)
+        return false;
+
+    const double minDelayBetweenGrabs = 0.1;
+    const double now = currentDateInSeconds();
+    if (now - impl->live.lastGrabTime < minDelayBetweenGrabs)
+        return false;
+
+    if (!grabScreenArea (impl->live.screenRect, cpuArea))
+        return false;
+
+    impl->live.lastGrabTime = now;
+    updatedRects.push_back (dl::Rect::from_x_y_w_h (0, 0, cpuArea.width(), cpuArea.height()));
+    return true;
+}
+
 bool ScreenGrabber::grabScreenArea (const dl::Rect& screenRect, dl::ImageSRGBA& cpuImage, GLTexture& gpuTexture)
 {
     CGRect cgRect = CGRectMake(screenRect.origin.x, screenRect.origin.y, screenRect.size.x, screenRect.size.y);
 
-    if (!canRecordScreen())
-    {
-        NSTextView *accessory = [[NSTextView alloc] initWithFrame:NSMakeRect(0,0,200,15)];
-        NSString* msg = @"DaltonLens needs to capture your screen to apply color filters.\n\n"
-                        "To give it permission you need to enable the DaltonLens app in "
-                        "System Preferences / Security & Privacy / Screen Recording.\n\n"
-                        "If this is the first time that you see this dialog, a macOS"
-                        " prompt will propose to take you there directly once you click on OK.";
-        NSFont *font = [NSFont systemFontOfSize:[NSFont systemFontSize]];
-        NSDictionary *textAttributes = [NSDictionary dictionaryWithObject:font forKey:NSFontAttributeName];
-        [accessory insertText:[[NSAttributedString alloc] initWithString:msg attributes:textAttributes]];
-        [accessory setEditable:NO];
-        [accessory setDrawsBackground:NO];
-        accessory.alignment = NSTextAlignmentJustified;
-        
-        NSAlert* alert = [NSAlert new];
-        [alert setMessageText: @"Screen recording permission required."];
-        [alert setAlertStyle:NSAlertStyleCritical];
-        alert.accessoryView = accessory;
-        [alert runModal];
-        
-        // Make sure we'll trigger a prompt.
-        CGImage* cgImage = CGWindowListCreateImage(cgRect, kCGWindowListOptionOnScreenOnly, kCGNullWindowID, kCGWindowImageDefault);
-        CGImageRelease (cgImage);
-    
+    if (!checkScreenCapturePermission())
         return false;
-    }
     
     CGImage* cgImage = CGWindowListCreateImage(cgRect, kCGWindowListOptionOnScreenOnly, kCGNullWindowID, kCGWindowImageDefault);
     if (cgImage == nullptr)
@@ -302,6 +439,7 @@ bool ScreenGrabber::grabScreenArea (const dl::Rect& screenRect, dl::ImageSRGBA&
     // So we need to get it from the texture to avoid losing resolution.
     const int imageWidth = textureInfo.width;
     const int imageHeight = textureInfo.height;
+    impl->contextHasPreviewGrab = false;
     impl->ensureCGContextCreatedForSize (imageWidth, imageHeight);
     
     CGContextDrawImage(impl->cgContext, CGRectMake(0, 0, imageWidth, imageHeight), cgImage);
@@ -318,6 +456,68 @@ bool ScreenGrabber::grabScreenArea (const dl::Rect& screenRect, dl::ImageSRGBA&
     return true;
 }
 
+bool ScreenGrabber::grabScreenArea (const dl::Rect& screenRect, dl::ImageSRGBA& cpuImage)
+{
+    // No permission dialog here, this can get called from a background thread.
+    if (!canRecordScreen())
+        return false;
+    
+    impl->contextHasPreviewGrab = false;
+    if (!impl->grabToContext (screenRect))
+        return false;
+    
+    uint8_t* imageBuffer = (uint8_t*)CGBitmapContextGetData(impl->cgContext);
+    
+    cpuImage.ensureAllocatedBufferForSize (impl->cgContextWidth, impl->cgContextHeight);
+    cpuImage.copyDataFrom(imageBuffer,
+                         (int)CGBitmapContextGetBytesPerRow(impl->cgContext),
+                         (int)CGBitmapContextGetWidth(impl->cgContext),
+                         (int)CGBitmapContextGetHeight(impl->cgContext));
+    return true;
+}
+
+bool ScreenGrabber::grabScreenAreaPreview (const dl::Rect& screenRect, int downsampleFactor,
+                                           dl::ImageSRGBA& previewImage,
+                                           int& fullWidth, int& fullHeight)
+{
+    if (!canRecordScreen())
+        return false;
+
+    impl->contextHasPreviewGrab = false;
+    if (!impl->grabToContext (screenRect))
+        return false;
+
+    convertPackedPixelsToSRGBADownsampled ((const uint8_t*)CGBitmapContextGetData(impl->cgContext),
+                                           (int)CGBitmapContextGetBytesPerRow(impl->cgContext),
+                                           impl->cgContextWidth, impl->cgContextHeight,
+                                           Impl::contextPixelFormat (),
+                                           downsampleFactor,
+                                           previewImage);
+    fullWidth = impl->cgContextWidth;
+    fullHeight = impl->cgContextHeight;
+    impl->contextHasPreviewGrab = true;
+    return true;
+}
+
+bool ScreenGrabber::convertLastGrabArea (const dl::Rect& imageRect, dl::ImageSRGBA& output)
+{
+    if (!impl->contextHasPreviewGrab)
+        return false;
+
+    // Same clipping as dl::crop.
+    const int x = std::max (0, int(imageRect.origin.x));
+    const int y = std::max (0, int(imageRect.origin.y));
+    const int width = std::min (impl->cgContextWidth - x, int(imageRect.size.x));
+    const int height = std::min (impl->cgContextHeight - y, int(imageRect.size.y));
+    if (width <= 0 || height <= 0)
+        return false;
+
+    const int bytesPerRow = (int)CGBitmapContextGetBytesPerRow(impl->cgContext);
+    const uint8_t* src = (const uint8_t*)CGBitmapContextGetData(impl->cgContext) + size_t(bytesPerRow) * y + size_t(x) * 4;
+    convertPackedPixelsToSRGBA (src, bytesPerRow, width, height, Impl::contextPixelFormat (), output);
+    return true;
+}
+
 dl::Rect getFrontWindowGeometry(GLFWwindow* grabWindowHandle)
 {
     dl::Rect output;
@@ -381,6 +581,27 @@ dl::Rect getFrontWindowGeometry(GLFWwindow* grabWindowHandle)
     return output;
 }
 
+// Nothing to keep across lookups.
+struct FrontWindowFinder::Impl
+{
+};
+
+FrontWindowFinder::FrontWindowFinder ()
+: impl (new Impl())
+{
+}
+
+FrontWindowFinder::~FrontWindowFinder () = default;
+
+void FrontWindowFinder::update ()
+{
+}
+
+dl::Rect FrontWindowFinder::frontWindowGeometry (GLFWwindow* grabWindowHandle)
+{
+    return getFrontWindowGeometry (grabWindowHandle);
+}
+
 } // dl
 
 namespace dl
@@ -391,6 +612,11 @@ void setAppFocusEnabled (bool enabled)
     NSApp.activationPolicy = enabled ? NSApplicationActivationPolicyRegular : NSApplicationActivationPolicyAccessory;
 }
 
+int getWindowSystemFileDescriptor ()
+{
+    return -1;
+}
+
 dl::Point getMouseCursor()
 {
     NSPoint mousePos = [NSEvent mouseLocation];
@@ -421,4 +647,18 @@ void getVersionAndBuildNumber(std::string& version, std::string& build)
     build = [buildNumber UTF8String];
 }
 
+std::string getUserCacheDirectory (const std::string& subFolder)
+{
+    NSArray<NSURL*>* urls = [[NSFileManager defaultManager] URLsForDirectory:NSCachesDirectory inDomains:NSUserDomainMask];
+    if (urls.count == 0)
+        return std::string();
+
+    NSString* bundleId = [[NSBundle mainBundle] bundleIdentifier];
+    NSURL* url = [urls[0] URLByAppendingPathComponent:(bundleId ? bundleId : @"DaltonLens")];
+    url = [url URLByAppendingPathComponent:[NSString stringWithUTF8String:subFolder.c_str()]];
+    if (![[NSFileManager defaultManager] createDirectoryAtURL:url withIntermediateDirectories:YES attributes:nil error:nil])
+        return std::string();
+    return std::string(url.path.UTF8String);
+}
+
 } // dl
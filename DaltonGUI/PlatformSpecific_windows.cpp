@@ -10,6 +10,7 @@
 
 #include <Dalton/Utils.h>
 #include <Dalton/OpenGL.h>
+#include <Dalton/PixelConversion.h>
 
 #include "DaltonGeneratedConfig.h"
 
@@ -17,6 +18,8 @@
 #define GLFW_EXPOSE_NATIVE_WIN32 1
 #include <GLFW/glfw3native.h>
 
+#include <shlobj.h>
+
 #include <thread>
 #include <mutex>
 #include <atomic>
@@ -43,6 +46,23 @@ void DisplayLinkTimer::setCallback (const std::function<void(void)>& callback)
     dl_assert (false, "not implemented");
 }
 
+void DisplayLinkTimer::setPaused (bool paused)
+{
+}
+
+void DisplayLinkTimer::setPresentingWindow (GLFWwindow* window)
+{
+}
+
+int DisplayLinkTimer::fileDescriptor () const
+{
+    return -1;
+}
+
+void DisplayLinkTimer::runOnce ()
+{
+}
+
 } // dl
 
 namespace dl
@@ -116,6 +136,11 @@ void KeyboardMonitor::runOnce ()
     }
 }
 
+int KeyboardMonitor::eventFileDescriptor () const
+{
+    return -1;
+}
+
 } // dl
 
 namespace dl
@@ -123,6 +148,17 @@ namespace dl
 
 struct ScreenGrabber::Impl
 {
+    // No damage tracking here, live capture just re-grabs everything at a reduced rate.
+    struct {
+        bool active = false;
+        dl::Rect screenRect;
+        double lastGrabTime = NAN;
+    } live;
+
+    // GDI does not give us the raw pixels for longer than a grab, so the
+    // preview keeps the converted full resolution image around.
+    dl::ImageSRGBA lastPreviewGrab;
+
     ~Impl()
     {
         
@@ -139,6 +175,11 @@ ScreenGrabber::~ScreenGrabber ()
 {
 }
 
+void ScreenGrabber::reserveForSize (int width, int height)
+{
+    // Nothing to pre-allocate here.
+}
+
 BITMAPINFOHEADER createBitmapHeader(int width, int height)
 {
 	BITMAPINFOHEADER  bi;
@@ -169,8 +210,115 @@ BITMAPINFOHEADER createBitmapHeader(int width, int height)
  * Example for DXGI: https://gist.github.com/mmozeiko/80989aa8f46901b2d7a323f3f3165790
  * Example for GDI: https://gist.github.com/SuperKogito/a6383dddcf4ee459b979e12550cc6e51
  */
+bool ScreenGrabber::liveCaptureIsSupported ()
+{
+    // The full re-grabs would include the viewer window.
+    return false;
+}
+
+void ScreenGrabber::startLiveCapture (const dl::Rect& screenRect)
+{
+    impl->live.active = true;
+    impl->live.screenRect = screenRect;
+    impl->live.lastGrabTime = NAN;
+}
+
+void ScreenGrabber::stopLiveCapture ()
+{
+    impl->live.active = false;
+}
+
+bool ScreenGrabber::isLiveCaptureActive () const
+{
+    return impl->live.active;
+}
+
+bool ScreenGrabber::usesSharedMemory () const
+{
+    return false;
+}
+
+bool ScreenGrabber::updateLiveCapture (dl::ImageSRGBA& cpuArea, GLTexture& gpuTexture, const dl::Rect& excludedScreenRect)
+{
+    std::vector<dl::Rect> updatedRects;
+    if (!updateLiveCapture (cpuArea, updatedRects, excludedScreenRect))
+        return false;
+
+    if (gpuTexture.width() == cpuArea.width() && gpuTexture.height() == cpuArea.height())
+        gpuTexture.uploadSubRect (cpuArea, 0, 0, cpuArea.width(), cpuArea.height());
+    else
+        gpuTexture.upload (cpuArea);
+    return true;
+}
+
+bool ScreenGrabber::updateLiveCapture (dl::ImageSRGBA& cpuArea, std::vector<dl::Rect>& updatedRects, const dl::Rect& excludedScreenRect)
+{
+    updatedRects.clear ();
+    if (!impl->live.active)
+        return false;
+
+    const double minDelayBetweenGrabs = 0.1;
+    const double now = currentDateInSeconds();
+    if (now - impl->live.lastGrabTime < minDelayBetweenGrabs)
+        return false;
+
+    if (!grabScreenArea (impl->live.screenRect, cpuArea))
+        return false;
+
+    impl->live.lastGrabTime = now;
+    updatedRects.push_back (dl::Rect::from_x_y_w_h (0, 0, cpuArea.width(), cpuArea.height()));
+    return true;
+}
+
 bool ScreenGrabber::grabScreenArea (const dl::Rect& screenRect, dl::ImageSRGBA& cpuImage, GLTexture& gpuTexture)
 {
+    if (!grabScreenArea (screenRect, cpuImage))
+        return false;
+
+    // Keep the same texture across grabs, the storage gets reused.
+    if (gpuTexture.textureId() == 0)
+        gpuTexture.initialize ();
+    gpuTexture.upload(cpuImage);
+    return true;
+}
+
+bool ScreenGrabber::grabScreenAreaPreview (const dl::Rect& screenRect, int downsampleFactor,
+                                           dl::ImageSRGBA& previewImage,
+                                           int& fullWidth, int& fullHeight)
+{
+    dl::ImageSRGBA fullImage;
+    if (!grabScreenArea (screenRect, fullImage))
+        return false;
+
+    // Already RGBA in memory.
+    PackedPixelFormat format;
+    format.redMask = 0xff;
+    format.greenMask = 0xff00;
+    format.blueMask = 0xff0000;
+    convertPackedPixelsToSRGBADownsampled (fullImage.rawBytes(), int(fullImage.bytesPerRow()),
+                                           fullImage.width(), fullImage.height(),
+                                           format,
+                                           downsampleFactor,
+                                           previewImage);
+    fullWidth = fullImage.width();
+    fullHeight = fullImage.height();
+    impl->lastPreviewGrab.swap (fullImage);
+    return true;
+}
+
+bool ScreenGrabber::convertLastGrabArea (const dl::Rect& imageRect, dl::ImageSRGBA& output)
+{
+    if (!impl->lastPreviewGrab.hasData())
+        return false;
+
+    output = dl::crop (impl->lastPreviewGrab, imageRect);
+    return output.hasData();
+}
+
+bool ScreenGrabber::grabScreenArea (const dl::Rect& screenRect, dl::ImageSRGBA& cpuImage)
+{
+    impl->lastPreviewGrab = {};
+
     HWND hwnd = GetDesktopWindow();
 
     // get handles to a device context (DC)
@@ -223,9 +371,6 @@ bool ScreenGrabber::grabScreenArea (const dl::Rect& screenRect, dl::ImageSRGBA&
 	DeleteDC(hwindowCompatibleDC);
 	ReleaseDC(hwnd, hwindowDC);
 
-    gpuTexture.initialize ();
-    gpuTexture.upload(cpuImage);
-
     return true;
 }
 
@@ -289,6 +434,27 @@ dl::Rect getFrontWindowGeometry(GLFWwindow* grabWindowHandle)
     return finder.findWindowGeometryUnderPointer (grabWindowHandle);
 }
 
+// Nothing to keep across lookups.
+struct FrontWindowFinder::Impl
+{
+};
+
+FrontWindowFinder::FrontWindowFinder ()
+: impl (new Impl())
+{
+}
+
+FrontWindowFinder::~FrontWindowFinder () = default;
+
+void FrontWindowFinder::update ()
+{
+}
+
+dl::Rect FrontWindowFinder::frontWindowGeometry (GLFWwindow* grabWindowHandle)
+{
+    return getFrontWindowGeometry (grabWindowHandle);
+}
+
 } // dl
 
 namespace dl
@@ -299,6 +465,16 @@ void setAppFocusEnabled (bool enabled)
     // NSApp.activationPolicy = enabled ? NSApplicationActivationPolicyRegular : NSApplicationActivationPolicyAccessory;
 }
 
+int getWindowSystemFileDescriptor ()
+{
+    return -1;
+}
+
+bool checkScreenCapturePermission ()
+{
+    return true;
+}
+
 dl::Point getMouseCursor()
 {
     // NSPoint mousePos = [NSEvent mouseLocation];
@@ -339,6 +515,19 @@ void getVersionAndBuildNumber(std::string& version, std::string& build)
     build = PROJECT_VERSION_COMMIT;
 }
 
+std::string getUserCacheDirectory (const std::string& subFolder)
+{
+    const char* localAppData = getenv ("LOCALAPPDATA");
+    if (!localAppData || !*localAppData)
+        return std::string();
+
+    const std::string path = std::string(localAppData) + "\\DaltonLens\\" + subFolder;
+    const int err = SHCreateDirectoryExA (NULL, path.c_str(), NULL);
+    if (err != ERROR_SUCCESS && err != ERROR_ALREADY_EXISTS)
+        return std::string();
+    return path;
+}
+
 // --------------------------------------------------------------------------------
 // StartupManager
 // --------------------------------------------------------------------------------
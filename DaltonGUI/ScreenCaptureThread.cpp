@@ -0,0 +1,459 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#include "ScreenCaptureThread.h"
+
+#include <DaltonGUI/DesktopGrabber.h>
+#include <DaltonGUI/PlatformSpecific.h>
+
+#include <Dalton/SPSCQueue.h>
+#include <Dalton/Utils.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace dl
+{
+
+namespace
+{
+
+    void copyRect (const ImageSRGBA& src, const dl::Rect& r, ImageSRGBA& dst)
+    {
+        const int x = int(r.origin.x);
+        const int w = int(r.size.x);
+        for (int y = int(r.origin.y); y < int(r.origin.y + r.size.y); ++y)
+            memcpy (dst.atRowPtr(y) + x, src.atRowPtr(y) + x, w * sizeof(PixelSRGBA));
+    }
+
+    bool sameRect (const dl::Rect& lhs, const dl::Rect& rhs)
+    {
+        return lhs.origin.x == rhs.origin.x && lhs.origin.y == rhs.origin.y
+            && lhs.size.x == rhs.size.x && lhs.size.y == rhs.size.y;
+    }
+
+} // anonymous
+
+struct ScreenCaptureThread::Impl
+{
+    struct Command
+    {
+        enum class Kind { Grab, ConvertArea, Reserve, StartLive, SetExcludedRect, StopLive };
+        Kind kind = Kind::Grab;
+        int64_t requestId = -1;
+        dl::Rect rect;
+        // Multiple areas to stitch together.
+        std::vector<dl::Rect> rects;
+        // Preview grabs only.
+        int downsampleFactor = 1;
+        // ConvertArea only.
+        int64_t previewRequestId = -1;
+    };
+
+    // Enough to have one frame displayed, one in flight and one being grabbed.
+    static constexpr int NumBuffers = 3;
+
+    // UI thread => capture thread.
+    SPSCQueue<Command, 16> commands;
+    SPSCQueue<std::unique_ptr<ImageSRGBA>, NumBuffers> freeBuffers;
+    // Capture thread => UI thread. Can never be full since there are only NumBuffers.
+    SPSCQueue<Frame, NumBuffers> readyFrames;
+
+    std::thread thread;
+    std::atomic<bool> stopRequested { false };
+
+    // Only used to sleep when there is nothing to do, the data goes through the queues.
+    std::mutex wakeupMutex;
+    std::condition_variable wakeupCondition;
+    bool wakeupRequested = false;
+
+    // Only accessed by the UI thread.
+    int64_t lastRequestId = 0;
+    int64_t liveRequestId = -1;
+    dl::Rect lastExcludedRect;
+
+    // Only accessed by the capture thread.
+    ScreenGrabber grabber;
+    DesktopGrabber desktopGrabber;
+    std::vector<std::unique_ptr<ImageSRGBA>> spareBuffers;
+    // Grabs and area conversions waiting for a buffer.
+    std::deque<Command> pendingGrabs;
+    // The grabber still has its raw pixels.
+    int64_t lastPreviewRequestId = -1;
+    struct {
+        int64_t requestId = -1;
+        dl::Rect screenRect;
+        dl::Rect excludedRect;
+        ImageSRGBA image;
+        std::vector<dl::Rect> updatedRects;
+        // Updated but not sent yet because no buffer was available.
+        std::vector<dl::Rect> pendingRects;
+    } live;
+
+    ~Impl ()
+    {
+        stop ();
+    }
+
+    void ensureStarted ()
+    {
+        if (thread.joinable())
+            return;
+
+        stopRequested = false;
+        thread = std::thread ([this]() {
+            run ();
+        });
+    }
+
+    void stop ()
+    {
+        if (!thread.joinable())
+            return;
+
+        stopRequested = true;
+        wakeup ();
+        thread.join ();
+    }
+
+    void wakeup ()
+    {
+        {
+            std::lock_guard<std::mutex> lk (wakeupMutex);
+            wakeupRequested = true;
+        }
+        wakeupCondition.notify_one ();
+    }
+
+    void pushCommand (Command cmd)
+    {
+        ensureStarted ();
+        // Commands are rare, the queue should only be full if the capture thread is stuck.
+        while (!commands.tryPush (std::move(cmd)))
+            std::this_thread::yield ();
+        wakeup ();
+    }
+
+    // Capture thread.
+    void run ();
+    void processCommands ();
+    void processPendingGrabs ();
+    void updateLive ();
+    void sendPendingLiveRects ();
+
+    std::unique_ptr<ImageSRGBA> acquireBuffer ()
+    {
+        std::unique_ptr<ImageSRGBA> buffer;
+        if (!spareBuffers.empty())
+        {
+            buffer = std::move (spareBuffers.back());
+            spareBuffers.pop_back ();
+            return buffer;
+        }
+        freeBuffers.tryPop (buffer);
+        return buffer;
+    }
+
+    void publishFrame (Frame&& frame)
+    {
+        const bool ok = readyFrames.tryPush (std::move(frame));
+        dl_assert (ok, "The ready queue should never be full.");
+    }
+};
+
+void ScreenCaptureThread::Impl::run ()
+{
+    while (!stopRequested)
+    {
+        processCommands ();
+        processPendingGrabs ();
+        if (live.requestId >= 0)
+            updateLive ();
+
+        const bool waitingForBuffers = !pendingGrabs.empty() || !live.pendingRects.empty();
+
+        std::unique_lock<std::mutex> lk (wakeupMutex);
+        auto shouldWakeup = [this]() { return wakeupRequested || stopRequested; };
+        if (live.requestId >= 0 || waitingForBuffers)
+        {
+            // Damage events are cheap to poll, and that's about the display rate.
+            wakeupCondition.wait_for (lk, std::chrono::milliseconds(16), shouldWakeup);
+        }
+        else
+        {
+            wakeupCondition.wait (lk, shouldWakeup);
+        }
+        wakeupRequested = false;
+    }
+
+    grabber.stopLiveCapture ();
+}
+
+void ScreenCaptureThread::Impl::processCommands ()
+{
+    Command cmd;
+    while (commands.tryPop (cmd))
+    {
+        switch (cmd.kind)
+        {
+            case Command::Kind::Grab:
+            case Command::Kind::ConvertArea:
+                pendingGrabs.push_back (std::move(cmd));
+                break;
+
+            case Command::Kind::Reserve:
+            {
+                const int width = int(cmd.rect.size.x);
+                const int height = int(cmd.rect.size.y);
+                grabber.reserveForSize (width, height);
+                std::unique_ptr<ImageSRGBA> buffer;
+                while (freeBuffers.tryPop (buffer))
+                    spareBuffers.push_back (std::move(buffer));
+                for (auto& spare : spareBuffers)
+                    spare->ensureAllocatedBufferForSize (width, height);
+                break;
+            }
+
+            case Command::Kind::StartLive:
+                lastPreviewRequestId = -1;
+                live.requestId = cmd.requestId;
+                live.screenRect = cmd.rect;
+                live.pendingRects.clear ();
+                grabber.startLiveCapture (cmd.rect);
+                break;
+
+            case Command::Kind::SetExcludedRect:
+                live.excludedRect = cmd.rect;
+                break;
+
+            case Command::Kind::StopLive:
+                live.requestId = -1;
+                live.pendingRects.clear ();
+                grabber.stopLiveCapture ();
+                break;
+        }
+    }
+}
+
+void ScreenCaptureThread::Impl::processPendingGrabs ()
+{
+    while (!pendingGrabs.empty())
+    {
+        std::unique_ptr<ImageSRGBA> buffer = acquireBuffer ();
+        if (!buffer)
+            return;
+
+        const Command cmd = std::move (pendingGrabs.front ());
+        pendingGrabs.pop_front ();
+
+        Frame frame;
+        frame.requestId = cmd.requestId;
+        frame.screenRect = cmd.rect;
+        frame.grabTime = currentDateInSeconds ();
+        if (cmd.kind == Command::Kind::ConvertArea)
+        {
+            // The raw pixels get overwritten by any other grab.
+            frame.isValid = cmd.previewRequestId == lastPreviewRequestId
+                         && grabber.convertLastGrabArea (cmd.rect, *buffer);
+        }
+        else if (cmd.downsampleFactor > 1)
+        {
+            frame.isValid = grabber.grabScreenAreaPreview (cmd.rect, cmd.downsampleFactor, *buffer,
+                                                           frame.fullResolutionWidth, frame.fullResolutionHeight);
+            frame.downsampleFactor = cmd.downsampleFactor;
+            lastPreviewRequestId = frame.isValid ? cmd.requestId : -1;
+        }
+        else
+        {
+            lastPreviewRequestId = -1;
+            if (cmd.rects.empty())
+                frame.isValid = grabber.grabScreenArea (cmd.rect, *buffer);
+            else
+                frame.isValid = desktopGrabber.grabScreenAreas (cmd.rects, *buffer, frame.screenRect);
+        }
+        if (frame.isValid)
+            frame.updatedRects.push_back (dl::Rect::from_x_y_w_h (0, 0, buffer->width(), buffer->height()));
+        frame.image = std::move (buffer);
+        publishFrame (std::move(frame));
+    }
+}
+
+void ScreenCaptureThread::Impl::updateLive ()
+{
+    if (grabber.updateLiveCapture (live.image, live.updatedRects, live.excludedRect))
+    {
+        live.pendingRects.insert (live.pendingRects.end(), live.updatedRects.begin(), live.updatedRects.end());
+
+        // The UI is late, no need to keep track of every small area.
+        const size_t maxPendingRects = 32;
+        if (live.pendingRects.size() > maxPendingRects)
+            live.pendingRects = { dl::Rect::from_x_y_w_h (0, 0, live.image.width(), live.image.height()) };
+    }
+
+    sendPendingLiveRects ();
+}
+
+void ScreenCaptureThread::Impl::sendPendingLiveRects ()
+{
+    if (live.pendingRects.empty())
+        return;
+
+    std::unique_ptr<ImageSRGBA> buffer = acquireBuffer ();
+    if (!buffer)
+        return;
+
+    // Only the updated areas get copied, the rest of the buffer is stale.
+    buffer->ensureAllocatedBufferForSize (live.image.width(), live.image.height());
+    for (const auto& r : live.pendingRects)
+        copyRect (live.image, r, *buffer);
+
+    Frame frame;
+    frame.requestId = live.requestId;
+    frame.isValid = true;
+    frame.screenRect = live.screenRect;
+    frame.grabTime = currentDateInSeconds ();
+    frame.updatedRects.swap (live.pendingRects);
+    frame.image = std::move (buffer);
+    publishFrame (std::move(frame));
+}
+
+ScreenCaptureThread::ScreenCaptureThread ()
+: impl (new Impl())
+{
+    for (int i = 0; i < Impl::NumBuffers; ++i)
+        impl->freeBuffers.tryPush (std::make_unique<ImageSRGBA>());
+}
+
+ScreenCaptureThread::~ScreenCaptureThread ()
+{
+    impl->stop ();
+}
+
+void ScreenCaptureThread::reserveForSize (int width, int height)
+{
+    Impl::Command cmd;
+    cmd.kind = Impl::Command::Kind::Reserve;
+    cmd.rect = dl::Rect::from_x_y_w_h (0, 0, width, height);
+    impl->pushCommand (cmd);
+}
+
+int64_t ScreenCaptureThread::requestGrab (const dl::Rect& screenRect)
+{
+    Impl::Command cmd;
+    cmd.kind = Impl::Command::Kind::Grab;
+    cmd.requestId = ++impl->lastRequestId;
+    cmd.rect = screenRect;
+    impl->pushCommand (cmd);
+    return cmd.requestId;
+}
+
+int64_t ScreenCaptureThread::requestGrab (const std::vector<dl::Rect>& screenRects)
+{
+    if (screenRects.size() == 1)
+        return requestGrab (screenRects[0]);
+
+    Impl::Command cmd;
+    cmd.kind = Impl::Command::Kind::Grab;
+    cmd.requestId = ++impl->lastRequestId;
+    cmd.rect = DesktopGrabber::boundingRect (screenRects);
+    cmd.rects = screenRects;
+    const int64_t requestId = cmd.requestId;
+    impl->pushCommand (std::move(cmd));
+    return requestId;
+}
+
+int64_t ScreenCaptureThread::requestPreviewGrab (const dl::Rect& screenRect, int downsampleFactor)
+{
+    Impl::Command cmd;
+    cmd.kind = Impl::Command::Kind::Grab;
+    cmd.requestId = ++impl->lastRequestId;
+    cmd.rect = screenRect;
+    cmd.downsampleFactor = downsampleFactor;
+    impl->pushCommand (cmd);
+    return cmd.requestId;
+}
+
+int64_t ScreenCaptureThread::requestFullResolutionArea (int64_t previewRequestId, const dl::Rect& imageRect)
+{
+    Impl::Command cmd;
+    cmd.kind = Impl::Command::Kind::ConvertArea;
+    cmd.requestId = ++impl->lastRequestId;
+    cmd.rect = imageRect;
+    cmd.previewRequestId = previewRequestId;
+    impl->pushCommand (cmd);
+    return cmd.requestId;
+}
+
+int64_t ScreenCaptureThread::startLiveCapture (const dl::Rect& screenRect)
+{
+    Impl::Command cmd;
+    cmd.kind = Impl::Command::Kind::StartLive;
+    cmd.requestId = ++impl->lastRequestId;
+    cmd.rect = screenRect;
+    impl->liveRequestId = cmd.requestId;
+    impl->pushCommand (cmd);
+    return cmd.requestId;
+}
+
+void ScreenCaptureThread::setLiveCaptureExcludedRect (const dl::Rect& excludedScreenRect)
+{
+    // This typically gets called every frame.
+    if (sameRect (excludedScreenRect, impl->lastExcludedRect))
+        return;
+
+    impl->lastExcludedRect = excludedScreenRect;
+    Impl::Command cmd;
+    cmd.kind = Impl::Command::Kind::SetExcludedRect;
+    cmd.rect = excludedScreenRect;
+    impl->pushCommand (cmd);
+}
+
+void ScreenCaptureThread::stopLiveCapture ()
+{
+    if (impl->liveRequestId < 0)
+        return;
+
+    impl->liveRequestId = -1;
+    Impl::Command cmd;
+    cmd.kind = Impl::Command::Kind::StopLive;
+    impl->pushCommand (cmd);
+}
+
+bool ScreenCaptureThread::isLiveCaptureActive () const
+{
+    return impl->liveRequestId >= 0;
+}
+
+bool ScreenCaptureThread::tryPopFrame (Frame& frame)
+{
+    return impl->readyFrames.tryPop (frame);
+}
+
+void ScreenCaptureThread::recycleFrame (Frame& frame)
+{
+    if (!frame.image)
+        return;
+
+    const bool ok = impl->freeBuffers.tryPush (std::move(frame.image));
+    dl_assert (ok, "More buffers than expected.");
+    frame = {};
+    // It might be waiting for a free buffer.
+    impl->wakeup ();
+}
+
+void ScreenCaptureThread::discardPendingFrames ()
+{
+    Frame frame;
+    while (tryPopFrame (frame))
+        recycleFrame (frame);
+}
+
+} // dl
@@ -0,0 +1,91 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#pragma once
+
+#include <Dalton/Image.h>
+#include <Dalton/MathUtils.h>
+
+#include <memory>
+#include <vector>
+
+namespace dl
+{
+
+// Grabs the screen on a dedicated thread so the UI thread never blocks on
+// the capture and the pixel conversion. Frames come back through a
+// lock-free queue and use a small pool of buffers that get recycled,
+// so the UI thread only has to upload them to a texture.
+//
+// All the methods must be called from the same (UI) thread.
+class ScreenCaptureThread
+{
+public:
+    struct Frame
+    {
+        // Matches the value returned by requestGrab or startLiveCapture.
+        int64_t requestId = -1;
+        bool isValid = false;
+        // Bounding box of all the grabbed areas.
+        dl::Rect screenRect;
+        double grabTime = NAN;
+
+        // Only for preview grabs, the image is then smaller than the
+        // full resolution one by downsampleFactor.
+        int downsampleFactor = 1;
+        int fullResolutionWidth = -1;
+        int fullResolutionHeight = -1;
+
+        // Areas of the image that changed, in image coordinates. For live
+        // frames only these areas have up-to-date content.
+        std::vector<dl::Rect> updatedRects;
+        std::unique_ptr<dl::ImageSRGBA> image;
+    };
+
+public:
+    ScreenCaptureThread ();
+    ~ScreenCaptureThread ();
+
+    // Optional hint to allocate the capture buffers upfront.
+    void reserveForSize (int width, int height);
+
+    // Single grab of the area. Returns the id of the request.
+    int64_t requestGrab (const dl::Rect& screenRect);
+
+    // Grabs all the areas in parallel, typically one per monitor, and
+    // stitches them into a single frame. See DesktopGrabber.
+    int64_t requestGrab (const std::vector<dl::Rect>& screenRects);
+
+    // Downsampled grab, see ScreenGrabber::grabScreenAreaPreview. The full
+    // resolution pixels of any area can then be obtained with
+    // requestFullResolutionArea, as long as no other grab was requested.
+    int64_t requestPreviewGrab (const dl::Rect& screenRect, int downsampleFactor);
+    // imageRect is in full resolution image coordinates. The frame is
+    // invalid if the preview is not available anymore.
+    int64_t requestFullResolutionArea (int64_t previewRequestId, const dl::Rect& imageRect);
+
+    // Keep sending the damaged areas until stopLiveCapture. Returns the id
+    // of the live frames. See ScreenGrabber::updateLiveCapture for the excluded rect.
+    int64_t startLiveCapture (const dl::Rect& screenRect);
+    void setLiveCaptureExcludedRect (const dl::Rect& excludedScreenRect);
+    void stopLiveCapture ();
+    bool isLiveCaptureActive () const;
+
+    // Returns false if no frame is ready. The frame needs to be given
+    // back with recycleFrame once its content got used.
+    bool tryPopFrame (Frame& frame);
+    void recycleFrame (Frame& frame);
+
+    // Recycles all the pending frames.
+    void discardPendingFrames ();
+
+private:
+    struct Impl;
+    friend struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+} // dl
@@ -0,0 +1,448 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#include "ScreenRecorder.h"
+
+#include <DaltonGUI/PlatformSpecific.h>
+
+#include <Dalton/LosslessCodec.h>
+#include <Dalton/Utils.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+namespace dl
+{
+
+namespace
+{
+
+    // File layout:
+    //   header: "DLREC001" + double recordingStartDate
+    //   frames: "DLFR" + int64 frameIndex + double timestamp + uint32 numBytes + encoded frame
+    // Everything is in native endianness.
+    const char segmentMagic[8] = { 'D', 'L', 'R', 'E', 'C', '0', '0', '1' };
+    const char frameMagic[4] = { 'D', 'L', 'F', 'R' };
+    const size_t frameHeaderSize = sizeof(frameMagic) + sizeof(int64_t) + sizeof(double) + sizeof(uint32_t);
+
+    std::string segmentPath (const std::string& dir, int segment)
+    {
+        return formatted ("%s/segment_%03d.dlrec", dir.c_str(), segment);
+    }
+
+    template <class T>
+    void appendPod (std::vector<uint8_t>& buffer, const T& v)
+    {
+        const uint8_t* ptr = reinterpret_cast<const uint8_t*>(&v);
+        buffer.insert (buffer.end(), ptr, ptr + sizeof(T));
+    }
+
+    template <class T>
+    T readPod (const uint8_t*& ptr)
+    {
+        T v;
+        memcpy (&v, ptr, sizeof(T));
+        ptr += sizeof(T);
+        return v;
+    }
+
+} // anonymous
+
+// --------------------------------------------------------------------------------
+// ScreenRecorder
+// --------------------------------------------------------------------------------
+
+struct ScreenRecorder::Impl
+{
+    Options options;
+
+    std::thread thread;
+    bool manualRecording = false;
+    std::atomic<bool> stopRequested { false };
+    std::mutex stopMutex;
+    std::condition_variable stopCondition;
+
+    mutable std::mutex statsMutex;
+    Stats stats;
+
+    // Only accessed by the recording thread.
+    ScreenGrabber grabber;
+    ImageSRGBA frame;
+    std::vector<uint8_t> encodedFrame;
+    FILE* segmentFile = nullptr;
+    int currentSegment = -1;
+    int framesInCurrentSegment = 0;
+    double recordingStartDate = NAN;
+    int64_t nextFrameIndex = 0;
+
+    bool prepare (const Options& options, double startDate);
+    void run ();
+    bool recordFrameAt (double timestamp);
+    bool recordFrame (int64_t frameIndex, double timestamp);
+    bool openNextSegment ();
+    void closeSegment ();
+
+    // Returns false if stop was requested while waiting.
+    bool waitUntil (double date)
+    {
+        const double delay = date - currentDateInSeconds();
+        std::unique_lock<std::mutex> lk (stopMutex);
+        if (delay > 0)
+        {
+            stopCondition.wait_for (lk, std::chrono::duration<double>(delay), [this]() {
+                return stopRequested.load();
+            });
+        }
+        return !stopRequested;
+    }
+};
+
+bool ScreenRecorder::Impl::prepare (const Options& options, double startDate)
+{
+    if (options.targetFps <= 0 || options.numSegments < 1 || options.framesPerSegment < 1)
+        return false;
+
+    if (!options.frameSource && (options.screenRect.size.x < 1 || options.screenRect.size.y < 1))
+        return false;
+
+    this->options = options;
+    stats = Stats();
+    currentSegment = -1;
+    framesInCurrentSegment = 0;
+    recordingStartDate = startDate;
+    nextFrameIndex = 0;
+    stopRequested = false;
+    return true;
+}
+
+void ScreenRecorder::Impl::run ()
+{
+    const double period = 1.0 / options.targetFps;
+    while (waitUntil (recordingStartDate + nextFrameIndex * period))
+    {
+        recordFrameAt (currentDateInSeconds());
+    }
+
+    closeSegment ();
+}
+
+bool ScreenRecorder::Impl::recordFrameAt (double timestamp)
+{
+    // The slots that are already in the past are lost.
+    const double period = 1.0 / options.targetFps;
+    const int64_t frameIndex = std::max (nextFrameIndex, int64_t(std::floor((timestamp - recordingStartDate) / period)));
+    const int64_t missedFrames = frameIndex - nextFrameIndex;
+    nextFrameIndex = frameIndex + 1;
+
+    const double startTime = currentDateInSeconds();
+    const bool ok = recordFrame (frameIndex, timestamp);
+    const double endTime = currentDateInSeconds();
+
+    std::lock_guard<std::mutex> _ (statsMutex);
+    if (ok)
+        ++stats.capturedFrames;
+    else
+        ++stats.failedGrabs;
+    stats.droppedFrames += missedFrames;
+    stats.bytesWritten += ok ? encodedFrame.size() : 0;
+    stats.lastFrameProcessingTime = endTime - startTime;
+    return ok;
+}
+
+bool ScreenRecorder::Impl::recordFrame (int64_t frameIndex, double timestamp)
+{
+    const bool grabbed = options.frameSource
+        ? options.frameSource (frame)
+        : grabber.grabScreenArea (options.screenRect, frame);
+    if (!grabbed)
+        return false;
+
+    if (segmentFile == nullptr || framesInCurrentSegment >= options.framesPerSegment)
+    {
+        if (!openNextSegment ())
+            return false;
+    }
+
+    encodedFrame.clear ();
+    appendPod (encodedFrame, frameMagic);
+    appendPod (encodedFrame, frameIndex);
+    appendPod (encodedFrame, timestamp);
+    appendPod (encodedFrame, uint32_t(0));
+    const uint32_t numBytes = uint32_t(encodeLossless (frame, encodedFrame));
+    memcpy (encodedFrame.data() + frameHeaderSize - sizeof(uint32_t), &numBytes, sizeof(uint32_t));
+
+    if (fwrite (encodedFrame.data(), 1, encodedFrame.size(), segmentFile) != encodedFrame.size())
+    {
+        dl_dbg ("Could not write the frame to segment %d", currentSegment);
+        closeSegment ();
+        return false;
+    }
+
+    // Keep the segment readable even if the app gets killed.
+    fflush (segmentFile);
+    ++framesInCurrentSegment;
+    return true;
+}
+
+bool ScreenRecorder::Impl::openNextSegment ()
+{
+    closeSegment ();
+
+    currentSegment = (currentSegment + 1) % options.numSegments;
+    framesInCurrentSegment = 0;
+
+    // Truncates the oldest segment of the ring.
+    const std::string path = segmentPath (options.outputDir, currentSegment);
+    segmentFile = fopen (path.c_str(), "wb");
+    if (!segmentFile)
+    {
+        dl_dbg ("Could not open %s", path.c_str());
+        return false;
+    }
+
+    fwrite (segmentMagic, 1, sizeof(segmentMagic), segmentFile);
+    fwrite (&recordingStartDate, 1, sizeof(recordingStartDate), segmentFile);
+    return true;
+}
+
+void ScreenRecorder::Impl::closeSegment ()
+{
+    if (segmentFile)
+    {
+        fclose (segmentFile);
+        segmentFile = nullptr;
+    }
+}
+
+ScreenRecorder::ScreenRecorder ()
+: impl (new Impl())
+{
+
+}
+
+ScreenRecorder::~ScreenRecorder ()
+{
+    stop ();
+}
+
+bool ScreenRecorder::start (const Options& options)
+{
+    stop ();
+
+    if (!impl->prepare (options, currentDateInSeconds()))
+        return false;
+
+    impl->thread = std::thread ([this]() {
+        impl->run ();
+    });
+    return true;
+}
+
+bool ScreenRecorder::startManual (const Options& options, double startDate)
+{
+    stop ();
+
+    if (!impl->prepare (options, startDate))
+        return false;
+
+    impl->manualRecording = true;
+    return true;
+}
+
+bool ScreenRecorder::recordFrameAt (double timestamp)
+{
+    dl_assert (impl->manualRecording, "recordFrameAt requires startManual");
+    return impl->recordFrameAt (timestamp);
+}
+
+void ScreenRecorder::stop ()
+{
+    if (impl->manualRecording)
+    {
+        impl->closeSegment ();
+        impl->manualRecording = false;
+        return;
+    }
+
+    if (!impl->thread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lk (impl->stopMutex);
+        impl->stopRequested = true;
+    }
+    impl->stopCondition.notify_all ();
+    impl->thread.join ();
+}
+
+bool ScreenRecorder::isRecording () const
+{
+    return impl->manualRecording || (impl->thread.joinable() && !impl->stopRequested);
+}
+
+ScreenRecorder::Stats ScreenRecorder::stats () const
+{
+    std::lock_guard<std::mutex> _ (impl->statsMutex);
+    return impl->stats;
+}
+
+// --------------------------------------------------------------------------------
+// ScreenRecordingReader
+// --------------------------------------------------------------------------------
+
+struct ScreenRecordingReader::Impl
+{
+    std::vector<FILE*> segmentFiles;
+    std::vector<FrameInfo> frames;
+    std::vector<uint8_t> buffer;
+
+    ~Impl ()
+    {
+        closeAll ();
+    }
+
+    void closeAll ()
+    {
+        for (auto* f : segmentFiles)
+            if (f) fclose (f);
+        segmentFiles.clear ();
+        frames.clear ();
+    }
+
+    void indexSegment (int segment)
+    {
+        FILE* f = segmentFiles[segment];
+        fseek (f, 0, SEEK_END);
+        const long fileSize = ftell (f);
+        fseek (f, sizeof(segmentMagic) + sizeof(double), SEEK_SET);
+
+        uint8_t header[frameHeaderSize];
+        while (fread (header, 1, frameHeaderSize, f) == frameHeaderSize)
+        {
+            const uint8_t* ptr = header;
+            if (memcmp (ptr, frameMagic, sizeof(frameMagic)) != 0)
+                break;
+            ptr += sizeof(frameMagic);
+
+            FrameInfo info;
+            info.frameIndex = readPod<int64_t> (ptr);
+            info.timestamp = readPod<double> (ptr);
+            info.numBytes = readPod<uint32_t> (ptr);
+            info.segment = segment;
+            info.fileOffset = ftell (f);
+
+            // Stop on a truncated frame, e.g. if the recorder is still writing it.
+            if (info.fileOffset + long(info.numBytes) > fileSize)
+                break;
+
+            frames.push_back (info);
+            fseek (f, info.numBytes, SEEK_CUR);
+        }
+    }
+};
+
+ScreenRecordingReader::ScreenRecordingReader ()
+: impl (new Impl())
+{
+
+}
+
+ScreenRecordingReader::~ScreenRecordingReader ()
+{
+
+}
+
+bool ScreenRecordingReader::open (const std::string& recordingDir)
+{
+    impl->closeAll ();
+
+    // Segments from an older recording with more segments could remain in the
+    // directory, only keep the ones that belong to the most recent recording.
+    std::vector<double> startDates;
+    for (int segment = 0; ; ++segment)
+    {
+        FILE* f = fopen (segmentPath (recordingDir, segment).c_str(), "rb");
+        if (!f)
+            break;
+
+        char magic[sizeof(segmentMagic)];
+        double startDate = NAN;
+        if (fread (magic, 1, sizeof(magic), f) != sizeof(magic)
+            || memcmp (magic, segmentMagic, sizeof(magic)) != 0
+            || fread (&startDate, 1, sizeof(startDate), f) != sizeof(startDate))
+        {
+            fclose (f);
+            f = nullptr;
+        }
+
+        impl->segmentFiles.push_back (f);
+        startDates.push_back (startDate);
+    }
+
+    if (impl->segmentFiles.empty())
+        return false;
+
+    const double mostRecentStartDate = *std::max_element (startDates.begin(), startDates.end(), [](double a, double b) {
+        return (std::isnan(a) ? -INFINITY : a) < (std::isnan(b) ? -INFINITY : b);
+    });
+
+    for (int segment = 0; segment < int(impl->segmentFiles.size()); ++segment)
+    {
+        if (impl->segmentFiles[segment] == nullptr)
+            continue;
+
+        if (startDates[segment] != mostRecentStartDate)
+        {
+            fclose (impl->segmentFiles[segment]);
+            impl->segmentFiles[segment] = nullptr;
+            continue;
+        }
+
+        impl->indexSegment (segment);
+    }
+
+    std::sort (impl->frames.begin(), impl->frames.end(), [](const FrameInfo& lhs, const FrameInfo& rhs) {
+        return lhs.frameIndex < rhs.frameIndex;
+    });
+
+    return !impl->frames.empty();
+}
+
+int ScreenRecordingReader::numFrames () const
+{
+    return int(impl->frames.size());
+}
+
+const ScreenRecordingReader::FrameInfo& ScreenRecordingReader::frameInfo (int idx) const
+{
+    dl_assert (idx >= 0 && idx < numFrames(), "Invalid frame index %d", idx);
+    return impl->frames[idx];
+}
+
+bool ScreenRecordingReader::readFrame (int idx, ImageSRGBA& image)
+{
+    if (idx < 0 || idx >= numFrames())
+        return false;
+
+    const FrameInfo& info = impl->frames[idx];
+    FILE* f = impl->segmentFiles[info.segment];
+    if (fseek (f, info.fileOffset, SEEK_SET) != 0)
+        return false;
+
+    impl->buffer.resize (info.numBytes);
+    if (fread (impl->buffer.data(), 1, info.numBytes, f) != info.numBytes)
+        return false;
+
+    return decodeLossless (impl->buffer.data(), impl->buffer.size(), image);
+}
+
+} // dl
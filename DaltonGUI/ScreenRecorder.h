@@ -0,0 +1,108 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#pragma once
+
+#include <Dalton/Image.h>
+#include <Dalton/MathUtils.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dl
+{
+
+// Records a screen area at a fixed rate on a background thread.
+// Frames are compressed with the lossless codec and appended to a fixed
+// ring of segment files, so the disk usage stays bounded and the last
+// numSegments*framesPerSegment frames are always available.
+class ScreenRecorder
+{
+public:
+    struct Options
+    {
+        // Must be an existing and writable directory.
+        std::string outputDir;
+        dl::Rect screenRect;
+        double targetFps = 5.0;
+        int numSegments = 8;
+        int framesPerSegment = 300;
+
+        // Optional, replaces the grab of screenRect, e.g. to record
+        // generated frames in tests. Called from the recording thread.
+        std::function<bool(ImageSRGBA&)> frameSource = nullptr;
+    };
+
+    struct Stats
+    {
+        int64_t capturedFrames = 0;
+        // Frames that could not be captured on time because the
+        // previous grab+encode+write took longer than the period.
+        int64_t droppedFrames = 0;
+        int64_t failedGrabs = 0;
+        int64_t bytesWritten = 0;
+        double lastFrameProcessingTime = 0;
+    };
+
+public:
+    ScreenRecorder ();
+    ~ScreenRecorder ();
+
+    bool start (const Options& options);
+    void stop ();
+
+    // Same as start, but without the background thread. Frames only get
+    // recorded by recordFrameAt, so the schedule is explicit, e.g. in tests
+    // or when driven by another loop. The slots are relative to startDate.
+    bool startManual (const Options& options, double startDate);
+
+    // Records the frame of the slot that contains timestamp, the slots
+    // skipped since the previous frame count as dropped.
+    // Only valid after startManual.
+    bool recordFrameAt (double timestamp);
+
+    bool isRecording () const;
+    Stats stats () const;
+
+private:
+    struct Impl;
+    friend struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+// Reads back the frames written by ScreenRecorder, in chronological order.
+// Typically used to replay a recording through the filters offline.
+class ScreenRecordingReader
+{
+public:
+    struct FrameInfo
+    {
+        int64_t frameIndex = -1;
+        double timestamp = NAN;
+        int segment = -1;
+        long fileOffset = -1;
+        uint32_t numBytes = 0;
+    };
+
+public:
+    ScreenRecordingReader ();
+    ~ScreenRecordingReader ();
+
+    bool open (const std::string& recordingDir);
+
+    int numFrames () const;
+    const FrameInfo& frameInfo (int idx) const;
+    bool readFrame (int idx, ImageSRGBA& image);
+
+private:
+    struct Impl;
+    friend struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+} // dl
@@ -6,6 +6,7 @@
 
 #include <DaltonGUI/DaltonLensGUI.h>
 #include <DaltonGUI/DaltonLensIcon.h>
+#include <DaltonGUI/DaltonLensPrefs.h>
 #include <DaltonGUI/PlatformSpecific.h>
 
 #include <Dalton/Utils.h>
@@ -20,10 +21,18 @@
 
 #include <tray/tray.h>
 
+#if PLATFORM_LINUX
+# include <glib.h>
+# include <poll.h>
+#endif
+
 #include <thread>
 #include <iostream>
 #include <fstream>
+#include <vector>
 #include <cassert>
+#include <cerrno>
+#include <cstring>
 
 class DaltonSystemTrayApp
 {
@@ -35,6 +44,7 @@ public:
         // text, disabled, checked, cb, context, submenu
         static tray_menu main_menu[] = {
             { "Grab Screen Region", 0, -1, grabScreen_cb, this },
+            { "Capture All Monitors", 0, dl::DaltonLensPrefs::captureAllMonitors() ? 1 : 0, captureAllMonitors_cb, this },
 #if PLATFORM_WINDOWS
             { "-" },
             { "Launch at Startup", 0, _startupManager.isLaunchAtStartupEnabled() ? 1 : 0, launchAtStartup_cb, this },
@@ -58,6 +68,9 @@ public:
 
     void run ()
     {
+#if PLATFORM_LINUX
+        runEventLoop ();
+#else
         bool shouldExit = false;
         dl::RateLimit rateLimit;
 
@@ -69,9 +82,83 @@ public:
             _dlGui.runOnce ();
             rateLimit.sleepIfNecessary (1 / 30.);
         }
+#endif
     }
 
 private:
+#if PLATFORM_LINUX
+    // Sleeps in poll on the GLib context of the tray, the X connections and
+    // the display link. The display link only ticks while a window is
+    // visible, so idle in the tray the app only wakes up for the menu, the
+    // window system events and the hotkeys. Those only get queued, the
+    // windows are rendered on the display link ticks only.
+    void runEventLoop ()
+    {
+        GMainContext* glibContext = g_main_context_default ();
+        g_main_context_acquire (glibContext);
+
+        _displayLinkTimer.setPaused (!_dlGui.needsContinuousUpdates ());
+        _displayLinkTimer.setCallback ([this]() {
+            _dlGui.runOnce ();
+        });
+
+        std::vector<GPollFD> glibFds (8);
+        std::vector<pollfd> fds;
+        std::vector<int> guiFds;
+
+        while (!_shouldExit)
+        {
+            gint maxPriority = 0;
+            g_main_context_prepare (glibContext, &maxPriority);
+            gint timeoutMs = -1;
+            int numGlibFds = 0;
+            while ((numGlibFds = g_main_context_query (glibContext, maxPriority, &timeoutMs, glibFds.data(), int(glibFds.size()))) > int(glibFds.size()))
+                glibFds.resize (numGlibFds);
+
+            fds.clear ();
+            for (int i = 0; i < numGlibFds; ++i)
+                fds.push_back ({ glibFds[i].fd, short(glibFds[i].events), 0 });
+
+            guiFds.clear ();
+            _dlGui.getEventFileDescriptors (guiFds);
+            if (_displayLinkTimer.fileDescriptor () >= 0)
+                guiFds.push_back (_displayLinkTimer.fileDescriptor ());
+            for (const int fd : guiFds)
+                fds.push_back ({ fd, POLLIN, 0 });
+
+            // Without the display link we can only rely on the vsync of the windows.
+            if (_displayLinkTimer.fileDescriptor () < 0 && _dlGui.needsContinuousUpdates ())
+                timeoutMs = 0;
+
+            if (poll (fds.data(), fds.size(), timeoutMs) < 0 && errno != EINTR)
+            {
+                fprintf (stderr, "ERROR: poll failed: %s\n", strerror(errno));
+                break;
+            }
+
+            for (int i = 0; i < numGlibFds; ++i)
+                glibFds[i].revents = fds[i].revents;
+            if (g_main_context_check (glibContext, maxPriority, glibFds.data(), numGlibFds))
+                g_main_context_dispatch (glibContext);
+
+            _dlGui.processInputEvents ();
+            if (_displayLinkTimer.fileDescriptor () >= 0)
+                _displayLinkTimer.runOnce ();
+            else
+                _dlGui.runOnce ();
+
+            _displayLinkTimer.setPaused (!_dlGui.needsContinuousUpdates ());
+            _displayLinkTimer.setPresentingWindow (_dlGui.presentingWindow ());
+        }
+
+        // The timer outlives the loop, don't leave a callback into it.
+        _displayLinkTimer.setPaused (true);
+        _displayLinkTimer.setPresentingWindow (nullptr);
+        _displayLinkTimer.setCallback (nullptr);
+        g_main_context_release (glibContext);
+    }
+#endif
+
     void onGrabScreen ()
     {
         _dlGui.toogleGrabScreenArea();
@@ -84,8 +171,16 @@ private:
         tray_update (&_tray);
     }
 
+    void onCaptureAllMonitors (struct tray_menu *item)
+    {
+        item->checked = !item->checked;
+        dl::DaltonLensPrefs::setCaptureAllMonitors (item->checked);
+        tray_update (&_tray);
+    }
+
     void onQuit()
     {
+        _shouldExit = true;
         tray_exit ();
         _dlGui.shutdown ();
     }
@@ -96,6 +191,7 @@ private:
     }
     
     static void launchAtStartup_cb(struct tray_menu *item) { reinterpret_cast<DaltonSystemTrayApp*>(item->context)->onLaunchAtStartup(item); }
+    static void captureAllMonitors_cb(struct tray_menu *item) { reinterpret_cast<DaltonSystemTrayApp*>(item->context)->onCaptureAllMonitors(item); }
     static void grabScreen_cb(struct tray_menu *item) { reinterpret_cast<DaltonSystemTrayApp*>(item->context)->onGrabScreen(); }
     static void quit_cb(struct tray_menu *item) { reinterpret_cast<DaltonSystemTrayApp*>(item->context)->onQuit(); }
     static void help_cb(struct tray_menu *item) { reinterpret_cast<DaltonSystemTrayApp*>(item->context)->onHelp(); }
@@ -105,6 +201,10 @@ private:
     dl::DaltonLensGUI _dlGui;
     std::string _iconAbsolutePath;
     dl::StartupManager _startupManager;
+#if PLATFORM_LINUX
+    dl::DisplayLinkTimer _displayLinkTimer;
+#endif
+    bool _shouldExit = false;
 };
 
 int main ()
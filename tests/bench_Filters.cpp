@@ -0,0 +1,136 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#include <Dalton/Utils.h>
+#include <Dalton/Image.h>
+#include <Dalton/Filters.h>
+#include <Dalton/OpenGL.h>
+
+#include <gl3w/GL/gl3w.h>
+#include <GLFW/glfw3.h>
+
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+using namespace dl;
+
+namespace
+{
+
+    struct Filters
+    {
+        Filter_Daltonize daltonize;
+        Filter_HSVTransform hsvTransform;
+        Filter_FlipRedBlue flipRedBlue;
+        Filter_FlipRedBlueAndInvertRed flipRedBlueAndInvertRed;
+        Filter_HighlightSimilarColors highlightSimilarColors;
+
+        std::vector<std::pair<const char*, GLFilter*>> all ()
+        {
+            return {
+                { "Daltonize", &daltonize },
+                { "HSVTransform", &hsvTransform },
+                { "FlipRedBlue", &flipRedBlue },
+                { "FlipRedBlueAndInvertRed", &flipRedBlueAndInvertRed },
+                { "HighlightSimilarColors", &highlightSimilarColors },
+            };
+        }
+    };
+
+    double initializeAllFilters ()
+    {
+        Filters filters;
+        const double startTime = currentDateInSeconds();
+        for (auto& it : filters.all())
+            it.second->initializeGL ();
+        glFinish ();
+        return currentDateInSeconds() - startTime;
+    }
+
+} // anonymous
+
+// Usage: bench_Filters [cacheDirectory]
+// Without cacheDirectory an empty temporary one is used and removed at exit.
+// Measures the shader startup cost with and without the program binary
+// cache, and the latency of the first render of each filter, which now
+// includes the lazy compilation. Note that some drivers like Mesa have
+// their own disk cache, which also makes the no cache numbers lower.
+int main (int argc, char** argv)
+{
+    if (!glfwInit())
+    {
+        fprintf (stderr, "Could not initialize GLFW.\n");
+        return 1;
+    }
+
+    GLContext context;
+    if (gl3wInit() != 0)
+    {
+        fprintf (stderr, "Could not initialize the GL loader.\n");
+        return 1;
+    }
+
+    namespace fs = std::filesystem;
+    fs::path temporaryDirectory;
+    if (argc <= 1)
+    {
+        temporaryDirectory = fs::temp_directory_path() / formatted ("dl_bench_shaders_%lld", (long long)(currentDateInSeconds() * 1e6));
+        std::error_code ec;
+        if (!fs::create_directories (temporaryDirectory, ec))
+        {
+            fprintf (stderr, "Could not create %s.\n", temporaryDirectory.c_str());
+            return 1;
+        }
+    }
+    const std::string cacheDirectory = argc > 1 ? argv[1] : temporaryDirectory.string();
+    fprintf (stderr, "Renderer: %s\n", (const char*)glGetString(GL_RENDERER));
+    fprintf (stderr, "Cache directory: %s\n", cacheDirectory.c_str());
+
+    GLShader::setProgramCacheDirectory ("");
+    fprintf (stderr, "[startup] no cache: %.2f ms\n", initializeAllFilters() * 1e3);
+
+    GLShader::setProgramCacheDirectory (cacheDirectory);
+    // The first run only populates the cache if it was empty.
+    fprintf (stderr, "[startup] cache, first run: %.2f ms\n", initializeAllFilters() * 1e3);
+    fprintf (stderr, "[startup] cache, next run: %.2f ms\n", initializeAllFilters() * 1e3);
+
+    ImageSRGBA im (1920, 1080);
+    im.fill (PixelSRGBA(128, 64, 32, 255));
+    GLTexture texture;
+    texture.initialize ();
+    texture.upload (im);
+
+    GLFilterProcessor processor;
+    processor.initializeGL ();
+
+    for (const bool withCache : { false, true })
+    {
+        GLShader::setProgramCacheDirectory (withCache ? cacheDirectory : "");
+        Filters filters;
+        for (auto& it : filters.all())
+        {
+            auto renderOnce = [&]() {
+                const double startTime = currentDateInSeconds();
+                processor.render (*it.second, texture.textureId(), texture.width(), texture.height());
+                glFinish ();
+                return currentDateInSeconds() - startTime;
+            };
+
+            const double firstSwitch = renderOnce ();
+            const double nextFrame = renderOnce ();
+            fprintf (stderr, "[first switch%s] %s: %.2f ms (next frame %.2f ms)\n",
+                     withCache ? ", cache" : "", it.first, firstSwitch * 1e3, nextFrame * 1e3);
+        }
+    }
+
+    if (!temporaryDirectory.empty())
+    {
+        std::error_code ec;
+        fs::remove_all (temporaryDirectory, ec);
+    }
+    return 0;
+}
@@ -0,0 +1,107 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#include <Dalton/Utils.h>
+#include <Dalton/Image.h>
+#include <Dalton/Filters.h>
+#include <Dalton/OpenGL.h>
+
+#include <gl3w/GL/gl3w.h>
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+using namespace dl;
+
+namespace
+{
+
+    double medianDurationInSeconds (const std::function<void()>& f, int numRuns)
+    {
+        std::vector<double> durations;
+        for (int i = 0; i < numRuns; ++i)
+        {
+            const double startTime = currentDateInSeconds();
+            f ();
+            durations.push_back (currentDateInSeconds() - startTime);
+        }
+        std::sort (durations.begin(), durations.end());
+        return durations[durations.size() / 2];
+    }
+
+} // anonymous
+
+// Usage: bench_HeadlessFilters
+// Compares the GPU path in a surfaceless EGL context, so without any
+// display, with the CPU path of Daltonize for several image sizes. The GPU
+// numbers include the upload and the download, like a server would pay
+// for a single image. Run it with LIBGL_ALWAYS_SOFTWARE=1 to get the
+// llvmpipe numbers on a machine with a GPU.
+int main (int argc, char** argv)
+{
+    GLContext context (nullptr, GLContext::Backend::EGLSurfaceless);
+    if (!context.isValid())
+    {
+        fprintf (stderr, "Could not create the surfaceless EGL context.\n");
+        return 1;
+    }
+
+    if (gl3wInit() != 0)
+    {
+        fprintf (stderr, "Could not initialize the GL loader.\n");
+        return 1;
+    }
+
+    fprintf (stderr, "Renderer: %s\n", (const char*)glGetString(GL_RENDERER));
+    fprintf (stderr, "Max texture size: %d\n", glMaxTextureSize());
+
+    Filter_Daltonize daltonize;
+    GLFilterProcessor processor;
+    processor.initializeGL ();
+
+    // Large images get split into tiles on GPUs with a small max texture size.
+    GLTiledTexture texture;
+    const int numRuns = 3;
+    const std::vector<std::pair<int,int>> sizes = { {256, 256}, {1024, 1024}, {1920, 1080}, {3840, 2160}, {7680, 4320} };
+    for (const auto& size : sizes)
+    {
+        ImageSRGBA im (size.first, size.second);
+        im.apply ([](int c, int r, PixelSRGBA& p) {
+            p = PixelSRGBA (uint8_t(c), uint8_t(r), uint8_t(c ^ r), 255);
+        });
+
+        ImageSRGBA cpuOutput;
+        const double cpuDuration = medianDurationInSeconds ([&]() {
+            daltonize.applyCPU (im, cpuOutput);
+        }, numRuns);
+
+        // The first run compiles the shader and allocates the textures.
+        ImageSRGBA gpuOutput;
+        texture.upload (im);
+        processor.render (daltonize, texture, gpuOutput);
+
+        const double uploadDuration = medianDurationInSeconds ([&]() {
+            texture.upload (im);
+            glFinish ();
+        }, numRuns);
+
+        // The download waits for the rendering to finish.
+        const double renderDuration = medianDurationInSeconds ([&]() {
+            processor.render (daltonize, texture, gpuOutput);
+        }, numRuns);
+
+        fprintf (stderr, "[%dx%d] CPU: %.2f ms, GPU: %.2f ms (upload %.2f ms, filter + download %.2f ms, %d tiles)\n",
+                 im.width(), im.height(),
+                 cpuDuration * 1e3,
+                 (uploadDuration + renderDuration) * 1e3,
+                 uploadDuration * 1e3,
+                 renderDuration * 1e3,
+                 texture.numTiles());
+    }
+
+    return 0;
+}
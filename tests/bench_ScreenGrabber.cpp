@@ -0,0 +1,68 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#include <Dalton/Utils.h>
+#include <Dalton/Image.h>
+#include <DaltonGUI/PlatformSpecific.h>
+
+#include <X11/Xlib.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+using namespace dl;
+
+// Usage: bench_ScreenGrabber [numIterations]
+// Compares the XShm path with the XGetImage fallback for a 4K grab
+// (or the full screen if smaller).
+int main (int argc, char** argv)
+{
+    const int numIterations = argc > 1 ? atoi(argv[1]) : 50;
+
+    Display* display = XOpenDisplay (nullptr);
+    if (!display)
+    {
+        fprintf (stderr, "Could not open the X display.\n");
+        return 1;
+    }
+    const int screenWidth = DisplayWidth (display, DefaultScreen(display));
+    const int screenHeight = DisplayHeight (display, DefaultScreen(display));
+    XCloseDisplay (display);
+
+    const auto rect = Rect::from_x_y_w_h (0, 0, std::min(screenWidth, 3840), std::min(screenHeight, 2160));
+
+    auto bench = [&](const char* name) {
+        ScreenGrabber grabber;
+        ImageSRGBA image;
+        // Warmup, also allocates the segment.
+        if (!grabber.grabScreenArea (rect, image))
+        {
+            fprintf (stderr, "%s: grab failed\n", name);
+            return;
+        }
+
+        std::vector<double> timings;
+        for (int i = 0; i < numIterations; ++i)
+        {
+            const double startTime = currentDateInSeconds();
+            grabber.grabScreenArea (rect, image);
+            timings.push_back (currentDateInSeconds() - startTime);
+        }
+        std::sort (timings.begin(), timings.end());
+        double mean = 0;
+        for (double t : timings) mean += t;
+        mean /= timings.size();
+        fprintf (stderr, "[%s] %dx%d: mean %.2f ms, median %.2f ms, min %.2f ms\n",
+                 name, int(rect.size.x), int(rect.size.y),
+                 mean*1e3, timings[timings.size()/2]*1e3, timings.front()*1e3);
+    };
+
+    bench ("XShm");
+    setenv ("DALTONLENS_DISABLE_XSHM", "1", 1);
+    bench ("XGetImage");
+    return 0;
+}
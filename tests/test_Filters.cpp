@@ -9,6 +9,7 @@
 #include <Dalton/Image.h>
 #include <Dalton/Filters.h>
 #include <Dalton/OpenGL.h>
+#include <Dalton/Platform.h>
 
 #include <tests/Common.h>
 
@@ -152,6 +153,607 @@ UTEST(Daltonize, DaltonizeGPU)
     testDaltonize (params, "brettel1997_tritan_wn_0.55", toleranceForSimulations);
 }
 
+UTEST(GLAsyncReadback, MatchesSyncDownload)
+{
+    ImageSRGBA im;
+    const std::string sourceImagePrefix = TEST_IMAGES_DIR;
+    readPngImage (sourceImagePrefix + "input.png", im);
+
+    int glfw_err = glfwInit();
+    ASSERT_EQ(glfw_err, GLFW_TRUE);
+
+    GLContext context;
+    int gl3w_err = gl3wInit();
+    ASSERT_EQ(gl3w_err, 0);
+
+    GLTexture texture;
+    texture.initialize ();
+    texture.upload (im);
+
+    Filter_Daltonize filter;
+    filter.initializeGL ();
+    GLFilterProcessor processor;
+    processor.initializeGL ();
+
+    ImageSRGBA syncOutput;
+    processor.render (filter, texture.textureId(), texture.width(), texture.height(), &syncOutput);
+
+    // More requests than buffers, so some have to wait for the previous ones.
+    GLAsyncReadback readback (2);
+    int numReceived = 0;
+    bool allMatch = true;
+    for (int i = 0; i < 5; ++i)
+    {
+        auto checkFiltered = [&](ImageSRGBA&& output) {
+            ++numReceived;
+            allMatch &= imagesAreSimilar (syncOutput, output, 0);
+        };
+
+        processor.render (filter, texture.textureId(), texture.width(), texture.height());
+        while (!readback.requestTexture (processor.filteredTexture(), checkFiltered))
+            readback.processCompleted (true /* wait */);
+    }
+
+    bool inputMatches = false;
+    auto checkInput = [&](ImageSRGBA&& output) {
+        inputMatches = imagesAreSimilar (im, output, 0);
+    };
+    while (!readback.requestTexture (texture, checkInput))
+        readback.processCompleted (true /* wait */);
+
+    // Small area around a pixel, like the cursor overlay does.
+    const dl::Rect rect = dl::Rect::from_x_y_w_h (100, 40, 31, 31);
+    bool rectMatches = false;
+    auto checkRect = [&](ImageSRGBA&& output) {
+        rectMatches = imagesAreSimilar (crop(syncOutput, rect), output, 0);
+    };
+    while (!readback.requestTextureRect (processor.filteredTexture(), rect, checkRect))
+        readback.processCompleted (true /* wait */);
+
+    readback.processCompleted (true /* wait */);
+    ASSERT_EQ(readback.numPending(), 0);
+    ASSERT_EQ(numReceived, 5);
+    ASSERT_TRUE(allMatch);
+    ASSERT_TRUE(inputMatches);
+    ASSERT_TRUE(rectMatches);
+}
+
+UTEST(GLGpuTimers, CollectsFilterTimings)
+{
+    ImageSRGBA im;
+    const std::string sourceImagePrefix = TEST_IMAGES_DIR;
+    readPngImage (sourceImagePrefix + "input.png", im);
+
+    int glfw_err = glfwInit();
+    ASSERT_EQ(glfw_err, GLFW_TRUE);
+
+    GLContext context;
+    int gl3w_err = gl3wInit();
+    ASSERT_EQ(gl3w_err, 0);
+
+    if (!glHasTimerQueries ())
+        return;
+
+    GLTexture texture;
+    texture.initialize ();
+    Filter_Daltonize filter;
+    GLFilterProcessor processor;
+    processor.initializeGL ();
+
+    GLGpuTimers::setEnabled (true);
+    GLGpuTimers::resetStats ();
+    for (int i = 0; i < 4; ++i)
+    {
+        texture.upload (im);
+        processor.render (filter, texture.textureId(), texture.width(), texture.height());
+    }
+    glFinish ();
+    GLGpuTimers::collectResults ();
+    GLGpuTimers::setEnabled (false);
+
+    const auto stats = GLGpuTimers::stats ();
+    ASSERT_EQ(stats.size(), size_t(2));
+    ASSERT_STREQ(stats[0].name.c_str(), "Daltonize");
+    ASSERT_EQ(stats[0].numSamples, 4);
+    ASSERT_STREQ(stats[1].name.c_str(), "Texture upload");
+    ASSERT_EQ(stats[1].numSamples, 4);
+    ASSERT_TRUE(stats[0].minMs <= stats[0].meanMs && stats[0].meanMs <= stats[0].p95Ms);
+}
+
+UTEST(GLFilterGraph, FusedMatchesSeparatePasses)
+{
+    ImageSRGBA im;
+    const std::string sourceImagePrefix = TEST_IMAGES_DIR;
+    readPngImage (sourceImagePrefix + "input.png", im);
+
+    int glfw_err = glfwInit();
+    ASSERT_EQ(glfw_err, GLFW_TRUE);
+
+    GLContext context;
+    int gl3w_err = gl3wInit();
+    ASSERT_EQ(gl3w_err, 0);
+
+    GLTexture texture;
+    texture.initialize ();
+    texture.upload (im);
+
+    Filter_Daltonize::Params params;
+    params.kind = Filter_Daltonize::Params::Kind::Deuteranope;
+    Filter_Daltonize correction;
+    correction.setParams (params);
+    correction.initializeGL ();
+
+    params.simulateOnly = true;
+    Filter_Daltonize simulation;
+    simulation.setParams (params);
+    simulation.initializeGL ();
+
+    Filter_HSVTransform hsvTransform;
+    hsvTransform.initializeGL ();
+
+    // A single filter must give the same result as GLFilterProcessor.
+    GLFilterProcessor processor;
+    processor.initializeGL ();
+    ImageSRGBA processorOutput;
+    processor.render (correction, texture.textureId(), texture.width(), texture.height(), &processorOutput);
+
+    GLFilterGraph graph;
+    graph.initializeGL ();
+    ImageSRGBA graphOutput;
+    graph.setFilters ({ &correction });
+    graph.render (texture.textureId(), texture.width(), texture.height(), &graphOutput);
+    ASSERT_EQ(graph.numPasses(), 1);
+    ASSERT_TRUE(imagesAreSimilar(processorOutput, graphOutput, 0));
+
+    graph.setFilters ({ &correction, &simulation, &hsvTransform });
+    ImageSRGBA fusedOutput;
+    graph.render (texture.textureId(), texture.width(), texture.height(), &fusedOutput);
+    ASSERT_EQ(graph.numPasses(), 1);
+
+    graph.setFusionEnabled (false);
+    ImageSRGBA separateOutput;
+    graph.render (texture.textureId(), texture.width(), texture.height(), &separateOutput);
+    ASSERT_EQ(graph.numPasses(), 3);
+
+    // The fused pass does not round the intermediate results.
+    ASSERT_TRUE(imagesAreSimilar(fusedOutput, separateOutput, 3));
+
+    // The last output texture must have the same content.
+    ImageSRGBA textureOutput;
+    graph.filteredTexture().download (textureOutput);
+    ASSERT_TRUE(imagesAreSimilar(separateOutput, textureOutput, 0));
+}
+
+UTEST(GLFilterGraph, RenderIfChangedSkipsRedundantPasses)
+{
+    ImageSRGBA im;
+    const std::string sourceImagePrefix = TEST_IMAGES_DIR;
+    readPngImage (sourceImagePrefix + "input.png", im);
+
+    int glfw_err = glfwInit();
+    ASSERT_EQ(glfw_err, GLFW_TRUE);
+
+    GLContext context;
+    int gl3w_err = gl3wInit();
+    ASSERT_EQ(gl3w_err, 0);
+
+    GLTexture texture;
+    texture.initialize ();
+    texture.upload (im);
+
+    Filter_HSVTransform hsvTransform;
+    GLFilterGraph graph;
+    graph.initializeGL ();
+    graph.setFilters ({ &hsvTransform });
+    ASSERT_TRUE(graph.renderIfChanged (texture));
+    ASSERT_FALSE(graph.renderIfChanged (texture));
+
+    // New params.
+    Filter_HSVTransform::Params params;
+    params.hueShift = 90;
+    hsvTransform.setParams (params);
+    ASSERT_TRUE(graph.renderIfChanged (texture));
+    ASSERT_FALSE(graph.renderIfChanged (texture));
+
+    // New input content, even with the same texture id.
+    texture.upload (im);
+    ASSERT_TRUE(graph.renderIfChanged (texture));
+
+    // New filters.
+    Filter_FlipRedBlue flipRedBlue;
+    graph.setFilters ({ &hsvTransform, &flipRedBlue });
+    ASSERT_TRUE(graph.renderIfChanged (texture));
+    ASSERT_FALSE(graph.renderIfChanged (texture));
+
+    // The skipped renders must leave the output untouched.
+    ImageSRGBA expectedOutput;
+    graph.render (texture.textureId(), texture.width(), texture.height(), &expectedOutput);
+    ASSERT_TRUE(graph.renderIfChanged (texture));
+    ASSERT_FALSE(graph.renderIfChanged (texture));
+    ImageSRGBA textureOutput;
+    graph.filteredTexture().download (textureOutput);
+    ASSERT_TRUE(imagesAreSimilar(expectedOutput, textureOutput, 0));
+}
+
+UTEST(GLFilterGraph, RegionOfInterestMatchesCrop)
+{
+    ImageSRGBA im;
+    const std::string sourceImagePrefix = TEST_IMAGES_DIR;
+    readPngImage (sourceImagePrefix + "input.png", im);
+
+    int glfw_err = glfwInit();
+    ASSERT_EQ(glfw_err, GLFW_TRUE);
+
+    GLContext context;
+    int gl3w_err = gl3wInit();
+    ASSERT_EQ(gl3w_err, 0);
+
+    GLTexture texture;
+    texture.initialize ();
+    texture.upload (im);
+
+    Filter_Daltonize daltonize;
+    Filter_FlipRedBlue flipRedBlue;
+    GLFilterGraph graph;
+    graph.initializeGL ();
+    graph.setFilters ({ &daltonize, &flipRedBlue });
+    graph.setFusionEnabled (false);
+
+    ImageSRGBA fullOutput;
+    graph.render (texture.textureId(), texture.width(), texture.height(), &fullOutput);
+
+    const dl::Rect uvRect = dl::Rect::from_x_y_w_h (0.25, 0.3, 0.2, 0.25);
+    const dl::Rect roi = GLFilterGraph::textureRectForUVRect (uvRect, texture.width(), texture.height(), 4);
+    ASSERT_EQ(roi.origin.x, 50.);
+    ASSERT_EQ(roi.origin.y, 41.);
+    ASSERT_EQ(roi.size.x, 52.);
+    ASSERT_EQ(roi.size.y, 46.);
+
+    graph.setRegionOfInterest (roi);
+    ImageSRGBA roiOutput;
+    graph.render (texture.textureId(), texture.width(), texture.height(), &roiOutput);
+    ASSERT_EQ(graph.filteredTexture().width(), 52);
+    ASSERT_EQ(graph.filteredTexture().height(), 46);
+    ASSERT_TRUE(imagesAreSimilar(crop(fullOutput, roi), roiOutput, 0));
+
+    ImageSRGBA cpuOutput;
+    ImageSRGBA cpuRoiOutput;
+    daltonize.applyCPU (im, cpuOutput);
+    daltonize.applyCPUOnRegion (im, roi, cpuRoiOutput);
+    ASSERT_TRUE(imagesAreSimilar(crop(cpuOutput, roi), cpuRoiOutput, 0));
+}
+
+UTEST(GLTiledTexture, TiledRenderMatchesSingleTexture)
+{
+    ImageSRGBA im;
+    const std::string sourceImagePrefix = TEST_IMAGES_DIR;
+    readPngImage (sourceImagePrefix + "input.png", im);
+
+    int glfw_err = glfwInit();
+    ASSERT_EQ(glfw_err, GLFW_TRUE);
+
+    GLContext context;
+    int gl3w_err = gl3wInit();
+    ASSERT_EQ(gl3w_err, 0);
+
+    GLTexture texture;
+    texture.initialize ();
+    texture.upload (im);
+
+    // Small tiles to get partial ones on the right and bottom borders.
+    GLTiledTexture tiledTexture;
+    tiledTexture.setMaxTileSize (64);
+    tiledTexture.upload (im);
+    ASSERT_EQ(tiledTexture.tileBorder(), 16);
+    const int tileStep = 64 - 2 * tiledTexture.tileBorder();
+    const int expectedNumTiles = ((im.width() + tileStep - 1) / tileStep) * ((im.height() + tileStep - 1) / tileStep);
+    ASSERT_EQ(tiledTexture.numTiles(), expectedNumTiles);
+    ASSERT_EQ(tiledTexture.tileIndexForPixel (im.width() - 1, im.height() - 1), expectedNumTiles - 1);
+
+    // The textures include the border pixels of the neighbor tiles.
+    auto tilesMatch = [&](const ImageSRGBA& expected) {
+        for (int i = 0; i < tiledTexture.numTiles(); ++i)
+        {
+            GLTiledTexture::Tile& tile = tiledTexture.tile(i);
+            ImageSRGBA tileIm;
+            tile.texture.download (tileIm);
+            if (tile.textureRect.size.x > 64 || tile.textureRect.size.y > 64
+                || !imagesAreSimilar (crop(expected, tile.textureRect), tileIm, 0))
+                return false;
+        }
+        return true;
+    };
+    ASSERT_TRUE(tilesMatch (im));
+
+    Filter_Daltonize daltonize;
+    GLFilterProcessor processor;
+    processor.initializeGL ();
+
+    ImageSRGBA expectedOutput;
+    processor.render (daltonize, texture.textureId(), texture.width(), texture.height(), &expectedOutput);
+
+    ImageSRGBA tiledOutput;
+    processor.render (daltonize, tiledTexture, tiledOutput);
+    ASSERT_TRUE(imagesAreSimilar(expectedOutput, tiledOutput, 0));
+
+    // Updates crossing the tile borders.
+    ImageSRGBA updatedIm = im;
+    updatedIm.apply ([](int c, int r, PixelSRGBA& p) {
+        if (c >= 50 && c < 150 && r >= 40 && r < 100)
+            p = PixelSRGBA (255 - p.r, p.g, 255 - p.b, p.a);
+    });
+    texture.upload (updatedIm);
+    tiledTexture.uploadSubRect (updatedIm, 50, 40, 100, 60);
+    ASSERT_TRUE(tilesMatch (updatedIm));
+    processor.render (daltonize, texture.textureId(), texture.width(), texture.height(), &expectedOutput);
+    processor.render (daltonize, tiledTexture, tiledOutput);
+    ASSERT_TRUE(imagesAreSimilar(expectedOutput, tiledOutput, 0));
+}
+
+UTEST(GLTiledTexture, LinearSamplingMatchesAcrossTileBorders)
+{
+    ImageSRGBA im;
+    const std::string sourceImagePrefix = TEST_IMAGES_DIR;
+    readPngImage (sourceImagePrefix + "input.png", im);
+
+    int glfw_err = glfwInit();
+    ASSERT_EQ(glfw_err, GLFW_TRUE);
+
+    GLContext context;
+    int gl3w_err = gl3wInit();
+    ASSERT_EQ(gl3w_err, 0);
+
+    GLTexture texture;
+    texture.initialize ();
+    texture.upload (im);
+    texture.setLinearInterpolationEnabled (true);
+
+    GLTiledTexture tiledTexture;
+    tiledTexture.setMaxTileSize (64);
+    tiledTexture.upload (im);
+    tiledTexture.setLinearInterpolationEnabled (true);
+    ASSERT_GT(tiledTexture.numTiles(), 1);
+
+    Filter_FlipRedBlue flipRedBlue;
+    GLFilterProcessor processor;
+    processor.initializeGL ();
+
+    // Half a pixel off, each output pixel blends 4 texels. The last row and
+    // column of each tile blend with the first ones of the next tile, which
+    // need to be in its border to match the untiled texture. The image edges
+    // are left out, that's the wrap mode and not the tiling.
+    bool allMatch = true;
+    for (int i = 0; i < tiledTexture.numTiles(); ++i)
+    {
+        const GLTiledTexture::Tile& tile = tiledTexture.tile(i);
+        dl::Rect imageRect = tile.imageRect;
+        if (imageRect.origin.x + imageRect.size.x >= im.width())
+            imageRect.size.x -= 1;
+        if (imageRect.origin.y + imageRect.size.y >= im.height())
+            imageRect.size.y -= 1;
+        imageRect.origin += dl::Point(0.5, 0.5);
+
+        ImageSRGBA expectedOutput;
+        processor.render (flipRedBlue, texture.textureId(), texture.width(), texture.height(), imageRect, &expectedOutput);
+
+        dl::Rect rectInTile = imageRect;
+        rectInTile.origin -= tile.textureRect.origin;
+        ImageSRGBA tileOutput;
+        processor.render (flipRedBlue, tile.texture.textureId(), tile.texture.width(), tile.texture.height(), rectInTile, &tileOutput);
+
+        // The interpolation weights can round differently with another texture size.
+        allMatch &= imagesAreSimilar (expectedOutput, tileOutput, 1);
+    }
+    ASSERT_TRUE(allMatch);
+}
+
+UTEST(GLTexturePool, ReusesReleasedStorage)
+{
+    int glfw_err = glfwInit();
+    ASSERT_EQ(glfw_err, GLFW_TRUE);
+
+    GLContext context;
+    int gl3w_err = gl3wInit();
+    ASSERT_EQ(gl3w_err, 0);
+
+    if (!glHasTextureStorage ())
+    {
+        fprintf (stderr, "No immutable texture storage, skipping.\n");
+        return;
+    }
+
+    ImageSRGBA im (64, 32);
+    im.fill (PixelSRGBA (10, 20, 30, 255));
+
+    GLTexturePool& pool = GLTexturePool::shared();
+    // Room for 2 textures of 64x32.
+    pool.setBudgetInBytes (2 * 64 * 32 * 4);
+
+    uint32_t firstTextureId = 0;
+    {
+        GLTexture texture;
+        texture.initialize ();
+        texture.upload (im);
+        firstTextureId = texture.textureId ();
+    }
+    ASSERT_EQ(pool.numPooledTextures(), 1);
+
+    // Same size, the storage gets reused and the content replaced.
+    GLTexture texture;
+    texture.initialize ();
+    texture.upload (im);
+    ASSERT_EQ(texture.textureId(), firstTextureId);
+    ASSERT_EQ(pool.numPooledTextures(), 0);
+    ImageSRGBA downloaded;
+    texture.download (downloaded);
+    ASSERT_TRUE(imagesAreSimilar(im, downloaded, 0));
+
+    // Different sizes go to different buckets, the oldest gets evicted.
+    for (int height : { 31, 30, 29 })
+    {
+        GLTexture other;
+        other.initialize ();
+        other.upload (ImageSRGBA (64, height));
+    }
+    ASSERT_EQ(pool.numPooledTextures(), 2);
+    ASSERT_TRUE(pool.pooledBytes() <= pool.budgetInBytes());
+
+    pool.clear ();
+    pool.setBudgetInBytes (0);
+    ASSERT_EQ(pool.numPooledTextures(), 0);
+}
+
+// Compares the cached bindings with the ones of the current context.
+bool stateCacheMatchesGL (const char* step)
+{
+    GLStateCache& cache = GLStateCache::current();
+    GLint texture = 0, drawFbo = 0, readFbo = 0, program = 0, packBuffer = 0;
+    glGetIntegerv (GL_TEXTURE_BINDING_2D, &texture);
+    glGetIntegerv (GL_DRAW_FRAMEBUFFER_BINDING, &drawFbo);
+    glGetIntegerv (GL_READ_FRAMEBUFFER_BINDING, &readFbo);
+    glGetIntegerv (GL_CURRENT_PROGRAM, &program);
+    glGetIntegerv (GL_PIXEL_PACK_BUFFER_BINDING, &packBuffer);
+    if (cache.texture2D() == uint32_t(texture)
+        && cache.drawFramebuffer() == uint32_t(drawFbo)
+        && cache.readFramebuffer() == uint32_t(readFbo)
+        && cache.program() == uint32_t(program)
+        && cache.pixelPackBuffer() == uint32_t(packBuffer))
+        return true;
+
+    dl_dbg ("[%s] cache (texture %d draw %d read %d program %d pack %d) vs GL (texture %d draw %d read %d program %d pack %d)",
+            step, cache.texture2D(), cache.drawFramebuffer(), cache.readFramebuffer(), cache.program(), cache.pixelPackBuffer(),
+            texture, drawFbo, readFbo, program, packBuffer);
+    return false;
+}
+
+UTEST(GLStateCache, MatchesGLBindings)
+{
+    int glfw_err = glfwInit();
+    ASSERT_EQ(glfw_err, GLFW_TRUE);
+
+    GLContext context;
+    int gl3w_err = gl3wInit();
+    ASSERT_EQ(gl3w_err, 0);
+
+    GLStateCache& cache = GLStateCache::current();
+    ASSERT_TRUE(stateCacheMatchesGL ("initial"));
+
+    ImageSRGBA im (16, 8);
+    im.fill (PixelSRGBA (10, 20, 30, 255));
+
+    GLTexture texture;
+    texture.initialize ();
+    texture.upload (im);
+    ASSERT_TRUE(stateCacheMatchesGL ("texture upload"));
+
+    GLShader shader;
+    shader.initialize (glslVersion(), nullptr, nullptr);
+    shader.enable ();
+    ASSERT_TRUE(stateCacheMatchesGL ("shader enable"));
+
+    GLFrameBuffer frameBuffer;
+    frameBuffer.enable (im.width(), im.height());
+    ASSERT_TRUE(stateCacheMatchesGL ("framebuffer enable"));
+
+    // Nested saves, the inner texture gets deleted while saved.
+    cache.pushTexture2D ();
+    {
+        GLTexture savedThenDeleted;
+        savedThenDeleted.initialize ();
+        savedThenDeleted.upload (im);
+        cache.bindTexture2D (savedThenDeleted.textureId());
+        cache.pushTexture2D ();
+        cache.bindTexture2D (texture.textureId());
+        ASSERT_TRUE(stateCacheMatchesGL ("push and bind"));
+        savedThenDeleted.releaseGL ();
+        ASSERT_TRUE(stateCacheMatchesGL ("delete saved texture"));
+        cache.popTexture2D ();
+        ASSERT_EQ(cache.texture2D(), 0u);
+        ASSERT_TRUE(stateCacheMatchesGL ("pop deleted texture"));
+    }
+
+    {
+        // The pack buffer of the caller must be restored.
+        GLuint callerBuffer = 0;
+        glGenBuffers (1, &callerBuffer);
+        cache.bindPixelPackBuffer (callerBuffer);
+
+        GLAsyncReadback readback (2);
+        bool received = false;
+        auto onReadback = [&](ImageSRGBA&&) { received = true; };
+        ASSERT_TRUE(readback.requestTexture (texture, onReadback));
+        ASSERT_TRUE(stateCacheMatchesGL ("readback texture"));
+        ASSERT_TRUE(readback.requestReadPixels (im.width(), im.height(), onReadback));
+        ASSERT_TRUE(stateCacheMatchesGL ("readback framebuffer"));
+        readback.processCompleted (true /* wait */);
+        ASSERT_TRUE(received);
+        ASSERT_TRUE(stateCacheMatchesGL ("readback completed"));
+        ASSERT_EQ(cache.pixelPackBuffer(), callerBuffer);
+        readback.releaseGL ();
+        ASSERT_TRUE(stateCacheMatchesGL ("readback release"));
+
+        cache.deleteBuffer (callerBuffer);
+        ASSERT_TRUE(stateCacheMatchesGL ("delete bound pack buffer"));
+    }
+
+    cache.popTexture2D ();
+    ASSERT_TRUE(stateCacheMatchesGL ("pop"));
+
+    // Deleting the bound texture reverts the binding to 0.
+    cache.bindTexture2D (texture.textureId());
+    texture.releaseGL ();
+    ASSERT_TRUE(stateCacheMatchesGL ("delete bound texture"));
+
+    shader.disable ();
+    ASSERT_TRUE(stateCacheMatchesGL ("shader disable"));
+    frameBuffer.disable ();
+    ASSERT_TRUE(stateCacheMatchesGL ("framebuffer disable"));
+
+    // Same for a framebuffer deleted while bound.
+    {
+        GLFrameBuffer boundThenDeleted;
+        boundThenDeleted.enable (im.width(), im.height());
+    }
+    ASSERT_TRUE(stateCacheMatchesGL ("delete bound framebuffer"));
+    ASSERT_EQ(cache.drawFramebuffer(), 0u);
+}
+
+#if PLATFORM_LINUX
+UTEST(GLContext, EGLSurfacelessMatchesCPU)
+{
+    ImageSRGBA im;
+    const std::string sourceImagePrefix = TEST_IMAGES_DIR;
+    readPngImage (sourceImagePrefix + "input.png", im);
+
+    // No GLFW, this should work without any display.
+    GLContext context (nullptr, GLContext::Backend::EGLSurfaceless);
+    if (!context.isValid())
+    {
+        fprintf (stderr, "No surfaceless EGL support, skipping.\n");
+        return;
+    }
+
+    int gl3w_err = gl3wInit();
+    ASSERT_EQ(gl3w_err, 0);
+
+    GLTexture texture;
+    texture.initialize ();
+    texture.upload (im);
+
+    Filter_Daltonize daltonize;
+    GLFilterProcessor processor;
+    processor.initializeGL ();
+
+    ImageSRGBA gpuOutput;
+    processor.render (daltonize, texture.textureId(), texture.width(), texture.height(), &gpuOutput);
+
+    ImageSRGBA cpuOutput;
+    daltonize.applyCPU (im, cpuOutput);
+    // Same tolerance as DaltonizeGPU.
+    ASSERT_TRUE(imagesAreSimilar(cpuOutput, gpuOutput, 6));
+}
+#endif
+
 UTEST(Daltonize, DaltonizeCPU)
 {
     ImageSRGBA im;
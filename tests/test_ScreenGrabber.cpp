@@ -0,0 +1,56 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#include <Dalton/Utils.h>
+#include <Dalton/Image.h>
+#include <DaltonGUI/PlatformSpecific.h>
+
+#include <tests/Common.h>
+
+#include <cstdlib>
+
+using namespace dl;
+
+// Needs an X server, e.g. Xvfb or Xdummy.
+UTEST(ScreenGrabber, SharedMemoryMatchesXGetImage)
+{
+    const auto rect = Rect::from_x_y_w_h (13, 7, 317, 243);
+
+    ImageSRGBA shmImage;
+    {
+        ScreenGrabber grabber;
+        grabber.reserveForSize (640, 480);
+        ASSERT_TRUE (grabber.grabScreenArea (rect, shmImage));
+        if (!grabber.usesSharedMemory ())
+        {
+            // Otherwise we would just compare XGetImage with itself.
+            fprintf (stderr, "No MIT-SHM on this display, skipping.\n");
+            return;
+        }
+        // Reuse the same segment.
+        ASSERT_TRUE (grabber.grabScreenArea (rect, shmImage));
+        ASSERT_TRUE (grabber.usesSharedMemory ());
+    }
+
+    ImageSRGBA xgetImage;
+    {
+        setenv ("DALTONLENS_DISABLE_XSHM", "1", 1);
+        ScreenGrabber grabber;
+        ASSERT_TRUE (grabber.grabScreenArea (rect, xgetImage));
+        ASSERT_FALSE (grabber.usesSharedMemory ());
+        unsetenv ("DALTONLENS_DISABLE_XSHM");
+    }
+
+    ASSERT_EQ (shmImage.width(), 317);
+    ASSERT_EQ (shmImage.height(), 243);
+    ASSERT_EQ (xgetImage.width(), shmImage.width());
+    ASSERT_EQ (xgetImage.height(), shmImage.height());
+    for (int r = 0; r < shmImage.height(); ++r)
+    for (int c = 0; c < shmImage.width(); ++c)
+        ASSERT_TRUE (shmImage(c, r) == xgetImage(c, r));
+}
+
+UTEST_MAIN();
@@ -7,9 +7,18 @@
 #include <Dalton/Utils.h>
 #include <Dalton/MathUtils.h>
 #include <Dalton/Image.h>
+#include <Dalton/LosslessCodec.h>
+#include <Dalton/ImagePyramid.h>
+#include <Dalton/PixelConversion.h>
+#include <Dalton/SPSCQueue.h>
+
+#include <DaltonGUI/ScreenRecorder.h>
 
 #include <tests/Common.h>
 
+#include <filesystem>
+#include <thread>
+
 using namespace dl;
 
 UTEST(Image, BasicRGBA)
@@ -75,4 +84,328 @@ UTEST(MathUtils, Rect)
     ASSERT_DOUBLE_EQ_WITH_ACCURACY(r3.size.y, 20, 1e-7);
 }
 
+UTEST(Utils, RefreshPeriod)
+{
+    const double nominal = 1.0 / 60.0;
+
+    // 2 vblanks at 59.5Hz, the period moves 10% towards it.
+    const double measured = 1.0 / 59.5;
+    double period = refineRefreshPeriod (nominal, nominal, 10.0, 100, 10.0 + 2*measured, 102);
+    ASSERT_DOUBLE_EQ_WITH_ACCURACY(period, 0.9 * nominal + 0.1 * measured, 1e-12);
+
+    // Outliers, e.g. a 30Hz monitor or a missed counter, are ignored.
+    ASSERT_DOUBLE_EQ_WITH_ACCURACY(refineRefreshPeriod (period, nominal, 10.0, 100, 10.0 + 1.0/30.0, 101), period, 1e-12);
+    ASSERT_DOUBLE_EQ_WITH_ACCURACY(refineRefreshPeriod (period, nominal, 10.0, 100, 10.0 + 2*nominal, 101), period, 1e-12);
+    // Same or older samples.
+    ASSERT_DOUBLE_EQ_WITH_ACCURACY(refineRefreshPeriod (period, nominal, 10.0, 100, 10.0, 100), period, 1e-12);
+    ASSERT_DOUBLE_EQ_WITH_ACCURACY(refineRefreshPeriod (period, nominal, 10.0, 100, 9.9, 94), period, 1e-12);
+
+    // Converges to the measured period.
+    period = nominal;
+    for (int i = 0; i < 200; ++i)
+        period = refineRefreshPeriod (period, nominal, i * measured, i, (i+1) * measured, i+1);
+    ASSERT_DOUBLE_EQ_WITH_ACCURACY(period, measured, 1e-9);
+
+    // Next vblank after now, and never the last one again.
+    const double p = 0.016;
+    ASSERT_DOUBLE_EQ_WITH_ACCURACY(nextVblankTime (10.0, p, 10.001), 10.016, 1e-9);
+    ASSERT_DOUBLE_EQ_WITH_ACCURACY(nextVblankTime (10.0, p, 10.040), 10.048, 1e-9);
+    ASSERT_DOUBLE_EQ_WITH_ACCURACY(nextVblankTime (10.0, p, 10.0), 10.016, 1e-9);
+    ASSERT_DOUBLE_EQ_WITH_ACCURACY(nextVblankTime (10.0, p, 9.99), 10.016, 1e-9);
+}
+
+UTEST(LosslessCodec, RoundTrip)
+{
+    ImageSRGBA im (203, 117);
+    for (int r = 0; r < im.height(); ++r)
+    for (int c = 0; c < im.width(); ++c)
+    {
+        // Mix flat areas, smooth gradients and noise to exercise all the ops.
+        if (r < 40)
+            im(c, r) = PixelSRGBA(12, 34, 56, 255);
+        else if (r < 80)
+            im(c, r) = PixelSRGBA(c, c + r, r, 255);
+        else
+            im(c, r) = PixelSRGBA((c*7919 + r*104729) & 0xff, (c*c + r) & 0xff, (r*r*31) & 0xff, (c + r) & 0xff);
+    }
+
+    std::vector<uint8_t> encoded = { 42 };
+    const size_t numBytes = encodeLossless (im, encoded);
+    ASSERT_EQ(encoded.size(), numBytes + 1);
+    ASSERT_LT(numBytes, im.width() * im.height() * 4);
+
+    ImageSRGBA decoded;
+    ASSERT_TRUE(decodeLossless (encoded.data() + 1, numBytes, decoded));
+    ASSERT_EQ(decoded.width(), im.width());
+    ASSERT_EQ(decoded.height(), im.height());
+    for (int r = 0; r < im.height(); ++r)
+    for (int c = 0; c < im.width(); ++c)
+        ASSERT_TRUE(decoded(c, r) == im(c, r));
+
+    ASSERT_FALSE(decodeLossless (encoded.data() + 1, numBytes / 2, decoded));
+}
+
+UTEST(ScreenRecorder, RingWraparoundAndDroppedFrames)
+{
+    namespace fs = std::filesystem;
+    const fs::path outputDir = fs::temp_directory_path() / formatted ("dl_test_recorder_%lld", (long long)(currentDateInSeconds() * 1e6));
+    ASSERT_TRUE(fs::create_directories (outputDir));
+
+    // Each frame is filled with the number of frames generated so far.
+    const double period = 0.01;
+    int numGeneratedFrames = 0;
+    ScreenRecorder::Options options;
+    options.outputDir = outputDir.string();
+    options.targetFps = 1.0 / period;
+    options.numSegments = 2;
+    options.framesPerSegment = 3;
+    options.frameSource = [&](ImageSRGBA& frame) {
+        frame.ensureAllocatedBufferForSize (16, 8);
+        frame.fill (PixelSRGBA (numGeneratedFrames++, 0, 0, 255));
+        return true;
+    };
+
+    // 10 frames, more than the 6 of the ring. The 8th one comes 4.5 periods
+    // after the 7th, so the slots 7, 8 and 9 get dropped.
+    std::vector<double> timestamps;
+    for (int i = 0; i < 7; ++i)
+        timestamps.push_back (i * period);
+    for (int i = 0; i < 3; ++i)
+        timestamps.push_back ((10.5 + i) * period);
+
+    ScreenRecorder recorder;
+    ASSERT_TRUE(recorder.startManual (options, 0.0));
+    for (double timestamp : timestamps)
+        ASSERT_TRUE(recorder.recordFrameAt (timestamp));
+    recorder.stop ();
+
+    const ScreenRecorder::Stats stats = recorder.stats();
+    ASSERT_EQ(stats.capturedFrames, 10);
+    ASSERT_EQ(stats.failedGrabs, 0);
+    ASSERT_EQ(stats.droppedFrames, 3);
+
+    // The last segment gets the most recent frame, the other one
+    // the full previous segment.
+    ScreenRecordingReader reader;
+    ASSERT_TRUE(reader.open (options.outputDir));
+    ASSERT_EQ(reader.numFrames(), 4);
+
+    // Dropped slots still consume a frame index.
+    const int64_t expectedFrameIndices[] = { 6, 10, 11, 12 };
+    for (int i = 0; i < reader.numFrames(); ++i)
+    {
+        ImageSRGBA frame;
+        ASSERT_TRUE(reader.readFrame (i, frame));
+        ASSERT_EQ(frame.width(), 16);
+        ASSERT_EQ(frame.height(), 8);
+        ASSERT_EQ(int(frame(0, 0).r), 6 + i);
+        ASSERT_EQ(reader.frameInfo(i).frameIndex, expectedFrameIndices[i]);
+        ASSERT_EQ(reader.frameInfo(i).timestamp, timestamps[6 + i]);
+    }
+
+    std::error_code ec;
+    fs::remove_all (outputDir, ec);
+}
+
+UTEST(ImagePyramid, Box2x2)
+{
+    ImageSRGBA im (37, 1024);
+    for (int r = 0; r < im.height(); ++r)
+    for (int c = 0; c < im.width(); ++c)
+        im(c, r) = PixelSRGBA((c*13 + r*7) & 0xff, (c*c + r) & 0xff, (r*r*31) & 0xff, 255 - (c & 0xff));
+
+    ImagePyramid pyramid;
+    pyramid.compute (im);
+    // 18x512, 9x256, 4x128, 2x64, 1x32, 1x16, ..., 1x1
+    ASSERT_EQ(pyramid.numLevels(), 10);
+    ASSERT_EQ(pyramid.level(0).width(), 18);
+    ASSERT_EQ(pyramid.level(0).height(), 512);
+    ASSERT_EQ(pyramid.level(9).width(), 1);
+    ASSERT_EQ(pyramid.level(9).height(), 1);
+
+    const ImageSRGBA& level0 = pyramid.level(0);
+    for (int r = 0; r < level0.height(); ++r)
+    for (int c = 0; c < level0.width(); ++c)
+    for (int i = 0; i < 4; ++i)
+    {
+        const int expected = (im(2*c, 2*r).v[i] + im(2*c+1, 2*r).v[i] + im(2*c, 2*r+1).v[i] + im(2*c+1, 2*r+1).v[i] + 2) / 4;
+        ASSERT_EQ(int(level0(c, r).v[i]), expected);
+    }
+
+    // Going from 2 to 1 column, then only averaging vertically.
+    const ImageSRGBA& level3 = pyramid.level(3);
+    const ImageSRGBA& level4 = pyramid.level(4);
+    const ImageSRGBA& level5 = pyramid.level(5);
+    ASSERT_EQ(level4.width(), 1);
+    ASSERT_EQ(int(level4(0, 3).r), (level3(0, 6).r + level3(1, 6).r + level3(0, 7).r + level3(1, 7).r + 2) / 4);
+    ASSERT_EQ(int(level5(0, 3).g), (2*level4(0, 6).g + 2*level4(0, 7).g + 2) / 4);
+}
+
+UTEST(PixelConversion, BGRX)
+{
+    const int width = 67;
+    const int height = 45;
+    const int srcBytesPerRow = width*4 + 12;
+    std::vector<uint8_t> src (srcBytesPerRow * height);
+    for (size_t i = 0; i < src.size(); ++i)
+        src[i] = uint8_t(i*31 + (i >> 7));
+
+    PackedPixelFormat format;
+    for (auto path : { PixelConversionPath::Scalar, PixelConversionPath::SSSE3, PixelConversionPath::AVX2, PixelConversionPath::Auto })
+    {
+        if (!cpuSupportsPixelConversionPath (path))
+            continue;
+
+        ImageSRGBA output;
+        convertPackedPixelsToSRGBA (src.data(), srcBytesPerRow, width, height, format, output, path);
+        for (int r = 0; r < height; ++r)
+        for (int c = 0; c < width; ++c)
+        {
+            const uint8_t* p = src.data() + r*srcBytesPerRow + c*4;
+            ASSERT_TRUE(output(c, r) == PixelSRGBA(p[2], p[1], p[0], 255));
+        }
+    }
+}
+
+UTEST(PixelConversion, GenericMasks)
+{
+    // RGB565
+    {
+        const uint16_t pixels[] = { 0xffff, 0xf800, 0x07e0, 0x001f, 0x0000, 0x8410 };
+        PackedPixelFormat format;
+        format.bitsPerPixel = 16;
+        format.redMask = 0xf800;
+        format.greenMask = 0x07e0;
+        format.blueMask = 0x001f;
+        ImageSRGBA output;
+        convertPackedPixelsToSRGBA (reinterpret_cast<const uint8_t*>(pixels), sizeof(pixels), 6, 1, format, output);
+        ASSERT_TRUE(output(0, 0) == PixelSRGBA(255, 255, 255, 255));
+        ASSERT_TRUE(output(1, 0) == PixelSRGBA(255, 0, 0, 255));
+        ASSERT_TRUE(output(2, 0) == PixelSRGBA(0, 255, 0, 255));
+        ASSERT_TRUE(output(3, 0) == PixelSRGBA(0, 0, 255, 255));
+        ASSERT_TRUE(output(4, 0) == PixelSRGBA(0, 0, 0, 255));
+        ASSERT_TRUE(output(5, 0) == PixelSRGBA(132, 130, 132, 255));
+    }
+
+    // Packed 24 bits, RGB byte order in memory.
+    {
+        const uint8_t pixels[] = { 10, 20, 30,  40, 50, 60 };
+        PackedPixelFormat format;
+        format.bitsPerPixel = 24;
+        format.redMask = 0xff;
+        format.greenMask = 0xff00;
+        format.blueMask = 0xff0000;
+        ImageSRGBA output;
+        convertPackedPixelsToSRGBA (pixels, sizeof(pixels), 2, 1, format, output);
+        ASSERT_TRUE(output(0, 0) == PixelSRGBA(10, 20, 30, 255));
+        ASSERT_TRUE(output(1, 0) == PixelSRGBA(40, 50, 60, 255));
+    }
+
+    // 30 bits depth, 10 bits per channel.
+    {
+        const uint32_t pixels[] = { (1023u << 20) | (512u << 10) | 3u };
+        PackedPixelFormat format;
+        format.bitsPerPixel = 32;
+        format.redMask = 0x3ff00000;
+        format.greenMask = 0xffc00;
+        format.blueMask = 0x3ff;
+        ImageSRGBA output;
+        convertPackedPixelsToSRGBA (reinterpret_cast<const uint8_t*>(pixels), sizeof(pixels), 1, 1, format, output);
+        ASSERT_TRUE(output(0, 0) == PixelSRGBA(255, 128, 0, 255));
+    }
+
+    // BGRX but big endian, so XRGB in memory.
+    {
+        const uint8_t pixels[] = { 0, 10, 20, 30 };
+        PackedPixelFormat format;
+        format.msbFirst = true;
+        ImageSRGBA output;
+        convertPackedPixelsToSRGBA (pixels, sizeof(pixels), 1, 1, format, output);
+        ASSERT_TRUE(output(0, 0) == PixelSRGBA(10, 20, 30, 255));
+    }
+}
+
+UTEST(PixelConversion, Downsampled)
+{
+    const int width = 37;
+    const int height = 22;
+    const int srcBytesPerRow = width*4 + 8;
+    std::vector<uint8_t> src (srcBytesPerRow * height);
+    for (size_t i = 0; i < src.size(); ++i)
+        src[i] = uint8_t(i*31 + (i >> 7));
+
+    for (int bitsPerPixel : { 32, 24 })
+    for (int factor : { 2, 4 })
+    {
+        // 24 bits goes through the generic path.
+        PackedPixelFormat format;
+        format.bitsPerPixel = bitsPerPixel;
+
+        ImageSRGBA fullRes;
+        convertPackedPixelsToSRGBA (src.data(), srcBytesPerRow, width, height, format, fullRes);
+
+        ImageSRGBA output;
+        convertPackedPixelsToSRGBADownsampled (src.data(), srcBytesPerRow, width, height, format, factor, output);
+        ASSERT_EQ(output.width(), (width + factor - 1) / factor);
+        ASSERT_EQ(output.height(), (height + factor - 1) / factor);
+
+        for (int r = 0; r < output.height(); ++r)
+        for (int c = 0; c < output.width(); ++c)
+        for (int i = 0; i < 3; ++i)
+        {
+            int sum = 0, count = 0;
+            for (int rr = r*factor; rr < std::min(height, (r+1)*factor); ++rr)
+            for (int cc = c*factor; cc < std::min(width, (c+1)*factor); ++cc, ++count)
+                sum += fullRes(cc, rr).v[i];
+            ASSERT_EQ(int(output(c, r).v[i]), (sum + count/2) / count);
+        }
+        ASSERT_EQ(int(output(0, 0).a), 255);
+    }
+}
+
+UTEST(SPSCQueue, ProducerConsumer)
+{
+    SPSCQueue<std::unique_ptr<int>, 4> queue;
+
+    std::unique_ptr<int> v;
+    ASSERT_FALSE(queue.tryPop (v));
+    for (int i = 0; i < 4; ++i)
+        ASSERT_TRUE(queue.tryPush (std::make_unique<int>(i)));
+    auto extra = std::make_unique<int>(42);
+    ASSERT_FALSE(queue.tryPush (std::move(extra)));
+    ASSERT_TRUE(extra != nullptr);
+    for (int i = 0; i < 4; ++i)
+    {
+        ASSERT_TRUE(queue.tryPop (v));
+        ASSERT_EQ(*v, i);
+    }
+    ASSERT_TRUE(queue.empty());
+
+    // Everything must come out in order with concurrent access.
+    const int numValues = 100000;
+    std::thread producer ([&]() {
+        for (int i = 0; i < numValues; ++i)
+        {
+            auto value = std::make_unique<int>(i);
+            while (!queue.tryPush (std::move(value)))
+                std::this_thread::yield ();
+        }
+    });
+
+    int expected = 0;
+    while (expected < numValues)
+    {
+        if (!queue.tryPop (v))
+        {
+            std::this_thread::yield ();
+            continue;
+        }
+        if (*v != expected)
+            break;
+        ++expected;
+    }
+    producer.join ();
+    ASSERT_EQ(expected, numValues);
+}
+
 UTEST_MAIN();